@@ -0,0 +1,79 @@
+#include "cipher_bench.h"
+#include "encryption_stream_shared.h"
+#include "parallel_utils.h"
+#include "signal_utils.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <print>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr auto MEASURE_TIME = std::chrono::milliseconds(400);
+constexpr std::array<CipherSuite, 2> BENCH_SUITES{CipherSuite::xchacha20poly1305, CipherSuite::aes256gcm};
+
+// MB/s of full frames sealed by `threads` threads together, each sealing its
+// own frame over and over until MEASURE_TIME has passed. The key is random
+// and thrown away, so the frame indexes only need to be distinct.
+[[nodiscard]] double measureSealRate(CipherSuite cipher, std::size_t threads) {
+    SecureBuffer<Key> key;
+    StreamHeader header{};
+    randombytes_buf(key.buf.data(), key.buf.size());
+    randombytes_buf(header.data(), header.size());
+
+    std::vector<ParallelFrameSlot> slots(threads);
+    for (ParallelFrameSlot& slot : slots) {
+        slot.allocate(DEFAULT_STREAM_FRAME_SIZE);
+        randombytes_buf(slot.plain.data(), slot.plain.size());
+        slot.plain_size = slot.plain.size();
+    }
+
+    WorkerPool pool(threads);
+    std::atomic<uint64_t> frames{0};
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point deadline = start + MEASURE_TIME;
+    pool.run(threads, [&](std::size_t i) {
+        do {
+            throwIfSignalCancellationRequested();
+            sealParallelFrame(key.buf, header, cipher, STREAM_MODE_RAW,
+                              frames.fetch_add(1, std::memory_order_relaxed), slots[i]);
+        } while (Clock::now() < deadline);
+    });
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return static_cast<double>(frames.load()) * static_cast<double>(DEFAULT_STREAM_FRAME_SIZE) / seconds / 1e6;
+}
+} // namespace
+
+void benchmarkCiphers() {
+    const std::size_t threads = resolveWorkerThreads(0);
+    std::println("\nCipher benchmark: sealing {} KiB frames, on one core and on all {} threads.\n",
+                 DEFAULT_STREAM_FRAME_SIZE / 1024, threads);
+
+    CipherSuite fastest = CipherSuite::xchacha20poly1305;
+    double fastest_rate = 0.0;
+    for (const CipherSuite cipher : BENCH_SUITES) {
+        if (!isCipherSuiteAvailable(cipher)) {
+            std::println("  {:<20} not available (no hardware AES on this CPU)", cipherSuiteName(cipher));
+            continue;
+        }
+        const double single_rate = measureSealRate(cipher, 1);
+        const double all_rate = threads > 1 ? measureSealRate(cipher, threads) : single_rate;
+        std::println("  {:<20} {:>8.0f} MB/s per core, {:>8.0f} MB/s on all threads",
+                     cipherSuiteName(cipher), single_rate, all_rate);
+        if (all_rate > fastest_rate) {
+            fastest = cipher;
+            fastest_rate = all_rate;
+        }
+    }
+
+    if (fastest == CipherSuite::aes256gcm) {
+        std::println("\nFastest on this host: {}. Select it with \"jdvrif conceal --cipher aes256gcm ...\".\n",
+                     cipherSuiteName(fastest));
+    } else {
+        std::println("\nFastest on this host: {} (the default).\n", cipherSuiteName(fastest));
+    }
+}
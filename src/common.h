@@ -22,6 +22,8 @@
 #include <cstddef>
 #include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -34,6 +36,9 @@ using Byte = std::uint8_t;
 using vBytes = std::vector<Byte>;
 using vString = std::vector<std::string>;
 
+// Receives a byte stream in order, in chunks of whatever size the producer has.
+using ByteSink = std::function<void(std::span<const Byte>)>;
+
 using Key = std::array<Byte,  crypto_secretstream_xchacha20poly1305_KEYBYTES>;
 using Salt = std::array<Byte, crypto_pwhash_SALTBYTES>;
 using StreamHeader = std::array<Byte, crypto_secretstream_xchacha20poly1305_HEADERBYTES>;
@@ -82,10 +87,66 @@ struct SecurePin {
 inline constexpr std::size_t NO_ZLIB_COMPRESSION_ID_INDEX = 0x80;
 
 inline constexpr Byte NO_ZLIB_COMPRESSION_ID = 0x58;
+inline constexpr Byte ZSTD_COMPRESSION_ID    = 0x5A;
+
+// Encoding of the payload inside the encrypted stream. The default ICC layout
+// records it in the compression flag byte (any value other than the two IDs
+// above, including the template's own, means zlib); V3 streams also
+// authenticate it on every frame. Bluesky images are always zlib.
+enum class PayloadCodec : Byte {
+    zlib,
+    raw,
+    zstd
+};
+
+[[nodiscard]] constexpr PayloadCodec payloadCodecFromFlag(Byte flag) noexcept {
+    return flag == NO_ZLIB_COMPRESSION_ID ? PayloadCodec::raw
+         : flag == ZSTD_COMPRESSION_ID    ? PayloadCodec::zstd
+         :                                  PayloadCodec::zlib;
+}
+
+// AEAD that seals V4 frames, stored in the KDF metadata. AES-256-GCM is only
+// offered where libsodium has a hardware implementation (AES-NI + CLMUL on
+// x86-64, the Crypto Extensions on ARMv8), and recover needs the same.
+enum class CipherSuite : Byte {
+    xchacha20poly1305 = 0,
+    aes256gcm = 1
+};
+
+// V4 encryption frame size: a power of two in this range, recorded per image.
+// Larger frames mean fewer frames and calls for big payloads; smaller ones
+// bound the memory of both conceal and recover.
+inline constexpr std::size_t
+    MIN_STREAM_FRAME_SIZE     = 64 * 1024,
+    DEFAULT_STREAM_FRAME_SIZE = 1  * 1024 * 1024,
+    MAX_STREAM_FRAME_SIZE     = 16 * 1024 * 1024;
+
+// Argon2id cost of the PIN-to-key derivation, recorded per image. Recover
+// refuses anything outside these bounds before it asks for the PIN: below the
+// floor is too cheap to be worth the name, above the ceiling would let a
+// crafted image demand unbounded memory. Memory is a power of two. The
+// defaults are libsodium's INTERACTIVE limits, which every earlier format
+// used.
+inline constexpr std::size_t
+    MIN_KDF_OPSLIMIT     = 1,
+    DEFAULT_KDF_OPSLIMIT = 2,
+    MAX_KDF_OPSLIMIT     = 16,
+    MIN_KDF_MEMLIMIT     = 16   * 1024 * 1024,
+    DEFAULT_KDF_MEMLIMIT = 64   * 1024 * 1024,
+    MAX_KDF_MEMLIMIT     = 1024 * 1024 * 1024;
+
+struct KdfCost {
+    std::size_t opslimit{DEFAULT_KDF_OPSLIMIT};
+    std::size_t memlimit{DEFAULT_KDF_MEMLIMIT};
+};
 
 enum class Mode : Byte {
     conceal,
-    recover
+    conceal_batch,
+    recover,
+    verify,
+    bench_cipher,
+    calibrate_kdf
 };
 
 enum class Option : Byte {
@@ -93,6 +154,22 @@ enum class Option : Byte {
     Bluesky
 };
 
+// Conceal-mode command-line settings. Zero-valued tuning fields mean "choose
+// automatically".
+struct ConcealOptions {
+    Option option{Option::None};
+    PayloadCodec codec{PayloadCodec::zlib};
+    CipherSuite cipher{CipherSuite::xchacha20poly1305};
+    std::size_t frame_size{0};           // 0 = chosen from the data file size.
+    KdfCost kdf{};
+    std::size_t threads{0};
+    double time_budget_seconds{0.0};  // 0 = no budget; zlib level follows input size.
+    std::string_view target_platform{};  // A PLATFORM_LIMITS name, or empty.
+    bool indexed{false};                 // zlib payload as independently decodable members.
+    bool preset_dictionaries{false};     // --dictionary; --target turns it on as well.
+    bool show_stats{false};
+};
+
 enum class FileTypeCheck : Byte {
     cover_image = 1,
     embedded_image = 2,
@@ -117,6 +194,13 @@ inline constexpr auto PLATFORM_LIMITS = std::to_array<PlatformLimits>({
     {"Flickr",     200 * 1024 * 1024,  SIZE_MAX,   UINT16_MAX},
 });
 
+[[nodiscard]] constexpr const PlatformLimits* findPlatformLimits(std::string_view name) noexcept {
+    for (const PlatformLimits& limits : PLATFORM_LIMITS) {
+        if (limits.name == name) return &limits;
+    }
+    return nullptr;
+}
+
 // Indexes the conceal-mode platform *report* list built by
 // platformReportTemplate() in conceal.cpp (X-Twitter, Tumblr, Bluesky,
 // Mastodon, Pixelfed, PostImage, ImgBB, ImgPile, Flickr) — NOT the
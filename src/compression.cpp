@@ -1,17 +1,25 @@
 #include "compression.h"
+#include "binary_io.h"
 #include "file_utils.h"
+#include "parallel_utils.h"
 #include "signal_utils.h"
+#include "template_assets.h"
 
 #include <libdeflate.h>
 #include <zlib.h>
+#include <zstd.h>
 
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <format>
 #include <fstream>
 #include <span>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace {
 [[nodiscard]] int selectCompressionLevel(std::size_t input_size) {
@@ -23,17 +31,7 @@ namespace {
                                                  Z_BEST_COMPRESSION;
 }
 
-inline constexpr std::size_t
-    ZLIB_IN_CHUNK_SIZE  = 2 * 1024 * 1024,
-    ZLIB_OUT_CHUNK_SIZE = 2 * 1024 * 1024;
-
-// Files at or below this size are compressed in a single whole-buffer
-// libdeflate call. Peak RSS for that path is roughly input + compress_bound
-// (~2x input), so the cap keeps the fast path's memory bounded. Larger inputs
-// fall back to the zlib streaming deflate below, which holds only fixed chunks.
-inline constexpr std::size_t LIBDEFLATE_WHOLE_BUFFER_LIMIT = 256 * 1024 * 1024;
-
-// --------------------------- libdeflate fast path ---------------------------
+// ----------------------------- libdeflate level -----------------------------
 
 // Map the zlib level the existing heuristic picks onto a libdeflate level.
 // Measured (bench/compress_levels) on real corpora, libdeflate L9 costs ~2.6-2.9x
@@ -59,136 +57,743 @@ struct CompressorGuard {
     CompressorGuard& operator=(const CompressorGuard&) = delete;
 };
 
-[[nodiscard]] vBytes readWholeFile(const fs::path& path, std::size_t expected_size) {
-    throwIfSignalCancellationRequested();
-    std::ifstream input = openBinaryInputOrThrow(
-        path,
-        std::format("Failed to open file for compression: {}", path.string()));
-    vBytes buffer(expected_size);
-    if (expected_size > 0) {
-        readExactOrThrow(input, buffer.data(), buffer.size(),
-                         "Read Error: Failed while reading input file.");
+
+// ------------------------- windowed libdeflate deflate ----------------------
+//
+// libdeflate only compresses whole buffers, so the input is cut into fixed-size
+// windows that are compressed independently (one per WorkerPool task) as raw
+// deflate streams. The streams are then joined the way zlib's gzjoin example
+// joins gzip members: the BFINAL bit of each non-last window's final block is
+// cleared, and an empty non-final stored block pads it to a byte boundary so
+// the next window's first block can follow. One zlib header, the joined blocks
+// and the combined Adler-32 form a single RFC 1950 stream that the recover side
+// inflates exactly as it would a one-shot one. Peak RSS is bounded by the
+// windows in flight (input + output each), whatever the input size.
+
+// Window boundaries decide the output bytes, so the size is fixed: the same
+// file and level give the same stream on any machine and at any --threads.
+// It is a whole number of filter blocks, so every window starts block aligned,
+// and large enough that starting each window without history costs no
+// measurable ratio.
+inline constexpr std::size_t WINDOW_SIZE = 8 * 1024 * 1024;
+static_assert(WINDOW_SIZE % PAYLOAD_FILTER_BLOCK_SIZE == 0);
+
+// Input buffered per round across all windows in flight, which keeps RSS (at
+// roughly 2x) flat as threads are added. Threads beyond
+// ROUND_INPUT_LIMIT / WINDOW_SIZE have no window to take.
+inline constexpr std::size_t ROUND_INPUT_LIMIT = 128 * 1024 * 1024;
+
+// Bytes appended to a non-last window: at most one header byte for the empty
+// stored block, then its LEN/NLEN.
+inline constexpr std::size_t WINDOW_JOIN_MARGIN = 5;
+
+struct DeflateWindow {
+    std::span<const Byte> data{};
+    bool is_last{false};
+    vBytes output{};
+    std::size_t output_size{0};
+    uint32_t adler{0};
+};
+
+[[nodiscard]] std::array<Byte, 2> zlibStreamHeader(int libdeflate_level) {
+    constexpr Byte CMF = 0x78;  // deflate, 32 KiB window
+    const unsigned flevel = (libdeflate_level < 2) ? 0U
+                          : (libdeflate_level < 6) ? 1U
+                          : (libdeflate_level == 6) ? 2U
+                          : 3U;
+    unsigned flg = flevel << 6;
+    flg += 31U - ((static_cast<unsigned>(CMF) * 256U + flg) % 31U);
+    return {CMF, static_cast<Byte>(flg)};
+}
+
+[[nodiscard]] std::array<Byte, 4> zlibStreamTrailer(uLong adler) {
+    return {
+        static_cast<Byte>((adler >> 24) & 0xFF),
+        static_cast<Byte>((adler >> 16) & 0xFF),
+        static_cast<Byte>((adler >> 8) & 0xFF),
+        static_cast<Byte>(adler & 0xFF),
+    };
+}
+
+// Turns a complete raw deflate stream into a joinable prefix: clears BFINAL on
+// its last block and appends an empty non-final stored block. libdeflate does
+// not report where its last block starts, so block headers are found by walking
+// the stream with inflate(Z_BLOCK), which stops at every block boundary. The
+// inflated bytes are discarded; the walk costs well under the compression.
+void unterminateDeflateWindow(DeflateWindow& window) {
+    z_stream strm{};
+    if (inflateInit2(&strm, -MAX_WBITS) != Z_OK) {
+        throw std::runtime_error("zlib: inflateInit2 failed");
     }
-    requireNoTrailingDataOrThrow(input, "Read Error: Input file changed while compressing.");
-    throwIfSignalCancellationRequested();
-    return buffer;
+    struct InflateGuard {
+        z_stream* stream;
+        ~InflateGuard() { inflateEnd(stream); }
+    } guard{&strm};
+
+    constexpr std::size_t SINK_SIZE = 256 * 1024;
+    vBytes sink(SINK_SIZE);
+
+    Byte* const stream = window.output.data();
+    const std::size_t stream_size = window.output_size;
+    strm.next_in  = stream;
+    strm.avail_in = static_cast<uInt>(stream_size);
+
+    // Position of the most recent block header's BFINAL bit. The first header
+    // starts at bit 0 of the stream.
+    std::size_t final_bit_byte = 0;
+    Byte final_bit_mask = 0x01;
+
+    // data_type bit 128: stopped at a block boundary; bit 64: the block just
+    // finished was the last; low three bits: unused (high) bits of the last
+    // consumed byte, where the next header (if any) begins.
+    unsigned unused_bits = 0;
+    while (true) {
+        strm.next_out  = sink.data();
+        strm.avail_out = static_cast<uInt>(sink.size());
+        const int ret = inflate(&strm, Z_BLOCK);
+        if (ret != Z_OK) {
+            throw std::runtime_error("zlib: failed to rescan a compressed window");
+        }
+        if ((strm.data_type & 128) == 0) continue;
+
+        unused_bits = static_cast<unsigned>(strm.data_type) & 7U;
+        if ((strm.data_type & 64) != 0) break;
+
+        const std::size_t consumed = stream_size - strm.avail_in;
+        if (unused_bits != 0) {
+            final_bit_byte = consumed - 1;
+            final_bit_mask = static_cast<Byte>(0x100U >> unused_bits);
+        } else {
+            final_bit_byte = consumed;
+            final_bit_mask = 0x01;
+        }
+    }
+    if (strm.avail_in != 0 || (stream[final_bit_byte] & final_bit_mask) == 0) {
+        throw std::runtime_error("zlib: compressed window did not end where expected");
+    }
+    stream[final_bit_byte] = static_cast<Byte>(stream[final_bit_byte] & ~final_bit_mask);
+
+    // Empty stored block: a 3-bit zero header (BFINAL=0, BTYPE=00), zero padding
+    // to the byte boundary, then LEN=0x0000 / NLEN=0xFFFF.
+    std::size_t size = stream_size;
+    if (unused_bits != 0) {
+        stream[size - 1] = static_cast<Byte>(stream[size - 1] & ((0x100U >> unused_bits) - 1U));
+    }
+    if (unused_bits < 3) {
+        stream[size++] = 0x00;
+    }
+    for (const Byte b : {Byte{0x00}, Byte{0x00}, Byte{0xFF}, Byte{0xFF}}) {
+        stream[size++] = b;
+    }
+    window.output_size = size;
 }
 
-void libdeflateCompressFileToPath(const fs::path& input_path, const fs::path& output_path, std::size_t expected_input_size) {
-    const vBytes input = readWholeFile(input_path, expected_input_size);
+void deflateWindow(DeflateWindow& window, int level) {
+    throwIfSignalCancellationRequested();
 
-    CompressorGuard compressor(libdeflateLevelFor(expected_input_size));
+    // libdeflate compressors are not thread-safe; each task owns one.
+    CompressorGuard compressor(level);
     if (!compressor.c) {
         throw std::runtime_error("libdeflate: failed to allocate compressor");
     }
 
-    const std::size_t bound = libdeflate_zlib_compress_bound(compressor.c, input.size());
-    vBytes output(bound);
+    const std::size_t bound = libdeflate_deflate_compress_bound(compressor.c, window.data.size());
+    if (window.output.size() < bound + WINDOW_JOIN_MARGIN) {
+        window.output.resize(bound + WINDOW_JOIN_MARGIN);
+    }
 
-    const std::size_t produced = libdeflate_zlib_compress(
+    window.output_size = libdeflate_deflate_compress(
         compressor.c,
-        input.data(),
-        input.size(),
-        output.data(),
-        output.size());
+        window.data.data(),
+        window.data.size(),
+        window.output.data(),
+        bound);
     throwIfSignalCancellationRequested();
-    if (produced == 0) {
+    if (window.output_size == 0) {
         // Only happens if the bound-sized buffer was somehow insufficient.
-        throw std::runtime_error("libdeflate: zlib compression failed");
+        throw std::runtime_error("libdeflate: deflate compression failed");
     }
 
-    std::ofstream out_file = openBinaryOutputForWriteOrThrow(output_path);
-    TempFileCleanupGuard output_guard(output_path);
-    writeBytesOrThrow(out_file, std::span<const Byte>(output.data(), produced), WRITE_COMPLETE_ERROR);
-    closeOutputOrThrow(out_file, WRITE_COMPLETE_ERROR);
-    output_guard.dismiss();
+    if (!window.is_last) {
+        unterminateDeflateWindow(window);
+    }
+    window.adler = libdeflate_adler32(1, window.data.data(), window.data.size());
 }
 
-// ------------------------- zlib streaming fallback --------------------------
-
 template<typename WriteChunkFn>
-void deflateFromInputStream(std::istream& input, std::size_t expected_input_size, WriteChunkFn&& write_chunk) {
-    vBytes in_chunk(ZLIB_IN_CHUNK_SIZE);
-    vBytes out_chunk(ZLIB_OUT_CHUNK_SIZE);
+void windowedDeflateFromInputStream(
+    std::istream& input,
+    std::size_t expected_input_size,
+    int level,
+    const PayloadFilter& filter,
+    WorkerPool& pool,
+    WriteChunkFn&& write_chunk) {
+
+    const std::size_t windows_per_round = std::min(pool.threadCount(), ROUND_INPUT_LIMIT / WINDOW_SIZE);
+
+    vBytes round_buffer(std::min(expected_input_size, windows_per_round * WINDOW_SIZE));
+    std::vector<DeflateWindow> windows(windows_per_round);
+
+    write_chunk(std::span<const Byte>(zlibStreamHeader(level)));
+
+    uLong stream_adler = adler32(0, Z_NULL, 0);
+    std::size_t input_left = expected_input_size;
+    bool finished = false;
+
+    while (!finished) {
+        throwIfSignalCancellationRequested();
+        const std::size_t round_input = std::min(input_left, round_buffer.size());
+        if (round_input > 0) {
+            readExactOrThrow(input, round_buffer.data(), round_input,
+                             "Read Error: Input file changed while compressing.");
+        }
+        applyPayloadFilter(filter, std::span<Byte>(round_buffer.data(), round_input),
+                           expected_input_size - input_left);
+        input_left -= round_input;
 
+        const std::size_t window_count = std::max<std::size_t>(
+            1, (round_input + WINDOW_SIZE - 1) / WINDOW_SIZE);
+        for (std::size_t i = 0; i < window_count; ++i) {
+            const std::size_t offset = std::min(i * WINDOW_SIZE, round_input);
+            const std::size_t length = std::min(WINDOW_SIZE, round_input - offset);
+
+            DeflateWindow& window = windows[i];
+            window.data = std::span<const Byte>(round_buffer.data() + offset, length);
+            window.is_last = (input_left == 0 && i + 1 == window_count);
+        }
+
+        pool.run(window_count, [&](std::size_t i) { deflateWindow(windows[i], level); });
+
+        for (std::size_t i = 0; i < window_count; ++i) {
+            const DeflateWindow& window = windows[i];
+            write_chunk(std::span<const Byte>(window.output.data(), window.output_size));
+            stream_adler = adler32_combine(stream_adler, window.adler, static_cast<z_off_t>(window.data.size()));
+            finished = window.is_last;
+        }
+    }
+
+    write_chunk(std::span<const Byte>(zlibStreamTrailer(stream_adler)));
+    requireNoTrailingDataOrThrow(input, "Read Error: Input file changed while compressing.");
+}
+
+
+// ----------------------- preset deflate dictionaries ------------------------
+//
+// On the small-budget platforms (X-Twitter ~10 KB, Tumblr ~64 KB, Bluesky
+// ~171 KB) a text or structured payload loses a large share of its output to
+// cold-start literals. With --dictionary (or --target), inputs up to
+// DICTIONARY_MAX_INPUT are therefore also compressed against each preset
+// dictionary, and the smallest stream wins. It is opt-in because releases
+// before the dictionaries cannot inflate such a stream. libdeflate has no
+// preset-dictionary support, so those candidates use zlib at the nearest zlib
+// level. The dictionaries (up to 24 KiB each; English prose and
+// JSON/YAML/TOML/XML/HTML) are embedded as template assets and are built by
+// templates/dictionaries/build_dictionaries.py from the corpus listed beside
+// it. A stream that uses one carries its Adler-32 as the RFC 1950 DICTID,
+// which is all recover needs to find it again.
+
+inline constexpr std::size_t DICTIONARY_MAX_INPUT = 1024 * 1024;
+
+[[nodiscard]] std::array<std::span<const Byte>, 2> presetDictionaries() noexcept {
+    return {deflateDictTextBytes(), deflateDictStructuredBytes()};
+}
+
+[[nodiscard]] vBytes zlibCompressWithDictionary(std::span<const Byte> input,
+                                                std::span<const Byte> dictionary,
+                                                int level) {
+    // libdeflate levels run to 12; zlib's stop at 9.
+    const int zlib_level = std::clamp(level, 1, Z_BEST_COMPRESSION);
     z_stream strm{};
-    if (deflateInit(&strm, selectCompressionLevel(expected_input_size)) != Z_OK) {
-        throw std::runtime_error("zlib: deflateInit failed");
+    if (deflateInit2(&strm, zlib_level, Z_DEFLATED, MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("zlib: deflateInit2 failed");
     }
     struct DeflateGuard {
         z_stream* stream;
         ~DeflateGuard() { deflateEnd(stream); }
     } guard{&strm};
 
+    if (deflateSetDictionary(&strm, dictionary.data(), static_cast<uInt>(dictionary.size())) != Z_OK) {
+        throw std::runtime_error("zlib: failed to set preset dictionary");
+    }
+
+    // deflateBound() counts the DICTID once a dictionary is set.
+    vBytes output(deflateBound(&strm, static_cast<uLong>(input.size())));
+    strm.next_in   = const_cast<Byte*>(input.data());
+    strm.avail_in  = static_cast<uInt>(input.size());
+    strm.next_out  = output.data();
+    strm.avail_out = static_cast<uInt>(output.size());
+    if (deflate(&strm, Z_FINISH) != Z_STREAM_END) {
+        throw std::runtime_error("zlib: preset dictionary compression failed");
+    }
+    output.resize(strm.total_out);
+    return output;
+}
+
+[[nodiscard]] vBytes libdeflateZlibCompress(std::span<const Byte> input, int level) {
+    CompressorGuard compressor(level);
+    if (!compressor.c) {
+        throw std::runtime_error("libdeflate: failed to allocate compressor");
+    }
+    vBytes output(libdeflate_zlib_compress_bound(compressor.c, input.size()));
+    const std::size_t produced = libdeflate_zlib_compress(
+        compressor.c, input.data(), input.size(), output.data(), output.size());
+    if (produced == 0) {
+        throw std::runtime_error("libdeflate: zlib compression failed");
+    }
+    output.resize(produced);
+    return output;
+}
+
+// Small inputs: the plain libdeflate stream or the best dictionary stream,
+// whichever is smaller.
+void zlibCompressSmallInput(std::istream& input,
+                            std::size_t input_size,
+                            int level,
+                            const PayloadFilter& filter,
+                            const ByteSink& sink) {
+    vBytes data(input_size);
+    if (input_size > 0) {
+        readExactOrThrow(input, data.data(), data.size(), "Read Error: Input file changed while compressing.");
+    }
+    requireNoTrailingDataOrThrow(input, "Read Error: Input file changed while compressing.");
+    applyPayloadFilter(filter, data, 0);
+
+    vBytes best = libdeflateZlibCompress(data, level);
+    for (const std::span<const Byte> dictionary : presetDictionaries()) {
+        throwIfSignalCancellationRequested();
+        vBytes candidate = zlibCompressWithDictionary(data, dictionary, level);
+        if (candidate.size() < best.size()) {
+            best = std::move(candidate);
+        }
+    }
+    sink(std::span<const Byte>(best));
+}
+
+
+// -------------------------- independent zlib members -------------------------
+//
+// The member framing described in payload_prefix.h: every member_size slice of
+// the input becomes its own complete zlib stream behind a 4-byte big-endian
+// length. Rounds are read and compressed across the pool like the windows
+// above, but nothing is joined, so recover can inflate the members in parallel
+// too. Each member pays for a zlib header, a trailer and a cold start, which at
+// 16 MiB members is well under 0.01% of the output.
+
+inline constexpr std::size_t MEMBER_LENGTH_BYTES = 4;
+
+void zlibMembersFromInputStream(
+    std::istream& input,
+    std::size_t expected_input_size,
+    std::size_t member_size,
+    int level,
+    const PayloadFilter& filter,
+    WorkerPool& pool,
+    const ByteSink& sink) {
+
+    const std::size_t members_per_round = std::max<std::size_t>(
+        1,
+        std::min(pool.threadCount(), ROUND_INPUT_LIMIT / member_size));
+
+    vBytes round_buffer(std::min(expected_input_size, members_per_round * member_size));
+    std::vector<vBytes> members(members_per_round);
+    std::array<Byte, MEMBER_LENGTH_BYTES> member_length{};
+    std::size_t input_left = expected_input_size;
+
+    while (input_left > 0) {
+        throwIfSignalCancellationRequested();
+        const std::size_t round_input = std::min(input_left, round_buffer.size());
+        readExactOrThrow(input, round_buffer.data(), round_input,
+                         "Read Error: Input file changed while compressing.");
+        applyPayloadFilter(filter, std::span<Byte>(round_buffer.data(), round_input),
+                           expected_input_size - input_left);
+        input_left -= round_input;
+
+        const std::size_t member_count = (round_input + member_size - 1) / member_size;
+        pool.run(member_count, [&](std::size_t i) {
+            throwIfSignalCancellationRequested();
+            const std::size_t offset = i * member_size;
+            members[i] = libdeflateZlibCompress(
+                std::span<const Byte>(round_buffer).subspan(offset, std::min(member_size, round_input - offset)),
+                level);
+        });
+
+        for (std::size_t i = 0; i < member_count; ++i) {
+            updateValue(member_length, 0, members[i].size(), MEMBER_LENGTH_BYTES);
+            sink(std::span<const Byte>(member_length));
+            sink(std::span<const Byte>(members[i]));
+        }
+    }
+    requireNoTrailingDataOrThrow(input, "Read Error: Input file changed while compressing.");
+}
+
+
+// ------------------------------ zstd encoder --------------------------------
+
+// zstd's level 3 with long-distance matching beats the deflate levels above
+// on both speed and ratio for large payloads; its own worker threads
+// (nbWorkers) replace the window-level split used for deflate.
+inline constexpr int ZSTD_PAYLOAD_LEVEL = 3;
+inline constexpr std::size_t ZSTD_IN_CHUNK_SIZE = 2 * 1024 * 1024;
+
+struct ZstdCCtxGuard {
+    ZSTD_CCtx* cctx{ZSTD_createCCtx()};
+    ZstdCCtxGuard() = default;
+    ~ZstdCCtxGuard() { ZSTD_freeCCtx(cctx); }
+    ZstdCCtxGuard(const ZstdCCtxGuard&) = delete;
+    ZstdCCtxGuard& operator=(const ZstdCCtxGuard&) = delete;
+};
+
+void requireZstdOk(std::size_t ret) {
+    if (ZSTD_isError(ret)) {
+        throw std::runtime_error(std::format("zstd compression error: {}", ZSTD_getErrorName(ret)));
+    }
+}
+
+// ------------------------- compressibility probe ----------------------------
+
+inline constexpr std::size_t
+    PROBE_WINDOW_SIZE  = 64 * 1024,
+    PROBE_WINDOW_COUNT = 8;
+
+inline constexpr int PROBE_TRIAL_LEVEL = 1;
+
+// Sampled order-0 entropy below this is compressible for certain; skip the trial.
+inline constexpr double PROBE_LOW_ENTROPY_BITS = 7.0;
+
+// Minimum level-1 trial saving worth a full compression pass. Level 1 on 64 KiB
+// windows understates what the real pass saves by a point or two, so these sit
+// low. A payload whose magic bytes name a compressed format needs to show more,
+// since what does compress in such files is usually just container headers.
+inline constexpr double
+    PROBE_MIN_SAVING           = 0.02,
+    PROBE_MIN_SAVING_CONTAINER = 0.05;
+
+struct FormatSignature {
+    std::size_t offset;
+    std::string_view magic;
+    std::string_view name;
+};
+
+using namespace std::string_view_literals;
+
+inline constexpr std::array COMPRESSED_FORMAT_SIGNATURES{
+    FormatSignature{0, "PK\x03\x04"sv,                 "ZIP archive"},
+    FormatSignature{0, "\x1F\x8B"sv,                   "gzip"},
+    FormatSignature{0, "\xFD" "7zXZ\x00"sv,            "xz"},
+    FormatSignature{0, "7z\xBC\xAF\x27\x1C"sv,         "7-Zip archive"},
+    FormatSignature{0, "BZh"sv,                         "bzip2"},
+    FormatSignature{0, "\x28\xB5\x2F\xFD"sv,           "Zstandard"},
+    FormatSignature{0, "\x04\x22\x4D\x18"sv,           "LZ4"},
+    FormatSignature{0, "Rar!\x1A\x07"sv,               "RAR archive"},
+    FormatSignature{0, "MSCF"sv,                        "Cabinet archive"},
+    FormatSignature{0, "\x89PNG\r\n\x1A\n"sv,          "PNG image"},
+    FormatSignature{0, "\xFF\xD8\xFF"sv,               "JPEG image"},
+    FormatSignature{0, "GIF8"sv,                        "GIF image"},
+    FormatSignature{8, "WEBP"sv,                        "WebP image"},
+    FormatSignature{4, "ftyp"sv,                        "ISO media (MP4/MOV/HEIC)"},
+    FormatSignature{0, "\x1A\x45\xDF\xA3"sv,           "Matroska/WebM media"},
+    FormatSignature{0, "OggS"sv,                        "Ogg media"},
+    FormatSignature{0, "fLaC"sv,                        "FLAC audio"},
+    FormatSignature{0, "ID3"sv,                         "MP3 audio"},
+};
+
+[[nodiscard]] std::string_view detectCompressedFormat(std::span<const Byte> head) {
+    for (const FormatSignature& sig : COMPRESSED_FORMAT_SIGNATURES) {
+        if (!spanHasRange(head, sig.offset, sig.magic.size())) continue;
+        if (std::equal(sig.magic.begin(), sig.magic.end(),
+                       head.begin() + static_cast<std::ptrdiff_t>(sig.offset),
+                       [](char a, Byte b) { return static_cast<Byte>(a) == b; })) {
+            return sig.name;
+        }
+    }
+    return {};
+}
+
+[[nodiscard]] double shannonEntropyBitsPerByte(std::span<const Byte> data) {
+    if (data.empty()) return 0.0;
+    std::array<std::size_t, 256> counts{};
+    for (const Byte b : data) ++counts[b];
+
+    const double total = static_cast<double>(data.size());
+    double entropy = 0.0;
+    for (const std::size_t count : counts) {
+        if (count == 0) continue;
+        const double p = static_cast<double>(count) / total;
+        entropy -= p * std::log2(p);
+    }
+    return entropy;
+}
+
+// Reads PROBE_WINDOW_COUNT windows spread evenly from the first byte to the
+// last, or the whole file when it is no larger than that. Window i of the
+// result is [i * PROBE_WINDOW_SIZE, ...) of the returned buffer.
+[[nodiscard]] vBytes readProbeSamples(const fs::path& path, std::size_t file_size) {
+    std::ifstream input = openBinaryInputOrThrow(
+        path,
+        std::format("Failed to open file for compression: {}", path.string()));
+
+    const std::size_t sample_limit = PROBE_WINDOW_SIZE * PROBE_WINDOW_COUNT;
+    if (file_size <= sample_limit) {
+        vBytes samples(file_size);
+        readExactOrThrow(input, samples.data(), samples.size(),
+                         "Read Error: Failed while reading input file.");
+        return samples;
+    }
+
+    vBytes samples(sample_limit);
+    const std::size_t stride = (file_size - PROBE_WINDOW_SIZE) / (PROBE_WINDOW_COUNT - 1);
+    for (std::size_t i = 0; i < PROBE_WINDOW_COUNT; ++i) {
+        input.seekg(checkedStreamOffset(i * stride, "Read Error: Invalid probe offset."));
+        readExactOrThrow(input, samples.data() + i * PROBE_WINDOW_SIZE, PROBE_WINDOW_SIZE,
+                         "Read Error: Failed while reading input file.");
+    }
+    return samples;
+}
+
+// Total size of the samples after compressing each probe window independently
+// at `level`; a window that would expand counts at its original size.
+[[nodiscard]] std::size_t compressSampleWindows(std::span<const Byte> samples, int level) {
+    CompressorGuard compressor(level);
+    if (!compressor.c) {
+        throw std::runtime_error("libdeflate: failed to allocate compressor");
+    }
+
+    vBytes output(libdeflate_deflate_compress_bound(compressor.c, PROBE_WINDOW_SIZE));
+    std::size_t compressed_total = 0;
+    for (std::size_t offset = 0; offset < samples.size(); offset += PROBE_WINDOW_SIZE) {
+        const std::span<const Byte> window = samples.subspan(offset, std::min(PROBE_WINDOW_SIZE, samples.size() - offset));
+        const std::size_t produced = libdeflate_deflate_compress(
+            compressor.c, window.data(), window.size(), output.data(), output.size());
+        // 0 means the output bound was exceeded: treat as not compressible.
+        compressed_total += (produced == 0) ? window.size() : produced;
+    }
+    return compressed_total;
+}
+
+// Fraction of the samples saved by compressing each window independently
+// (zero when compression would expand them).
+[[nodiscard]] double trialCompressionSaving(std::span<const Byte> samples) {
+    const std::size_t compressed_total = compressSampleWindows(samples, PROBE_TRIAL_LEVEL);
+    return std::max(0.0, 1.0 - static_cast<double>(compressed_total) / static_cast<double>(samples.size()));
+}
+
+// ---------------------------- time-budget levels ----------------------------
+
+// Levels tried, cheapest first. libdeflate's time per byte rises steeply with
+// level (see libdeflateLevelFor), so the search stops at the first level that
+// overruns rather than timing the slower ones too.
+inline constexpr std::array BUDGET_CANDIDATE_LEVELS{1, 3, 6, 9, 12};
+
+// Floor on a measured trial time: a tiny sample can finish inside the clock's
+// resolution, which would project an infinitely fast compressor.
+inline constexpr double BUDGET_MIN_TRIAL_SECONDS = 1e-6;
+
+} // namespace
+
+void zlibCompressFileToSink(
+    const fs::path& input_path,
+    std::size_t expected_input_size,
+    const CompressionSettings& settings,
+    const ByteSink& sink) {
+    // Output is a standard RFC 1950 zlib stream whatever the input size, so the
+    // recover-side zlib inflate decodes it unchanged. Inputs that fit in one
+    // window get one libdeflate call and no join; the pool is never larger than
+    // the number of windows.
+    const std::size_t requested_threads = resolveWorkerThreads(settings.threads);
+    const std::size_t window_count = std::max<std::size_t>(
+        1, (expected_input_size + WINDOW_SIZE - 1) / WINDOW_SIZE);
+
+    throwIfSignalCancellationRequested();
+    std::ifstream input = openBinaryInputOrThrow(
+        input_path,
+        std::format("Failed to open file for compression: {}", input_path.string()));
+
+    const int level = settings.level.value_or(libdeflateLevelFor(expected_input_size));
+    if (settings.preset_dictionaries && expected_input_size <= DICTIONARY_MAX_INPUT) {
+        zlibCompressSmallInput(input, expected_input_size, level, settings.filter, sink);
+        return;
+    }
+    WorkerPool pool(std::min(requested_threads, window_count));
+    windowedDeflateFromInputStream(input, expected_input_size, level, settings.filter, pool, sink);
+}
+
+void zlibCompressMembersToSink(
+    const fs::path& input_path,
+    std::size_t expected_input_size,
+    std::size_t member_input_size,
+    const CompressionSettings& settings,
+    const ByteSink& sink) {
+    if (member_input_size == 0 || member_input_size % PAYLOAD_FILTER_BLOCK_SIZE != 0) {
+        throw std::invalid_argument("zlibCompressMembersToSink: member size must be a whole number of filter blocks");
+    }
+    const std::size_t member_count = (expected_input_size + member_input_size - 1) / member_input_size;
+
+    throwIfSignalCancellationRequested();
+    std::ifstream input = openBinaryInputOrThrow(
+        input_path,
+        std::format("Failed to open file for compression: {}", input_path.string()));
+
+    const int level = settings.level.value_or(libdeflateLevelFor(expected_input_size));
+    WorkerPool pool(std::min(resolveWorkerThreads(settings.threads), std::max<std::size_t>(1, member_count)));
+    zlibMembersFromInputStream(
+        input, expected_input_size, member_input_size, level, settings.filter, pool, sink);
+}
+
+void zstdCompressFileToSink(
+    const fs::path& input_path,
+    std::size_t expected_input_size,
+    const CompressionSettings& settings,
+    const ByteSink& sink) {
+    ZstdCCtxGuard context;
+    if (!context.cctx) {
+        throw std::runtime_error("zstd: failed to allocate compression context");
+    }
+    requireZstdOk(ZSTD_CCtx_setParameter(context.cctx, ZSTD_c_compressionLevel, ZSTD_PAYLOAD_LEVEL));
+    requireZstdOk(ZSTD_CCtx_setParameter(context.cctx, ZSTD_c_enableLongDistanceMatching, 1));
+    requireZstdOk(ZSTD_CCtx_setPledgedSrcSize(context.cctx, static_cast<unsigned long long>(expected_input_size)));
+
+    // Fails only on a libzstd built without ZSTD_MULTITHREAD, which then
+    // compresses on the calling thread; the output format is the same.
+    const std::size_t threads = resolveWorkerThreads(settings.threads);
+    if (threads > 1) {
+        (void)ZSTD_CCtx_setParameter(context.cctx, ZSTD_c_nbWorkers, static_cast<int>(threads));
+    }
+
+    throwIfSignalCancellationRequested();
+    std::ifstream input = openBinaryInputOrThrow(
+        input_path,
+        std::format("Failed to open file for compression: {}", input_path.string()));
+
+    vBytes in_chunk(ZSTD_IN_CHUNK_SIZE);
+    vBytes out_chunk(ZSTD_CStreamOutSize());
     std::size_t input_left = expected_input_size;
     bool finished = false;
+
     while (!finished) {
         throwIfSignalCancellationRequested();
         const std::size_t to_read = std::min(input_left, in_chunk.size());
-        const std::streamsize read_count = readSomeOrThrow(
-            input,
-            in_chunk.data(),
-            to_read,
-            "Read Error: Failed while reading input file.");
-        if (read_count != static_cast<std::streamsize>(to_read)) {
-            throw std::runtime_error("Read Error: Input file changed while compressing.");
+        if (to_read > 0) {
+            readExactOrThrow(input, in_chunk.data(), to_read,
+                             "Read Error: Input file changed while compressing.");
         }
+        applyPayloadFilter(settings.filter, std::span<Byte>(in_chunk.data(), to_read),
+                           expected_input_size - input_left);
         input_left -= to_read;
 
-        strm.next_in  = in_chunk.data();
-        strm.avail_in = static_cast<uInt>(read_count);
-
-        const int flush = (input_left == 0) ? Z_FINISH : Z_NO_FLUSH;
+        const ZSTD_EndDirective mode = (input_left == 0) ? ZSTD_e_end : ZSTD_e_continue;
+        ZSTD_inBuffer in{in_chunk.data(), to_read, 0};
         do {
-            strm.next_out  = out_chunk.data();
-            strm.avail_out = static_cast<uInt>(out_chunk.size());
-
-            const int ret = deflate(&strm, flush);
             throwIfSignalCancellationRequested();
-            if (ret != Z_OK && ret != Z_STREAM_END) {
-                throw std::runtime_error(std::format(
-                    "zlib deflate error: {}",
-                    strm.msg ? strm.msg : std::to_string(ret)));
+            ZSTD_outBuffer out{out_chunk.data(), out_chunk.size(), 0};
+            const std::size_t remaining = ZSTD_compressStream2(context.cctx, &out, &in, mode);
+            requireZstdOk(remaining);
+            if (out.pos > 0) {
+                sink(std::span<const Byte>(out_chunk.data(), out.pos));
             }
+            // With ZSTD_e_end, 0 means the frame is complete and flushed;
+            // with ZSTD_e_continue, keep going until this chunk is consumed.
+            finished = (mode == ZSTD_e_end && remaining == 0);
+        } while (mode == ZSTD_e_end ? !finished : in.pos < in.size);
+    }
 
-            const std::size_t produced = out_chunk.size() - strm.avail_out;
-            if (produced > 0) {
-                write_chunk(std::span<const Byte>(out_chunk.data(), produced));
-            }
+    requireNoTrailingDataOrThrow(input, "Read Error: Input file changed while compressing.");
+}
 
-            if (ret == Z_STREAM_END) {
-                finished = true;
-                break;
-            }
-        } while (strm.avail_out == 0);
+LevelSelection selectLevelForTimeBudget(
+    const fs::path& path,
+    std::size_t file_size,
+    std::size_t threads,
+    double budget_seconds) {
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+
+    throwIfSignalCancellationRequested();
+    LevelSelection selection;
+    if (file_size == 0) {
+        selection.fits_budget = true;
+        return selection;
     }
 
-    requireNoTrailingDataOrThrow(input, "Read Error: Input file changed while compressing.");
+    const vBytes samples = readProbeSamples(path, file_size);
+    const std::span<const Byte> sample_view(samples);
+
+    // Windows compress in parallel, so the whole file runs at the measured
+    // single-thread rate times the workers that will actually have a window.
+    const std::size_t resolved_threads = resolveWorkerThreads(threads);
+    const std::size_t window_count = (file_size + WINDOW_SIZE - 1) / WINDOW_SIZE;
+    const double parallelism = static_cast<double>(
+        std::min({resolved_threads, window_count, ROUND_INPUT_LIMIT / WINDOW_SIZE}));
+
+    for (const int level : BUDGET_CANDIDATE_LEVELS) {
+        throwIfSignalCancellationRequested();
+        const Clock::time_point trial_start = Clock::now();
+        const std::size_t compressed_total = compressSampleWindows(sample_view, level);
+        const double trial_seconds = std::max(
+            BUDGET_MIN_TRIAL_SECONDS,
+            std::chrono::duration<double>(Clock::now() - trial_start).count());
+
+        const double bytes_per_second = static_cast<double>(samples.size()) / trial_seconds;
+        const double projected = static_cast<double>(file_size) / (bytes_per_second * parallelism);
+        // Time spent on the trials themselves also comes out of the budget.
+        const double remaining = budget_seconds - std::chrono::duration<double>(Clock::now() - start).count();
+
+        const bool fits = projected <= remaining;
+        if (!fits && level != BUDGET_CANDIDATE_LEVELS.front()) {
+            break;
+        }
+        selection = LevelSelection{
+            .level = level,
+            .fits_budget = fits,
+            .projected_seconds = projected,
+            .sample_ratio = static_cast<double>(compressed_total) / static_cast<double>(samples.size()),
+        };
+        if (!fits) {
+            break;
+        }
+    }
+    return selection;
 }
 
-void zlibStreamCompressFileToPath(const fs::path& input_path, const fs::path& output_path, std::size_t expected_input_size) {
-    std::ifstream input = openBinaryInputOrThrow(
-        input_path,
-        std::format("Failed to open file for compression: {}", input_path.string()));
-    std::ofstream output = openBinaryOutputForWriteOrThrow(output_path);
-    TempFileCleanupGuard output_guard(output_path);
-    deflateFromInputStream(input, expected_input_size, [&](std::span<const Byte> chunk) {
-        writeBytesOrThrow(output, chunk, WRITE_COMPLETE_ERROR);
-    });
-    closeOutputOrThrow(output, WRITE_COMPLETE_ERROR);
-    output_guard.dismiss();
+std::span<const Byte> presetDeflateDictionary(uint32_t dict_id) noexcept {
+    for (const std::span<const Byte> dictionary : presetDictionaries()) {
+        const uLong adler = adler32(adler32(0, Z_NULL, 0), dictionary.data(), static_cast<uInt>(dictionary.size()));
+        if (static_cast<uint32_t>(adler) == dict_id) {
+            return dictionary;
+        }
+    }
+    return {};
 }
 
-} // namespace
+CompressionProbe probeCompressibility(const fs::path& path, std::size_t file_size) {
+    throwIfSignalCancellationRequested();
+    CompressionProbe probe;
+    if (file_size == 0) {
+        probe.reason = "empty file";
+        return probe;
+    }
+
+    const vBytes samples = readProbeSamples(path, file_size);
+    const std::span<const Byte> sample_view(samples);
+    probe.sampled_bytes = samples.size();
+    probe.detected_format = detectCompressedFormat(sample_view.first(std::min<std::size_t>(samples.size(), 16)));
+    probe.entropy_bits_per_byte = shannonEntropyBitsPerByte(sample_view);
 
-void zlibCompressFileToPath(const fs::path& input_path, const fs::path& output_path, std::size_t expected_input_size) {
-    // Both paths emit a standard RFC 1950 zlib stream, so the recover-side
-    // zlib inflate decodes either one. libdeflate handles the common (smaller)
-    // case far faster; the streaming zlib path keeps memory bounded for very
-    // large inputs.
-    if (expected_input_size <= LIBDEFLATE_WHOLE_BUFFER_LIMIT) {
-        libdeflateCompressFileToPath(input_path, output_path, expected_input_size);
-    } else {
-        zlibStreamCompressFileToPath(input_path, output_path, expected_input_size);
+    if (probe.entropy_bits_per_byte < PROBE_LOW_ENTROPY_BITS) {
+        probe.reason = std::format("low sampled entropy, {:.2f} bits/byte", probe.entropy_bits_per_byte);
+        return probe;
     }
+
+    probe.trial_saving = trialCompressionSaving(sample_view);
+    throwIfSignalCancellationRequested();
+
+    const double min_saving = probe.detected_format.empty() ? PROBE_MIN_SAVING : PROBE_MIN_SAVING_CONTAINER;
+    probe.bypass = probe.trial_saving < min_saving;
+    probe.reason = std::format(
+        "level-1 trial saved {:.1f}% of sampled data, {} the {:.0f}% threshold{}{}",
+        probe.trial_saving * 100.0,
+        probe.bypass ? "below" : "meeting",
+        min_saving * 100.0,
+        probe.detected_format.empty() ? "" : "; detected ",
+        probe.detected_format);
+    return probe;
 }
@@ -1,5 +1,88 @@
 #pragma once
 
 #include "common.h"
+#include "payload_filter.h"
 
-void zlibCompressFileToPath(const fs::path& input_path, const fs::path& output_path, std::size_t expected_input_size);
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+struct CompressionSettings {
+    // Worker threads compressing input windows; 0 = one per hardware thread.
+    std::size_t threads{0};
+    // libdeflate level for the zlib codec; unset = picked from the input size.
+    std::optional<int> level{};
+    // Applied to the input before either codec compresses it.
+    PayloadFilter filter{};
+    // Also try the preset dictionaries on zlib inputs of up to 1 MiB. Off by
+    // default: releases before them cannot inflate a stream that needs one.
+    bool preset_dictionaries{false};
+};
+
+// Both compressors hand their output to `sink` in stream order as it is
+// produced, in chunks of no particular size, so callers can encrypt it on the
+// fly instead of staging it on disk.
+
+// One RFC 1950 zlib stream. With settings.preset_dictionaries, inputs of up to
+// 1 MiB may use a preset dictionary.
+void zlibCompressFileToSink(
+    const fs::path& input_path,
+    std::size_t expected_input_size,
+    const CompressionSettings& settings,
+    const ByteSink& sink);
+
+// The member framing of payload_prefix.h: each member_input_size slice of the
+// input compressed to its own zlib stream behind a big-endian u32 length.
+void zlibCompressMembersToSink(
+    const fs::path& input_path,
+    std::size_t expected_input_size,
+    std::size_t member_input_size,
+    const CompressionSettings& settings,
+    const ByteSink& sink);
+
+// The preset dictionary whose Adler-32 is dict_id (the DICTID of a zlib
+// stream that needs one), or an empty span if none matches.
+[[nodiscard]] std::span<const Byte> presetDeflateDictionary(uint32_t dict_id) noexcept;
+
+// One zstd frame (level 3, long-distance matching, multithreaded).
+void zstdCompressFileToSink(
+    const fs::path& input_path,
+    std::size_t expected_input_size,
+    const CompressionSettings& settings,
+    const ByteSink& sink);
+
+// Outcome of sampling a payload before compression. A payload is stored raw
+// (NO_ZLIB_COMPRESSION_ID) when compressing it would save almost nothing.
+struct CompressionProbe {
+    bool bypass{false};
+    std::string_view detected_format{};  // Recognised compressed container, if any.
+    std::size_t sampled_bytes{0};
+    double entropy_bits_per_byte{0.0};   // Order-0 Shannon entropy of the samples.
+    double trial_saving{0.0};            // Fraction saved by the level-1 trial; 0 if not run.
+    std::string reason{};
+};
+
+// Reads a few scattered 64 KiB windows of the file (all of it, if small),
+// sniffs the leading magic bytes, measures entropy and trial-compresses the
+// windows at libdeflate level 1 to decide whether compression is worthwhile.
+[[nodiscard]] CompressionProbe probeCompressibility(const fs::path& path, std::size_t file_size);
+
+// Outcome of fitting the zlib codec's libdeflate level to a wall-clock budget.
+struct LevelSelection {
+    int level{1};
+    bool fits_budget{false};
+    double projected_seconds{0.0};  // Whole-file compression time at `level`.
+    double sample_ratio{1.0};       // Compressed / original size of the samples at `level`.
+};
+
+// Times libdeflate on the probe samples at rising levels on this machine and
+// returns the highest level whose projected time for the whole file, spread
+// over `threads` workers, fits in budget_seconds. Falls back to level 1 (with
+// fits_budget false) when even that is projected to overrun.
+[[nodiscard]] LevelSelection selectLevelForTimeBudget(
+    const fs::path& path,
+    std::size_t file_size,
+    std::size_t threads,
+    double budget_seconds);
@@ -5,6 +5,7 @@
 #include "encryption.h"
 #include "file_utils.h"
 #include "jpeg_utils.h"
+#include "payload_prefix.h"
 #include "segmentation.h"
 #include "signal_utils.h"
 #include "template_assets.h"
@@ -14,10 +15,13 @@
 #include <format>
 #include <fstream>
 #include <limits>
+#include <memory>
+#include <optional>
 #include <print>
 #include <span>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace {
 constexpr std::size_t
@@ -27,7 +31,6 @@ constexpr std::size_t
     MAX_BLUESKY_IMAGE_SIZE    = 2'000'000,
     DATA_FILENAME_MAX_LENGTH  = 20,
     LARGE_FILE_SIZE           = 300 * 1024 * 1024,
-    COMPRESS_BYPASS_SIZE      = 10 * 1024 * 1024,
     MAX_SIZE_CONCEAL          = 2ULL * 1024 * 1024 * 1024, // Cover mage size + embedded (compressed) hidden file size (payload)
     OUTPUT_STREAM_BUFFER      = 1 * 1024 * 1024;
 
@@ -37,14 +40,29 @@ struct ConcealFlags {
 };
 
 struct EncryptionInput {
-    fs::path path{};
-    std::size_t size{0};
-    bool is_compressed{true};
+    PayloadSource source{};
+    PayloadCodec codec{PayloadCodec::zlib};
+    FrameFormat frames{};
+    PayloadLayout layout{};
+    EncryptedSizeLimit limit{};
+    std::optional<std::size_t> encrypted_size{};  // Known up front for a raw payload.
+};
+
+// One image decided and checked up to the point where its key is needed.
+// Planning is where an input that cannot fit fails (the --target search, a raw
+// payload's exact size), so the caller starts Argon2id only once it is done.
+struct ConcealPlan {
+    ConcealFlags flags{};
+    OptimizedCover cover{};
+    vBytes segment_vec{};
+    std::string data_filename{};
+    EncryptionInput encryption_input{};
 };
 
 struct StagedImage {
     fs::path output_path{};
     TempFileCleanupGuard temp_output{};
+    std::size_t write_calls{0};  // System calls that wrote it, for --stats.
 
     StagedImage(fs::path final_path, fs::path temporary_path)
         : output_path(std::move(final_path)),
@@ -62,11 +80,17 @@ struct EmbeddedWriteResult {
 };
 
 struct ConcealFinalizeResult {
-    SecurePin recovery_pin{};
     StagedImage staged;
     std::size_t embedded_jpg_size{0};
 };
 
+// One image of a batch, staged and waiting for the batch's PIN to be shown.
+struct BatchImage {
+    fs::path data_file_path{};
+    vString platforms_vec{};
+    ConcealFinalizeResult result;
+};
+
 [[nodiscard]] fs::path randomizedPath(
     const fs::path& parent,
     std::string_view prefix,
@@ -88,16 +112,6 @@ struct ConcealFinalizeResult {
         "Write File Error: Could not create a temporary output filename.");
 }
 
-// Neutral prefix only — do not embed the payload stem. Directory listings
-// during conceal would otherwise reveal the secret filename.
-[[nodiscard]] fs::path tempStagePath(std::string_view tag) {
-    return randomizedPath(
-        {},
-        std::format(".jdvrif_{}_", tag),
-        ".bin",
-        std::format("Write File Error: Could not create a temporary {} filename.", tag));
-}
-
 [[nodiscard]] ConcealFlags concealFlags(Option option) {
     return {
         .has_no_option = option == Option::None,
@@ -148,11 +162,180 @@ void validateCoverImageLimits(std::size_t jpg_size, const ConcealFlags& flags) {
     return data_filename;
 }
 
-[[nodiscard]] bool shouldBypassCompression(const fs::path& data_file_path, std::size_t source_data_size) {
-    return source_data_size > COMPRESS_BYPASS_SIZE && hasFileExtension(data_file_path, {
-        ".zip", ".jar", ".rar", ".7z", ".bz2", ".gz", ".xz", ".lz", ".lz4", ".cab", ".rpm", ".deb",
-        ".mp4", ".mp3", ".exe", ".jpg", ".jpeg", ".jfif", ".png", ".webp", ".gif", ".ogg", ".flac"
+// Bluesky recover always inflates (see recoverBluesky), so only the default
+// mode may store a payload raw.
+[[nodiscard]] CompressionProbe decideCompression(const fs::path& data_file_path,
+                                                 std::size_t source_data_size,
+                                                 const ConcealFlags& flags) {
+    if (flags.has_bluesky_option) {
+        return CompressionProbe{.reason = "Bluesky images are always compressed"};
+    }
+    return probeCompressibility(data_file_path, source_data_size);
+}
+
+void printCompressionProbe(const CompressionProbe& probe, PayloadCodec codec) {
+    std::println("\nCompression: {} ({}).",
+                 probe.bypass ? "skipped" : (codec == PayloadCodec::zstd ? "zstd" : "zlib"),
+                 probe.reason);
+    if (probe.sampled_bytes == 0) {
+        return;
+    }
+    std::println("  Sampled {} bytes; entropy {:.3f} bits/byte.", probe.sampled_bytes, probe.entropy_bits_per_byte);
+}
+
+// With --time-budget, the zlib level is measured on this machine instead of
+// following the input-size thresholds.
+[[nodiscard]] CompressionSettings compressionSettingsFor(const fs::path& data_file_path,
+                                                         std::size_t source_data_size,
+                                                         PayloadCodec codec,
+                                                         const ConcealOptions& options) {
+    CompressionSettings settings{
+        .threads = options.threads,
+        .preset_dictionaries = options.preset_dictionaries || !options.target_platform.empty(),
+    };
+    if (codec != PayloadCodec::zlib || options.time_budget_seconds <= 0.0) {
+        return settings;
+    }
+
+    const LevelSelection selection = selectLevelForTimeBudget(
+        data_file_path, source_data_size, options.threads, options.time_budget_seconds);
+    settings.level = selection.level;
+
+    if (!selection.fits_budget) {
+        std::println("\nNote: Compression is projected to take {:.1f}s even at the fastest level, over the {:.1f}s budget.",
+                     selection.projected_seconds, options.time_budget_seconds);
+    }
+    if (options.show_stats) {
+        std::println("  Level: {} (projected {:.1f}s of the {:.1f}s budget; samples compress to {:.1f}%).",
+                     selection.level, selection.projected_seconds, options.time_budget_seconds,
+                     selection.sample_ratio * 100.0);
+    }
+    return settings;
+}
+
+// ------------------------------ --target search ----------------------------
+
+inline constexpr int
+    TARGET_MIN_LEVEL = 1,
+    TARGET_MAX_LEVEL = 12;
+
+// A winning compressed payload up to this size is kept in memory and encrypted
+// as-is, instead of being compressed a second time.
+inline constexpr std::size_t TARGET_KEEP_PAYLOAD_LIMIT = 64 * 1024 * 1024;
+
+// Thrown from the search's sink to abandon a level once its output has grown
+// past the largest payload that could fit.
+struct TargetOverrun {};
+
+struct TargetFit {
+    PayloadCodec codec{PayloadCodec::zlib};
+    std::optional<int> level{};
+    std::size_t payload_size{0};
+    std::shared_ptr<const vBytes> payload{};  // Kept compressed payload, if any.
+};
+
+[[nodiscard]] std::shared_ptr<vBytes> makeWipedOnReleaseBuffer(std::size_t capacity) {
+    auto buffer = std::shared_ptr<vBytes>(new vBytes, [](vBytes* v) {
+        sodium_memzero(v->data(), v->size());
+        delete v;
     });
+    // Reserved up front so the contents are never reallocated (and left unwiped).
+    buffer->reserve(capacity);
+    return buffer;
+}
+
+// Largest payload (the bytes after the filename prefix) whose embedded image
+// still meets `limits`; nullopt when not even a 1-byte payload does. Output
+// size only grows with the payload, so a binary search finds it.
+[[nodiscard]] std::optional<std::size_t> largestFittingPayload(const PlatformLimits& limits,
+                                                               std::size_t template_size,
+                                                               std::size_t filename_prefix_size,
+                                                               std::size_t frame_size,
+                                                               std::size_t jpg_size) {
+    const auto fits = [&](std::size_t payload_size) {
+        const std::size_t encrypted_size =
+            computeStreamEncryptedSizePrefixed(payload_size, filename_prefix_size, frame_size);
+        if (encrypted_size > MAX_SIZE_CONCEAL - std::min<std::size_t>(jpg_size, MAX_SIZE_CONCEAL)) {
+            return false;
+        }
+        return platformAccepts(limits, predictEmbeddedSummary(template_size, encrypted_size, jpg_size));
+    };
+
+    if (!fits(1)) return std::nullopt;
+    std::size_t lo = 1;
+    std::size_t hi = MAX_SIZE_CONCEAL;
+    while (lo < hi) {
+        const std::size_t mid = lo + (hi - lo + 1) / 2;
+        if (fits(mid)) lo = mid; else hi = mid - 1;
+    }
+    return lo;
+}
+
+// Finds the cheapest way to make the output meet the --target platform's
+// limits, using only the size arithmetic of the finished image, so nothing is
+// encrypted or written if no setting fits. Levels run cheapest first: level 1,
+// then level 12 to rule out the impossible, then a binary search between them
+// for the lowest level that fits. Each trial stops as soon as its output passes
+// the largest payload that could fit.
+[[nodiscard]] TargetFit fitPayloadToTarget(const fs::path& data_file_path,
+                                           std::size_t source_data_size,
+                                           PayloadCodec codec,
+                                           const CompressionSettings& compression_settings,
+                                           const PlatformLimits& limits,
+                                           std::size_t template_size,
+                                           std::size_t filename_prefix_size,
+                                           std::size_t frame_size,
+                                           std::size_t jpg_size) {
+    const std::optional<std::size_t> max_payload =
+        largestFittingPayload(limits, template_size, filename_prefix_size, frame_size, jpg_size);
+    if (!max_payload) {
+        throw std::runtime_error(std::format(
+            "File Size Error: The cover image alone is too large for {}.", limits.name));
+    }
+    if (codec == PayloadCodec::raw && source_data_size <= *max_payload) {
+        return TargetFit{.codec = PayloadCodec::raw, .payload_size = source_data_size};
+    }
+
+    const bool keep_payload = *max_payload <= TARGET_KEEP_PAYLOAD_LIMIT;
+    std::shared_ptr<vBytes> trial_payload;
+    TargetFit best{};
+
+    const auto tryLevel = [&](int level) {
+        CompressionSettings settings = compression_settings;
+        settings.level = level;
+        if (keep_payload) trial_payload = makeWipedOnReleaseBuffer(*max_payload);
+
+        std::size_t produced = 0;
+        try {
+            zlibCompressFileToSink(data_file_path, source_data_size, settings, [&](std::span<const Byte> bytes) {
+                produced += bytes.size();
+                if (produced > *max_payload) throw TargetOverrun{};
+                if (trial_payload) trial_payload->insert(trial_payload->end(), bytes.begin(), bytes.end());
+            });
+        } catch (const TargetOverrun&) {
+            return false;
+        }
+        best = TargetFit{
+            .codec = PayloadCodec::zlib,
+            .level = level,
+            .payload_size = produced,
+            .payload = std::move(trial_payload),
+        };
+        return true;
+    };
+
+    if (tryLevel(TARGET_MIN_LEVEL)) return best;
+    if (!tryLevel(TARGET_MAX_LEVEL)) {
+        throw std::runtime_error(std::format(
+            "File Size Error: Data file does not fit {}, even at the highest compression level.", limits.name));
+    }
+    int lo = TARGET_MIN_LEVEL + 1;
+    int hi = TARGET_MAX_LEVEL - 1;
+    while (lo <= hi) {
+        const int mid = lo + (hi - lo) / 2;
+        if (tryLevel(mid)) hi = mid - 1; else lo = mid + 1;
+    }
+    return best;
 }
 
 [[nodiscard]] vBytes copyTemplateBytes(std::span<const Byte> template_bytes) {
@@ -196,34 +379,70 @@ void maybePrintLargeFileNotice(std::size_t source_data_size) {
     }
 }
 
-[[nodiscard]] EncryptionInput prepareEncryptionInput(const fs::path& data_file_path,
-                                                     std::size_t source_data_size,
-                                                     bool bypass_compression,
-                                                     vBytes& segment_vec,
-                                                     TempFileCleanupGuard& compressed_guard) {
-    if (bypass_compression) {
-        if (NO_ZLIB_COMPRESSION_ID_INDEX >= segment_vec.size()) {
-            throw std::runtime_error("Internal Error: Compression marker index out of range.");
-        }
-        segment_vec[NO_ZLIB_COMPRESSION_ID_INDEX] = NO_ZLIB_COMPRESSION_ID;
-        return EncryptionInput{
-            .path = data_file_path,
-            .size = source_data_size,
-            .is_compressed = false,
-        };
+void writeCompressionMarker(vBytes& segment_vec, PayloadCodec codec) {
+    // zlib keeps the template's marker byte, which recover reads as zlib.
+    if (codec == PayloadCodec::zlib) {
+        return;
+    }
+    if (NO_ZLIB_COMPRESSION_ID_INDEX >= segment_vec.size()) {
+        throw std::runtime_error("Internal Error: Compression marker index out of range.");
+    }
+    segment_vec[NO_ZLIB_COMPRESSION_ID_INDEX] =
+        (codec == PayloadCodec::raw) ? NO_ZLIB_COMPRESSION_ID : ZSTD_COMPRESSION_ID;
+}
+
+// Large data files get larger encryption frames: a quarter of the frames
+// (and frame calls) at 1 MiB, with still plenty of frames to seal in
+// parallel. --frame-size overrides the choice either way.
+inline constexpr std::size_t
+    LARGE_FRAME_INPUT_THRESHOLD = 256 * 1024 * 1024,
+    LARGE_INPUT_FRAME_SIZE      = 4   * 1024 * 1024;
+
+[[nodiscard]] FrameFormat frameFormatFor(std::size_t source_data_size, const ConcealOptions& options) {
+    std::size_t frame_size = options.frame_size;
+    if (frame_size == 0) {
+        frame_size = source_data_size > LARGE_FRAME_INPUT_THRESHOLD ? LARGE_INPUT_FRAME_SIZE : DEFAULT_STREAM_FRAME_SIZE;
     }
+    return FrameFormat{.cipher = options.cipher, .frame_size = frame_size, .threads = options.threads};
+}
 
-    fs::path compressed_path = tempStagePath("comp");
-    zlibCompressFileToPath(data_file_path, compressed_path, source_data_size);
-    compressed_guard.set(compressed_path);
+// --indexed splits a zlib payload into independently decodable members so
+// recover can inflate them in parallel. A payload of one member gains nothing
+// and stays a single stream, as does anything stored raw.
+[[nodiscard]] PayloadLayout payloadLayoutFor(std::size_t source_data_size,
+                                             PayloadCodec codec,
+                                             const PayloadFilter& filter,
+                                             const ConcealOptions& options) {
+    if (!options.indexed || codec != PayloadCodec::zlib || source_data_size <= PAYLOAD_MEMBER_INPUT_SIZE) {
+        return PayloadLayout{.filter = filter};
+    }
+    return PayloadLayout{
+        .member_input_size = PAYLOAD_MEMBER_INPUT_SIZE,
+        .total_input_size = source_data_size,
+        .filter = filter,
+    };
+}
 
-    return EncryptionInput{
-        .path = compressed_path,
-        .size = checkedFileSize(
-            compressed_path,
-            "Zlib Compression Error: Failed to build compressed payload.",
-            true),
-        .is_compressed = true,
+// Compressed payloads stream from the compressor straight into the encryptor,
+// so their final size is unknown until the last frame; the size limits are
+// enforced per frame instead (see encryptionSizeLimit).
+[[nodiscard]] PayloadSource makePayloadSource(const fs::path& data_file_path,
+                                              std::size_t source_data_size,
+                                              PayloadCodec codec,
+                                              const PayloadLayout& layout,
+                                              const CompressionSettings& compression_settings) {
+    if (codec == PayloadCodec::raw) {
+        return payloadSourceFromFile(data_file_path, source_data_size);
+    }
+    return [data_file_path, source_data_size, codec, layout, compression_settings](const ByteSink& sink) {
+        if (layout.hasMembers()) {
+            zlibCompressMembersToSink(
+                data_file_path, source_data_size, layout.member_input_size, compression_settings, sink);
+        } else if (codec == PayloadCodec::zstd) {
+            zstdCompressFileToSink(data_file_path, source_data_size, compression_settings, sink);
+        } else {
+            zlibCompressFileToSink(data_file_path, source_data_size, compression_settings, sink);
+        }
     };
 }
 
@@ -242,19 +461,34 @@ void validateCombinedSizeLimits(std::size_t encrypted_payload_size, std::size_t
     }
 }
 
+[[nodiscard]] EncryptedSizeLimit encryptionSizeLimit(std::size_t jpg_size, const ConcealFlags& flags) {
+    if (flags.has_bluesky_option) {
+        return EncryptedSizeLimit{
+            .max_bytes = MAX_EMBEDDED_CIPHERTEXT_BLUESKY,
+            .error_message = "Data File Size Error: File exceeds maximum size limit for the Bluesky platform.",
+        };
+    }
+    return EncryptedSizeLimit{
+        .max_bytes = (jpg_size < MAX_SIZE_CONCEAL) ? MAX_SIZE_CONCEAL - jpg_size : 0,
+        .error_message = "File Size Error: Combined size of image and data file "
+                         "exceeds maximum default size limit for jdvrif.",
+    };
+}
+
 template<typename WriteFn>
 [[nodiscard]] StagedImage writeToStagedOutput(WriteFn&& write_fn) {
     const fs::path output_path = uniqueOutputPath();
     StagedImage staged(output_path, tempOutputPath(output_path));
-    // OutputFile's internal 1 MiB buffer coalesces the small segment-header
-    // writes (replacing the old ofstream pubsetbuf) while letting the bulk
-    // payload stream through sendfile(2); see file_utils OutputFile.
+    // OutputFile's internal 1 MiB buffer coalesces small writes; the ICC
+    // segments bypass it through writeGather, a round of frames at a time
+    // (see IccSegmentWriter::flush).
     OutputFile out(staged.temp_output.path, OUTPUT_STREAM_BUFFER);
     write_fn(out);
     // Durable close: the recovery PIN is printed and then discarded, so the
     // image it unlocks must already be on stable storage -- a PIN for an image
     // lost to a crash is unrecoverable.
     out.close(WRITE_COMPLETE_ERROR, /*durable=*/true);
+    staged.write_calls = out.writeCalls();
     return staged;
 }
 
@@ -267,13 +501,36 @@ template<typename WriteFn>
     });
 }
 
-[[nodiscard]] EmbeddedWriteResult saveEmbeddedJpgFromEncryptedPath(
-    vBytes& segment_vec, const fs::path& encrypted_path,
-    std::span<const Byte> jpg_vec) {
+// The ciphertext goes straight into the output's ICC segments as it is
+// sealed, a round of frames per write; encrypt_fn receives the sink.
+// With encrypted_size known, the image is preallocated and laid out up front
+// (see IccSegmentWriter::reserve).
+template<typename EncryptFn>
+[[nodiscard]] EmbeddedWriteResult saveEmbeddedJpgEncrypting(
+    vBytes& segment_vec,
+    std::span<const Byte> jpg_vec,
+    std::optional<std::size_t> encrypted_size,
+    std::size_t threads,
+    EncryptFn&& encrypt_fn) {
     SegmentedEmbedSummary summary;
     StagedImage staged = writeToStagedOutput([&](OutputFile& f) {
-        summary = writeEmbeddedJpgFromEncryptedFile(f, segment_vec, encrypted_path, jpg_vec);
+        IccSegmentWriter segments(f, segment_vec);
+        if (encrypted_size) {
+            segments.reserve(*encrypted_size, jpg_vec, threads);
+        }
+        encrypt_fn(CipherSink{
+            .write = [&](std::span<const Byte> bytes) { segments.append(bytes); },
+            .end_round = [&] { segments.flush(); },
+        });
+        summary = segments.finish();
+        if (!encrypted_size) {
+            f.write(jpg_vec, WRITE_COMPLETE_ERROR);
+        }
     });
+    summary.embedded_image_size = checkedAdd(
+        summary.embedded_image_size,
+        jpg_vec.size(),
+        "File Size Error: Embedded image size overflow.");
     return EmbeddedWriteResult{std::move(staged), summary};
 }
 
@@ -286,27 +543,31 @@ void finalizePlatformReport(vString& platforms_vec, const SegmentedEmbedSummary&
     vBytes& segment_vec,
     const OptimizedCover& cover,
     const EncryptionInput& encryption_input,
+    ImageKey& image_key,
     const std::string& data_filename,
     vString& platforms_vec) {
 
-    TempFileCleanupGuard encrypted_guard(tempStagePath("enc"));
-    SecurePin recovery_pin = encryptDataFileToFile(
+    EmbeddedWriteResult embedded = saveEmbeddedJpgEncrypting(
         segment_vec,
-        encryption_input.path,
-        encryption_input.size,
-        data_filename,
-        encrypted_guard.path,
-        encryption_input.is_compressed);
-
-    EmbeddedWriteResult embedded = saveEmbeddedJpgFromEncryptedPath(
-        segment_vec,
-        encrypted_guard.path,
-        cover.view());
+        cover.view(),
+        encryption_input.encrypted_size,
+        encryption_input.frames.threads,
+        [&](const CipherSink& sink) {
+            encryptDataFileToSink(
+                segment_vec,
+                encryption_input.source,
+                encryption_input.limit,
+                data_filename,
+                encryption_input.layout,
+                encryption_input.codec,
+                encryption_input.frames,
+                image_key,
+                sink);
+        });
 
     finalizePlatformReport(platforms_vec, embedded.summary);
 
     return ConcealFinalizeResult{
-        .recovery_pin = std::move(recovery_pin),
         .staged = std::move(embedded.staged),
         .embedded_jpg_size = embedded.summary.embedded_image_size,
     };
@@ -316,16 +577,20 @@ void finalizePlatformReport(vString& platforms_vec, const SegmentedEmbedSummary&
     vBytes& segment_vec,
     const OptimizedCover& cover,
     const EncryptionInput& encryption_input,
+    ImageKey& image_key,
     const std::string& data_filename,
     vString& platforms_vec) {
 
-    SecurePin recovery_pin = encryptDataFileForBluesky(
+    encryptDataFileForBluesky(
         segment_vec,
-        encryption_input.path,
-        encryption_input.size,
+        encryption_input.source,
+        encryption_input.limit,
         platforms_vec,
         data_filename,
-        encryption_input.is_compressed);
+        encryption_input.layout,
+        encryption_input.codec,
+        encryption_input.frames,
+        image_key);
 
     const std::span<const Byte> cover_view = cover.view();
     StagedImage staged = saveEmbeddedJpg(
@@ -342,7 +607,6 @@ void finalizePlatformReport(vString& platforms_vec, const SegmentedEmbedSummary&
     }
 
     return ConcealFinalizeResult{
-        .recovery_pin = std::move(recovery_pin),
         .staged = std::move(staged),
         .embedded_jpg_size = embedded_jpg_size,
     };
@@ -354,36 +618,50 @@ void flushStdoutOrThrow() {
     }
 }
 
-void finalizeConcealOutput(const vString& platforms_vec, ConcealFinalizeResult& result) {
-    std::print("\nPlatform compatibility for output image:-\n\n");
+void printPlatformReport(const vString& platforms_vec) {
     for (const auto& s : platforms_vec) {
         std::println(" ✓ {}", s);
     }
+}
 
+// The PIN is shown before any image it unlocks is given its final name, so an
+// output that appears is never one whose PIN failed to reach the user.
+void deliverRecoveryPin(SecurePin& recovery_pin, std::string_view kept_for) {
     std::println("\nRecovery PIN: [***{}***]\n\n"
-                 "Important: Keep your PIN safe, so that you can extract the hidden file.\n",
-                 result.recovery_pin.value);
+                 "Important: Keep your PIN safe, so that you can extract {}.\n",
+                 recovery_pin.value,
+                 kept_for);
     flushStdoutOrThrow();
     throwIfSignalCancellationRequested();
-    result.recovery_pin.wipe();
+    recovery_pin.wipe();
+}
 
+void commitConcealedImage(ConcealFinalizeResult& result) {
     commitStagedFileNoReplaceOrThrow(
         result.staged.temp_output.path,
         result.staged.output_path,
         "Write File Error: Failed to commit output image");
     result.staged.temp_output.dismiss();
+}
 
-    std::println("\nSaved \"file-embedded\" JPG image: {} ({} bytes).\n\nComplete!\n",
-                 result.staged.output_path.string(),
-                 result.embedded_jpg_size);
-    flushStdoutOrThrow();
+void requireCipherAvailable(CipherSuite cipher) {
+    if (!isCipherSuiteAvailable(cipher)) {
+        throw std::runtime_error(std::format(
+            "Cipher Error: {} needs hardware support (AES-NI on x86-64, the Crypto Extensions on ARMv8)\n"
+            "              that this CPU lacks. Run \"jdvrif bench-cipher\" to see what this host supports.",
+            cipherSuiteName(cipher)));
+    }
 }
-} // namespace
 
-void concealData(vBytes& jpg_vec, Option option, const fs::path& data_file_path) {
-    vString platforms_vec = platformReportTemplate();
-    const ConcealFlags flags = concealFlags(option);
+// Prepares the cover and decides how the payload is compressed and framed,
+// running every size check that does not need the ciphertext; nothing is
+// written or printed beyond the --stats report.
+[[nodiscard]] ConcealPlan planConceal(
+    vBytes& jpg_vec,
+    const ConcealOptions& options,
+    const fs::path& data_file_path) {
 
+    const ConcealFlags flags = concealFlags(options.option);
     const std::size_t source_data_size = validateFileForRead(data_file_path);
 
     OptimizedCover cover = prepareCoverImage(jpg_vec, source_data_size, flags);
@@ -395,31 +673,201 @@ void concealData(vBytes& jpg_vec, Option option, const fs::path& data_file_path)
     validateCoverImageLimits(jpg_size, flags);
 
     const std::string data_filename = validateDataFilename(data_file_path);
-    const bool bypass_compression = shouldBypassCompression(data_file_path, source_data_size);
+    const CompressionProbe probe = decideCompression(data_file_path, source_data_size, flags);
+    PayloadCodec codec = probe.bypass ? PayloadCodec::raw : options.codec;
+    if (options.show_stats) {
+        printCompressionProbe(probe, codec);
+    }
+
+    CompressionSettings compression_settings =
+        compressionSettingsFor(data_file_path, source_data_size, codec, options);
+    if (codec != PayloadCodec::raw) {
+        compression_settings.filter = choosePayloadFilter(data_file_path, source_data_size);
+        if (options.show_stats && compression_settings.filter.active()) {
+            std::println("  Filter: {}.", payloadFilterName(compression_settings.filter));
+        }
+    }
 
+    const FrameFormat frames = frameFormatFor(source_data_size, options);
     vBytes segment_vec = makeSegmentTemplate(flags.has_bluesky_option);
     maybePrintLargeFileNotice(source_data_size);
 
-    TempFileCleanupGuard compressed_guard;
-    const EncryptionInput encryption_input = prepareEncryptionInput(
-        data_file_path,
-        source_data_size,
-        bypass_compression,
-        segment_vec,
-        compressed_guard);
+    PayloadSource payload_source;
+    if (!options.target_platform.empty()) {
+        const PlatformLimits* limits = findPlatformLimits(options.target_platform);
+        if (!limits) {
+            throw std::runtime_error("Internal Error: Unknown target platform.");
+        }
+        TargetFit fit = fitPayloadToTarget(
+            data_file_path, source_data_size, codec, compression_settings,
+            *limits, segment_vec.size(),
+            payloadPrefixSize(data_filename, PayloadLayout{.filter = compression_settings.filter}),
+            frames.frame_size, jpg_size);
+        codec = fit.codec;
+        compression_settings.level = fit.level;
+        if (codec == PayloadCodec::raw) {
+            compression_settings.filter = PayloadFilter{};
+        }
+        if (options.show_stats) {
+            std::println("  Target: {} fits with {} ({} byte payload).",
+                         limits->name,
+                         fit.level ? std::format("zlib level {}", *fit.level) : std::string("no compression"),
+                         fit.payload_size);
+        }
+        if (fit.payload) {
+            payload_source = [payload = std::move(fit.payload)](const ByteSink& sink) {
+                sink(std::span<const Byte>(*payload));
+            };
+        }
+    }
+    const PayloadLayout layout = payloadLayoutFor(source_data_size, codec, compression_settings.filter, options);
+    if (options.show_stats && layout.hasMembers()) {
+        std::println("  Indexed: {} independent zlib members of {} MiB.",
+                     layout.memberCount(), layout.member_input_size / (1024 * 1024));
+    }
+    if (!payload_source) {
+        payload_source = makePayloadSource(data_file_path, source_data_size, codec, layout, compression_settings);
+    }
+
+    if (options.show_stats) {
+        std::println("  Cipher: {}, {} KiB frames.", cipherSuiteName(frames.cipher), frames.frame_size / 1024);
+    }
+    writeCompressionMarker(segment_vec, codec);
+    // A raw payload's encrypted size is exact up front: fail before any work.
+    std::optional<std::size_t> encrypted_size;
+    if (codec == PayloadCodec::raw) {
+        if (data_filename.size() > std::numeric_limits<std::size_t>::max() - 1 - source_data_size) {
+            throw std::runtime_error("File Size Error: Encrypted output overflow.");
+        }
+        encrypted_size = computeStreamEncryptedSizePrefixed(
+            source_data_size,
+            payloadPrefixSize(data_filename, layout),
+            frames.frame_size);
+        validateCombinedSizeLimits(*encrypted_size, jpg_size, flags);
+    }
+
+    return ConcealPlan{
+        .flags = flags,
+        .cover = std::move(cover),
+        .segment_vec = std::move(segment_vec),
+        .data_filename = data_filename,
+        .encryption_input = EncryptionInput{
+            .source = std::move(payload_source),
+            .codec = codec,
+            .frames = frames,
+            .layout = layout,
+            .limit = encryptionSizeLimit(jpg_size, flags),
+            .encrypted_size = encrypted_size,
+        },
+    };
+}
+
+// Compresses, encrypts with image_key and writes one planned image to its
+// temporary path; nothing is committed or printed beyond the --stats report.
+[[nodiscard]] ConcealFinalizeResult stageConcealedImage(
+    ConcealPlan& plan,
+    const ConcealOptions& options,
+    ImageKey& image_key,
+    vString& platforms_vec) {
+
+    if (options.show_stats) {
+        std::println("  Key derivation: Argon2id, {} passes over {} MiB{}.",
+                     image_key.cost().opslimit, image_key.cost().memlimit / (1024 * 1024),
+                     image_key.subkeyId() ? std::format(", batch subkey {}", *image_key.subkeyId()) : "");
+    }
+    ConcealFinalizeResult result = plan.flags.has_bluesky_option
+        ? concealBlueskyPath(plan.segment_vec, plan.cover, plan.encryption_input, image_key, plan.data_filename, platforms_vec)
+        : concealDefaultPath(plan.segment_vec, plan.cover, plan.encryption_input, image_key, plan.data_filename, platforms_vec);
+    if (options.show_stats) {
+        std::println("  Output: {} bytes in {} write calls.", result.embedded_jpg_size, result.staged.write_calls);
+    }
+    return result;
+}
+} // namespace
+
+void concealData(vBytes& jpg_vec, const ConcealOptions& options, const fs::path& data_file_path) {
+    requireCipherAvailable(options.cipher);
+    (void)validateFileForRead(data_file_path);
+
+    ConcealPlan plan = planConceal(jpg_vec, options, data_file_path);
+
+    // Only now, with every size check passed, does Argon2id start; it runs
+    // while the first round of frames is compressed.
+    SecurePin recovery_pin = generateRecoveryPin();
+    ImageKey image_key(recovery_pin, options.kdf);
+
+    vString platforms_vec = platformReportTemplate();
+    ConcealFinalizeResult result = stageConcealedImage(plan, options, image_key, platforms_vec);
+
+    std::print("\nPlatform compatibility for output image:-\n\n");
+    printPlatformReport(platforms_vec);
+    deliverRecoveryPin(recovery_pin, "the hidden file");
+    commitConcealedImage(result);
+
+    std::println("\nSaved \"file-embedded\" JPG image: {} ({} bytes).\n\nComplete!\n",
+                 result.staged.output_path.string(),
+                 result.embedded_jpg_size);
+    flushStdoutOrThrow();
+}
+
+// Every image is staged before the shared PIN is shown, and none is committed
+// until it has been: one failure leaves no outputs behind, rather than some
+// images whose PIN was never printed.
+void concealBatch(const vBytes& jpg_vec, const ConcealOptions& options, std::span<const fs::path> data_file_paths) {
+    requireCipherAvailable(options.cipher);
+    if (data_file_paths.size() > MAX_BATCH_SUBKEY_ID + 1) {
+        throw std::runtime_error("Invalid Input Error: Too many data files for one batch.");
+    }
+    for (const fs::path& data_file_path : data_file_paths) {
+        (void)validateFileForRead(data_file_path);
+        (void)validateDataFilename(data_file_path);
+    }
 
-    if (data_filename.size() > std::numeric_limits<std::size_t>::max() - 1 - encryption_input.size) {
-        throw std::runtime_error("File Size Error: Encrypted output overflow.");
+    // Every image is planned first, so one that cannot fit fails the batch
+    // before the KDF runs.
+    std::vector<ConcealPlan> plans;
+    plans.reserve(data_file_paths.size());
+    for (std::size_t i = 0; i < data_file_paths.size(); ++i) {
+        std::println("\n[{}/{}] {}", i + 1, data_file_paths.size(), data_file_paths[i].string());
+        vBytes cover_vec = jpg_vec;
+        plans.push_back(planConceal(cover_vec, options, data_file_paths[i]));
     }
-    const std::size_t filename_prefix_size = 1 + data_filename.size();
-    const std::size_t encrypted_payload_size = computeStreamEncryptedSizePrefixed(
-        encryption_input.size,
-        filename_prefix_size);
-    validateCombinedSizeLimits(encrypted_payload_size, jpg_size, flags);
 
-    ConcealFinalizeResult result = flags.has_bluesky_option
-        ? concealBlueskyPath(segment_vec, cover, encryption_input, data_filename, platforms_vec)
-        : concealDefaultPath(segment_vec, cover, encryption_input, data_filename, platforms_vec);
+    // The one Argon2id run of the batch, overlapping the first image's compression.
+    BatchKey batch_key(options.kdf);
 
-    finalizeConcealOutput(platforms_vec, result);
+    std::vector<BatchImage> images;
+    images.reserve(data_file_paths.size());
+    for (std::size_t i = 0; i < data_file_paths.size(); ++i) {
+        if (options.show_stats) {
+            std::println("\n[{}/{}] {}", i + 1, data_file_paths.size(), data_file_paths[i].string());
+        }
+        ImageKey image_key(batch_key, i);
+        vString platforms_vec = platformReportTemplate();
+        ConcealFinalizeResult result = stageConcealedImage(plans[i], options, image_key, platforms_vec);
+        plans[i] = ConcealPlan{};
+        images.push_back(BatchImage{
+            .data_file_path = data_file_paths[i],
+            .platforms_vec = std::move(platforms_vec),
+            .result = std::move(result),
+        });
+    }
+
+    for (const BatchImage& image : images) {
+        std::print("\nPlatform compatibility for output image of {}:-\n\n", image.data_file_path.string());
+        printPlatformReport(image.platforms_vec);
+    }
+
+    deliverRecoveryPin(batch_key.pin(), std::format("the hidden files from all {} images", images.size()));
+
+    std::println("");
+    for (BatchImage& image : images) {
+        commitConcealedImage(image.result);
+        std::println("Saved \"file-embedded\" JPG image: {} ({} bytes) <- {}.",
+                     image.result.staged.output_path.string(),
+                     image.result.embedded_jpg_size,
+                     image.data_file_path.string());
+    }
+    std::println("\nComplete!\n");
+    flushStdoutOrThrow();
 }
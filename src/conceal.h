@@ -2,4 +2,10 @@
 
 #include "common.h"
 
-void concealData(vBytes& jpg_vec, Option option, const fs::path& data_file_path);
+#include <span>
+
+void concealData(vBytes& jpg_vec, const ConcealOptions& options, const fs::path& data_file_path);
+
+// Conceals each data file in its own copy of the cover image, all under one
+// recovery PIN (see BatchKey): one Argon2id run for the whole batch.
+void concealBatch(const vBytes& jpg_vec, const ConcealOptions& options, std::span<const fs::path> data_file_paths);
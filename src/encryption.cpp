@@ -3,63 +3,54 @@
 #include "binary_io.h"
 #include "embedded_layout.h"
 #include "file_utils.h"
+#include "payload_prefix.h"
 #include "pin_input.h"
 #include "segmentation.h"
 #include "template_assets.h"
 
 #include <algorithm>
 #include <array>
-#include <cstring>
+#include <bit>
+#include <cstdint>
+#include <format>
 #include <iostream>
-#include <limits>
+#include <optional>
 #include <print>
 #include <ranges>
 #include <span>
 #include <stdexcept>
 #include <string>
 #include <utility>
+#include <vector>
 
 namespace {
-inline constexpr std::size_t MAX_FILENAME_PREFIX_BYTES =
-    static_cast<std::size_t>(std::numeric_limits<Byte>::max());
-
-struct FilenamePrefix {
-    std::array<Byte, MAX_FILENAME_PREFIX_BYTES> bytes{};
-    std::size_t size{0};
-
-    [[nodiscard]] std::span<const Byte> view() const noexcept {
-        return std::span<const Byte>(bytes.data(), size);
-    }
-};
-
-[[nodiscard]] FilenamePrefix makeFilenamePrefix(const std::string& data_filename) {
-    if (data_filename.empty() ||
-        data_filename.size() > static_cast<std::size_t>(std::numeric_limits<Byte>::max() - 1)) {
-        throw std::runtime_error("Data File Error: Invalid data filename length.");
-    }
-
-    FilenamePrefix filename_prefix;
-    filename_prefix.size = 1 + data_filename.size();
-    filename_prefix.bytes[0] = static_cast<Byte>(data_filename.size());
-    std::memcpy(filename_prefix.bytes.data() + 1, data_filename.data(), data_filename.size());
-    return filename_prefix;
-}
-
 void storeKdfMetadata(
     vBytes& segment_vec,
     std::size_t kdf_metadata_index,
-    const Salt& salt,
-    const std::array<Byte, crypto_secretstream_xchacha20poly1305_HEADERBYTES>& stream_header) {
+    const ImageKey& image_key,
+    const std::array<Byte, crypto_secretstream_xchacha20poly1305_HEADERBYTES>& stream_header,
+    const FrameFormat& frames) {
 
     randombytes_buf(segment_vec.data() + kdf_metadata_index, KDF_METADATA_REGION_BYTES);
 
+    const std::optional<std::uint64_t> subkey_id = image_key.subkeyId();
     std::ranges::copy(
-        KDF_METADATA_MAGIC_V3,
+        subkey_id ? KDF_METADATA_MAGIC_V6 : KDF_METADATA_MAGIC_V5,
         segment_vec.begin() + static_cast<std::ptrdiff_t>(kdf_metadata_index + KDF_MAGIC_OFFSET));
     segment_vec[kdf_metadata_index + KDF_ALG_OFFSET] = KDF_ALG_ARGON2ID13;
     segment_vec[kdf_metadata_index + KDF_SENTINEL_OFFSET] = KDF_SENTINEL;
+    segment_vec[kdf_metadata_index + KDF_CIPHER_OFFSET] = static_cast<Byte>(frames.cipher);
+    segment_vec[kdf_metadata_index + KDF_FRAME_SIZE_OFFSET] = static_cast<Byte>(std::countr_zero(frames.frame_size));
+    segment_vec[kdf_metadata_index + KDF_OPSLIMIT_OFFSET] = static_cast<Byte>(image_key.cost().opslimit);
+    segment_vec[kdf_metadata_index + KDF_MEMLIMIT_OFFSET] =
+        static_cast<Byte>(std::countr_zero(image_key.cost().memlimit));
+    if (subkey_id) {
+        // u48 big-endian: the high 16 bits, then the low 32.
+        updateValue(segment_vec, kdf_metadata_index + KDF_SUBKEY_ID_OFFSET, *subkey_id >> 32, 2);
+        updateValue(segment_vec, kdf_metadata_index + KDF_SUBKEY_ID_OFFSET + 2, *subkey_id & 0xFFFFFFFF, 4);
+    }
     std::ranges::copy(
-        salt,
+        image_key.salt(),
         segment_vec.begin() + static_cast<std::ptrdiff_t>(kdf_metadata_index + KDF_SALT_OFFSET));
     std::ranges::copy(
         stream_header,
@@ -75,8 +66,10 @@ void deriveStreamKeyMaterial(
     std::span<const Byte> metadata,
     std::size_t kdf_metadata_index,
     SecurePin& recovery_pin,
-    Key& key,
+    PendingKey& key,
     StreamHeader& stream_header,
+    const KdfCost& kdf,
+    std::optional<std::uint64_t> subkey_id,
     const char* corrupt_error) {
 
     requireSpanRange(metadata, kdf_metadata_index + KDF_SALT_OFFSET, Salt{}.size(), corrupt_error);
@@ -87,8 +80,8 @@ void deriveStreamKeyMaterial(
         metadata.begin() + static_cast<std::ptrdiff_t>(kdf_metadata_index + KDF_SALT_OFFSET),
         static_cast<std::ptrdiff_t>(salt.size()),
         salt.begin());
-    deriveKeyFromPin(key, recovery_pin, salt);
-    // PIN is no longer needed after key derivation on the recover path.
+    key.start(recovery_pin, salt, kdf, subkey_id);
+    // The worker holds its own copy; the PIN is not needed here any more.
     recovery_pin.wipe();
 
     std::ranges::copy_n(
@@ -182,6 +175,67 @@ void validateBlueskyExifCapacity(
 namespace {
 constexpr const char* CORRUPT_FILE_ERROR = "File Extraction Error: Embedded data file is corrupt!";
 
+// Bytes 6-7 were random before V4, so only a V4 image names its suite and
+// frame size. The frame size bounds recover's buffers, hence the hard limits.
+[[nodiscard]] FrameFormat readFrameFormat(
+    std::span<const Byte> metadata,
+    std::size_t kdf_metadata_index,
+    KdfMetadataVersion metadata_version) {
+
+    if (!hasParallelFrames(metadata_version)) {
+        return FrameFormat{.cipher = CipherSuite::xchacha20poly1305, .frame_size = STREAM_CHUNK_SIZE};
+    }
+    const Byte cipher = metadata[kdf_metadata_index + KDF_CIPHER_OFFSET];
+    if (cipher != static_cast<Byte>(CipherSuite::xchacha20poly1305) &&
+        cipher != static_cast<Byte>(CipherSuite::aes256gcm)) {
+        throw std::runtime_error(
+            "File Decryption Error: This file uses a cipher this version of jdvrif does not support.");
+    }
+    const Byte frame_size_log2 = metadata[kdf_metadata_index + KDF_FRAME_SIZE_OFFSET];
+    if (frame_size_log2 < std::countr_zero(MIN_STREAM_FRAME_SIZE) ||
+        frame_size_log2 > std::countr_zero(MAX_STREAM_FRAME_SIZE)) {
+        throw std::runtime_error(CORRUPT_FILE_ERROR);
+    }
+    return FrameFormat{
+        .cipher = static_cast<CipherSuite>(cipher),
+        .frame_size = std::size_t{1} << frame_size_log2,
+    };
+}
+
+[[nodiscard]] KdfCost readKdfCost(
+    std::span<const Byte> metadata,
+    std::size_t kdf_metadata_index,
+    KdfMetadataVersion metadata_version) {
+
+    if (!hasKdfCost(metadata_version)) {
+        return KdfCost{};
+    }
+    const Byte opslimit = metadata[kdf_metadata_index + KDF_OPSLIMIT_OFFSET];
+    const Byte memlimit_log2 = metadata[kdf_metadata_index + KDF_MEMLIMIT_OFFSET];
+    if (opslimit < MIN_KDF_OPSLIMIT || opslimit > MAX_KDF_OPSLIMIT ||
+        memlimit_log2 < std::countr_zero(MIN_KDF_MEMLIMIT) ||
+        memlimit_log2 > std::countr_zero(MAX_KDF_MEMLIMIT)) {
+        throw std::runtime_error(
+            "File Decryption Error: This file's key derivation cost is outside the range jdvrif accepts.");
+    }
+    return KdfCost{
+        .opslimit = opslimit,
+        .memlimit = std::size_t{1} << memlimit_log2,
+    };
+}
+
+[[nodiscard]] std::optional<std::uint64_t> readBatchSubkeyId(
+    std::span<const Byte> metadata,
+    std::size_t kdf_metadata_index,
+    KdfMetadataVersion metadata_version) {
+
+    if (metadata_version != KdfMetadataVersion::v6_batch_subkey) {
+        return std::nullopt;
+    }
+    return (std::uint64_t{getValue(metadata, kdf_metadata_index + KDF_SUBKEY_ID_OFFSET, 2)} << 32) |
+           getValue(metadata, kdf_metadata_index + KDF_SUBKEY_ID_OFFSET + 2, 4);
+}
+
 // Zero the full allocation (capacity, not only size) then release. vector::clear()
 // alone leaves residual ciphertext in the heap freelist until the block is reused.
 void wipeAndRelease(vBytes& buf) noexcept {
@@ -215,82 +269,77 @@ struct WipeBytesGuard {
 };
 } // namespace
 
-SecurePin encryptDataFileForBluesky(
+void encryptDataFileForBluesky(
     vBytes& segment_vec,
-    const fs::path& data_path,
-    std::size_t input_size,
+    const PayloadSource& source,
+    const EncryptedSizeLimit& limit,
     vString& platforms_vec,
     const std::string& data_filename,
-    bool is_data_compressed) {
+    const PayloadLayout& layout,
+    PayloadCodec codec,
+    const FrameFormat& frames,
+    ImageKey& image_key) {
     constexpr std::size_t kdf_metadata_index = BLUESKY_CIPHER_LAYOUT.template_kdf_metadata_index;
 
     requireSpanRange(segment_vec, kdf_metadata_index, KDF_METADATA_REGION_BYTES, "Internal Error: Corrupt key metadata.");
-    const FilenamePrefix filename_prefix = makeFilenamePrefix(data_filename);
+    const vBytes payload_prefix = encodePayloadPrefix(data_filename, layout);
 
-    SecureBuffer<Key> key;
-    Salt salt{};
     StreamHeader stream_header{};
     vBytes encrypted_vec;
     // Guard must outlive the encrypt call: a throw partway through (e.g. signal
     // cancellation) still leaves partial ciphertext in the buffer to wipe.
     WipeBytesGuard encrypted_wipe{encrypted_vec};
 
-    SecurePin pin = generateRecoveryPin();
-    randombytes_buf(salt.data(), salt.size());
-    deriveKeyFromPin(key.buf, pin, salt);
-    encryptFileWithSecretStreamPrefixed(
-        data_path,
-        input_size,
-        filename_prefix.view(),
-        streamModeByte(is_data_compressed),
-        key.buf,
+    encryptParallelFramesPrefixed(
+        source,
+        payload_prefix,
+        streamModeByte(codec),
+        frames,
+        image_key.key(),
         stream_header,
+        limit,
         encrypted_vec);
 
     buildBlueskySegments(segment_vec, encrypted_vec);
 
-    storeKdfMetadata(segment_vec, kdf_metadata_index, salt, stream_header);
+    storeKdfMetadata(segment_vec, kdf_metadata_index, image_key, stream_header, frames);
 
     keepOnlyPlatformEntry(platforms_vec, BLUESKY_PLATFORM_INDEX);
-    return pin;
 }
 
-SecurePin encryptDataFileToFile(
+void encryptDataFileToSink(
     vBytes& segment_vec,
-    const fs::path& data_path,
-    std::size_t input_size,
+    const PayloadSource& source,
+    const EncryptedSizeLimit& limit,
     const std::string& data_filename,
-    const fs::path& encrypted_output_path,
-    bool is_data_compressed) {
+    const PayloadLayout& layout,
+    PayloadCodec codec,
+    const FrameFormat& frames,
+    ImageKey& image_key,
+    const CipherSink& sink) {
 
     constexpr std::size_t kdf_metadata_index = ICC_CIPHER_LAYOUT.template_kdf_metadata_index;
     requireSpanRange(segment_vec, kdf_metadata_index, KDF_METADATA_REGION_BYTES, "Internal Error: Corrupt key metadata.");
-    const FilenamePrefix filename_prefix = makeFilenamePrefix(data_filename);
+    const vBytes payload_prefix = encodePayloadPrefix(data_filename, layout);
 
-    SecureBuffer<Key> key;
-    Salt salt{};
     StreamHeader stream_header{};
-
-    SecurePin pin = generateRecoveryPin();
-    randombytes_buf(salt.data(), salt.size());
-    deriveKeyFromPin(key.buf, pin, salt);
-    encryptFileWithSecretStreamPrefixedToFile(
-        data_path,
-        input_size,
-        filename_prefix.view(),
-        streamModeByte(is_data_compressed),
-        key.buf,
+    encryptParallelFramesPrefixedToSink(
+        source,
+        payload_prefix,
+        streamModeByte(codec),
+        frames,
+        image_key.key(),
         stream_header,
-        encrypted_output_path);
+        limit,
+        sink);
 
-    storeKdfMetadata(segment_vec, kdf_metadata_index, salt, stream_header);
-    return pin;
+    storeKdfMetadata(segment_vec, kdf_metadata_index, image_key, stream_header, frames);
 }
 
-KdfMetadataVersion prepareDecryptKeyFromMetadata(
+StreamFormat prepareDecryptKeyFromMetadata(
     vBytes& metadata_vec,
     bool isBlueskyFile,
-    Key& out_key,
+    PendingKey& out_key,
     StreamHeader& out_stream_header) {
 
     const EmbeddedCipherLayout& cipher_layout = embeddedCipherLayout(isBlueskyFile);
@@ -304,9 +353,21 @@ KdfMetadataVersion prepareDecryptKeyFromMetadata(
     const KdfMetadataVersion metadata_version =
         getKdfMetadataVersion(metadata_vec, kdf_metadata_index);
     if (metadata_version != KdfMetadataVersion::v2_secretstream &&
-        metadata_version != KdfMetadataVersion::v3_secretstream_authenticated_mode) {
+        metadata_version != KdfMetadataVersion::v3_secretstream_authenticated_mode &&
+        !hasParallelFrames(metadata_version)) {
         throw std::runtime_error("File Decryption Error: Unsupported legacy encrypted file format. Use an older jdvrif release to recover this file.");
     }
+    const StreamFormat format{
+        .version = metadata_version,
+        .frames = readFrameFormat(metadata_vec, kdf_metadata_index, metadata_version),
+    };
+    const KdfCost kdf = readKdfCost(metadata_vec, kdf_metadata_index, metadata_version);
+    if (!isCipherSuiteAvailable(format.frames.cipher)) {
+        throw std::runtime_error(std::format(
+            "File Decryption Error: This file was encrypted with {}, which this CPU has no hardware support for.\n"
+            "                       Recover it on a machine with AES-NI (x86-64) or the ARMv8 Crypto Extensions.",
+            cipherSuiteName(format.frames.cipher)));
+    }
 
     if (isBlueskyFile) {
         requireSpanRange(metadata_vec, cipher_layout.file_size_index, 4, CORRUPT_FILE_ERROR);
@@ -323,41 +384,42 @@ KdfMetadataVersion prepareDecryptKeyFromMetadata(
         recovery_pin,
         out_key,
         out_stream_header,
+        kdf,
+        readBatchSubkeyId(metadata_vec, kdf_metadata_index, metadata_version),
         CORRUPT_FILE_ERROR);
     // recovery_pin already wiped inside deriveStreamKeyMaterial.
-    return metadata_version;
+    return format;
 }
 
 DecryptResult decryptDataFileWithKey(
     const Key& key,
     const StreamHeader& stream_header,
-    KdfMetadataVersion metadata_version,
+    const StreamFormat& format,
     const fs::path& encrypted_input_path,
     const fs::path& stream_output_path,
-    bool is_data_compressed) {
+    PayloadCodec codec) {
 
     DecryptResult result;
 
-    constexpr std::size_t min_encrypted_size = STREAM_FRAME_LEN_BYTES + crypto_secretstream_xchacha20poly1305_ABYTES;
-    if (checkedFileSize(encrypted_input_path, CORRUPT_FILE_ERROR, true) < min_encrypted_size) {
+    if (checkedFileSize(encrypted_input_path, CORRUPT_FILE_ERROR, true) < MIN_STREAM_CIPHERTEXT_BYTES) {
         result.failed = true;
         return result;
     }
 
     std::size_t output_size = 0;
     std::string decrypted_filename;
-    if (!decryptWithSecretStreamFileInputToFileExtractingFilename(
+    if (!decryptStreamFileInputToFileExtractingFilename(
             encrypted_input_path,
             key,
             stream_header,
-            metadata_version,
-            is_data_compressed,
+            format,
+            codec,
             stream_output_path,
             output_size,
             decrypted_filename)) {
         return failDecryption();
     }
-    if (!is_data_compressed && output_size == 0) {
+    if (codec == PayloadCodec::raw && output_size == 0) {
         throw std::runtime_error("File Extraction Error: Output file is empty.");
     }
 
@@ -366,22 +428,84 @@ DecryptResult decryptDataFileWithKey(
     return result;
 }
 
+namespace {
+[[nodiscard]] VerifyResult verifyResultFrom(bool authenticated, StreamAuthentication& auth, PayloadCodec codec) {
+    if (!authenticated) {
+        std::println(std::cerr, "\nVerification failed!");
+        return VerifyResult{.failed = true};
+    }
+    VerifyResult result;
+    result.filename = std::move(auth.filename);
+    result.payload_size = auth.payload_size;
+    if (codec == PayloadCodec::raw) {
+        result.original_size = auth.payload_size;
+    } else if (auth.layout.hasMembers()) {
+        result.original_size = auth.layout.total_input_size;
+    }
+    return result;
+}
+} // namespace
+
+VerifyResult verifyDataFileWithKey(
+    const Key& key,
+    const StreamHeader& stream_header,
+    const StreamFormat& format,
+    const fs::path& image_path,
+    std::span<const FileExtent> extents,
+    PayloadCodec codec) {
+
+    std::size_t ciphertext_size = 0;
+    for (const FileExtent& extent : extents) {
+        ciphertext_size += extent.size;
+    }
+    if (ciphertext_size < MIN_STREAM_CIPHERTEXT_BYTES) {
+        return VerifyResult{.failed = true};
+    }
+
+    StreamAuthentication auth;
+    const bool authenticated = authenticateStreamExtents(
+        image_path,
+        std::vector<FileExtent>(extents.begin(), extents.end()),
+        key,
+        stream_header,
+        format,
+        codec,
+        auth);
+    return verifyResultFrom(authenticated, auth, codec);
+}
+
+VerifyResult verifyDataWithKey(
+    const Key& key,
+    const StreamHeader& stream_header,
+    const StreamFormat& format,
+    std::span<const Byte> ciphertext,
+    PayloadCodec codec) {
+
+    if (ciphertext.size() < MIN_STREAM_CIPHERTEXT_BYTES) {
+        return VerifyResult{.failed = true};
+    }
+
+    StreamAuthentication auth;
+    const bool authenticated = authenticateStreamBuffer(ciphertext, key, stream_header, format, codec, auth);
+    return verifyResultFrom(authenticated, auth, codec);
+}
+
 DecryptResult decryptDataFile(
     vBytes& metadata_vec,
     bool isBlueskyFile,
     const fs::path& encrypted_input_path,
     const fs::path& stream_output_path,
-    bool is_data_compressed) {
+    PayloadCodec codec) {
 
-    SecureBuffer<Key> key;
+    PendingKey key;
     StreamHeader stream_header{};
-    const KdfMetadataVersion metadata_version =
-        prepareDecryptKeyFromMetadata(metadata_vec, isBlueskyFile, key.buf, stream_header);
+    const StreamFormat format =
+        prepareDecryptKeyFromMetadata(metadata_vec, isBlueskyFile, key, stream_header);
     return decryptDataFileWithKey(
-        key.buf,
+        key.get(),
         stream_header,
-        metadata_version,
+        format,
         encrypted_input_path,
         stream_output_path,
-        is_data_compressed);
+        codec);
 }
@@ -2,7 +2,42 @@
 
 #include "common.h"
 
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+
 enum class KdfMetadataVersion : Byte;
+struct PayloadLayout;
+struct FileExtent;
+
+// Produces the payload (everything after the payload prefix) by calling the
+// sink as often as it likes; the payload ends when the source returns. Lets a
+// compressor feed the encryptor directly, with no staging file in between.
+using PayloadSource = std::function<void(const ByteSink&)>;
+
+// Where sealed ciphertext goes. Unlike a plain ByteSink, write may keep the
+// spans it is given instead of copying them: they stay valid until the next
+// end_round, which the encryptor calls after each round of frames, before it
+// reuses their buffers. A sink can so write a whole round at once.
+struct CipherSink {
+    ByteSink write{};
+    std::function<void()> end_round{};
+};
+
+// Streams a file of known size in STREAM_CHUNK_SIZE pieces, failing if the
+// file changes size underneath.
+[[nodiscard]] PayloadSource payloadSourceFromFile(const fs::path& data_path, std::size_t input_size);
+
+// Ceiling on the framed ciphertext, checked as each frame is produced: with a
+// streamed (compressed) source the final size is only known at the end.
+struct EncryptedSizeLimit {
+    std::size_t max_bytes{std::numeric_limits<std::size_t>::max()};
+    const char* error_message{"File Size Error: Encrypted output overflow."};
+};
 
 template<typename T>
 struct SecureBuffer {
@@ -23,27 +58,145 @@ struct SecureBuffer {
     auto size() const { return buf.size(); }
 };
 
+// Argon2id key derivation on a thread of its own, so that compression (on
+// conceal) or ciphertext extraction (on recover) runs while the KDF does. The
+// worker derives from its own copy of the PIN and wipes that copy, along with
+// deriveKeyFromPin's stack copies, before it exits; the key is wiped on
+// destruction. Like WorkerPool workers, the thread blocks all signals.
+class PendingKey {
+public:
+    PendingKey() = default;
+    ~PendingKey();
+
+    PendingKey(const PendingKey&) = delete;
+    PendingKey& operator=(const PendingKey&) = delete;
+
+    // Reads pin.value; the caller's SecurePin is left as it was. With a
+    // subkey_id the Argon2id output is a batch master key, and the key is
+    // that master's subkey_id subkey (see BatchKey).
+    void start(const SecurePin& pin, const Salt& salt, const KdfCost& cost,
+               std::optional<std::uint64_t> subkey_id = std::nullopt);
+
+    // The key is master's subkey_id subkey, derived when get() is first
+    // called. master must outlive this.
+    void startSubkey(PendingKey& master, std::uint64_t subkey_id);
+
+    // Waits for the derivation to finish and rethrows anything it threw.
+    [[nodiscard]] const Key& get();
+
+private:
+    SecureBuffer<Key> key_{};
+    SecurePin pin_{};
+    Salt salt_{};
+    KdfCost cost_{};
+    std::optional<std::uint64_t> subkey_id_{};
+    PendingKey* master_{nullptr};
+    std::exception_ptr error_{};
+    std::thread worker_{};
+    bool started_{false};
+};
+
+// Largest subkey id the KDF metadata can record (a u48).
+inline constexpr std::uint64_t MAX_BATCH_SUBKEY_ID = (std::uint64_t{1} << 48) - 1;
+
+[[nodiscard]] SecurePin generateRecoveryPin();
+
+// One recovery PIN and salt for a batch of images. Argon2id runs once, into
+// the batch master key; each image is sealed with its own subkey of it and
+// records the subkey id, so any one image recovers alone from the PIN.
+class BatchKey {
+public:
+    explicit BatchKey(const KdfCost& cost);
+
+    BatchKey(const BatchKey&) = delete;
+    BatchKey& operator=(const BatchKey&) = delete;
+
+    // Non-const so the caller can wipe it once it has been shown.
+    [[nodiscard]] SecurePin& pin() noexcept { return pin_; }
+
+private:
+    friend class ImageKey;
+
+    SecurePin pin_{};
+    Salt salt_{};
+    KdfCost cost_{};
+    PendingKey master_{};
+};
+
+// The key one image is sealed with, and what its KDF metadata must record for
+// recover to derive it again.
+class ImageKey {
+public:
+    // A standalone image: its own salt, with Argon2id started at once.
+    ImageKey(const SecurePin& pin, const KdfCost& cost);
+    // Image subkey_id of batch, which must outlive this.
+    ImageKey(BatchKey& batch, std::uint64_t subkey_id);
+
+    ImageKey(const ImageKey&) = delete;
+    ImageKey& operator=(const ImageKey&) = delete;
+
+    [[nodiscard]] const Salt& salt() const noexcept { return salt_; }
+    [[nodiscard]] const KdfCost& cost() const noexcept { return cost_; }
+    [[nodiscard]] std::optional<std::uint64_t> subkeyId() const noexcept { return subkey_id_; }
+    [[nodiscard]] PendingKey& key() noexcept { return key_; }
+
+private:
+    Salt salt_{};
+    KdfCost cost_{};
+    std::optional<std::uint64_t> subkey_id_{};
+    PendingKey key_{};
+};
+
+// Per-image V4 frame parameters, recorded in the KDF metadata, plus the
+// --threads limit (not recorded) on the workers that seal or open them.
+struct FrameFormat {
+    CipherSuite cipher{CipherSuite::xchacha20poly1305};
+    std::size_t frame_size{DEFAULT_STREAM_FRAME_SIZE};
+    std::size_t threads{0};  // 0 = one per hardware thread.
+};
+
+// What the KDF metadata records about the ciphertext that follows it. V2/V3
+// streams are always XChaCha20-Poly1305 in 1 MiB frames.
+struct StreamFormat {
+    KdfMetadataVersion version{};
+    FrameFormat frames{};
+};
+
+// AES-256-GCM is usable only where libsodium has hardware support for it.
+[[nodiscard]] bool isCipherSuiteAvailable(CipherSuite cipher) noexcept;
+[[nodiscard]] std::string_view cipherSuiteName(CipherSuite cipher) noexcept;
+
 void buildBlueskySegments(vBytes& segment_vec, const vBytes& data_vec);
 
 [[nodiscard]] std::size_t computeStreamEncryptedSizePrefixed(
     std::size_t input_plaintext_size,
-    std::size_t prefix_plaintext_size);
+    std::size_t prefix_plaintext_size,
+    std::size_t frame_size);
 
-[[nodiscard]] SecurePin encryptDataFileForBluesky(
+void encryptDataFileForBluesky(
     vBytes& segment_vec,
-    const fs::path& data_path,
-    std::size_t input_size,
+    const PayloadSource& source,
+    const EncryptedSizeLimit& limit,
     vString& platforms_vec,
     const std::string& data_filename,
-    bool is_data_compressed);
+    const PayloadLayout& layout,
+    PayloadCodec codec,
+    const FrameFormat& frames,
+    ImageKey& image_key);
 
-[[nodiscard]] SecurePin encryptDataFileToFile(
+// Streams the framed ciphertext to sink as it is produced, a round of frames
+// at a time. The KDF metadata is only stored into segment_vec once the last
+// frame has been passed on.
+void encryptDataFileToSink(
     vBytes& segment_vec,
-    const fs::path& data_path,
-    std::size_t input_size,
+    const PayloadSource& source,
+    const EncryptedSizeLimit& limit,
     const std::string& data_filename,
-    const fs::path& encrypted_output_path,
-    bool is_data_compressed);
+    const PayloadLayout& layout,
+    PayloadCodec codec,
+    const FrameFormat& frames,
+    ImageKey& image_key,
+    const CipherSink& sink);
 
 struct DecryptResult {
     std::string filename{};
@@ -52,24 +205,52 @@ struct DecryptResult {
 };
 
 // Validates KDF metadata (and Bluesky EXIF capacity), prompts for the recovery
-// PIN, and derives the secretstream key + header. Intended to run *before*
+// PIN, reads the stream header, and starts deriving the key on out_key. Fails
+// before the prompt if the image needs a cipher suite this host cannot run, or
+// a key derivation cost outside the KdfCost bounds. Intended to run *before*
 // extracting ciphertext from the cover image so corrupt/oversized embeddings
-// fail without multi-gigabyte staging I/O.
-[[nodiscard]] KdfMetadataVersion prepareDecryptKeyFromMetadata(
+// fail without multi-gigabyte staging I/O; the KDF then overlaps extraction.
+[[nodiscard]] StreamFormat prepareDecryptKeyFromMetadata(
     vBytes& metadata_vec,
     bool isBlueskyFile,
-    Key& out_key,
+    PendingKey& out_key,
     StreamHeader& out_stream_header);
 
-// Streams encrypted_input_path through secretstream decrypt (and inflate when
-// is_data_compressed) into stream_output_path using a key prepared above.
+// Streams encrypted_input_path through stream decryption (and the codec's
+// decoder, unless raw) into stream_output_path using a key prepared above.
 [[nodiscard]] DecryptResult decryptDataFileWithKey(
     const Key& key,
     const StreamHeader& stream_header,
-    KdfMetadataVersion metadata_version,
+    const StreamFormat& format,
     const fs::path& encrypted_input_path,
     const fs::path& stream_output_path,
-    bool is_data_compressed);
+    PayloadCodec codec);
+
+struct VerifyResult {
+    std::string filename{};
+    std::size_t payload_size{0};                  // As encrypted: compressed, for a compressed codec.
+    std::optional<std::size_t> original_size{};   // When the layout records it.
+    bool failed{false};
+};
+
+// Authenticates every frame of the ciphertext held in extents of image_path
+// with a key prepared above, as decryptDataFileWithKey would, but discards
+// the plaintext instead of decoding it: nothing is written anywhere.
+[[nodiscard]] VerifyResult verifyDataFileWithKey(
+    const Key& key,
+    const StreamHeader& stream_header,
+    const StreamFormat& format,
+    const fs::path& image_path,
+    std::span<const FileExtent> extents,
+    PayloadCodec codec);
+
+// The same, for ciphertext already extracted into memory.
+[[nodiscard]] VerifyResult verifyDataWithKey(
+    const Key& key,
+    const StreamHeader& stream_header,
+    const StreamFormat& format,
+    std::span<const Byte> ciphertext,
+    PayloadCodec codec);
 
 // prepareDecryptKeyFromMetadata + decryptDataFileWithKey (PIN then decrypt).
 // Prefer the split path in recover so ciphertext is extracted only after PIN.
@@ -78,4 +259,4 @@ struct DecryptResult {
     bool isBlueskyFile,
     const fs::path& encrypted_input_path,
     const fs::path& stream_output_path,
-    bool is_data_compressed);
+    PayloadCodec codec);
@@ -1,76 +1,173 @@
 #pragma once
 
 #include "common.h"
+#include "encryption.h"
+#include "payload_prefix.h"
+#include "read_ahead.h"
 
+#include <algorithm>
 #include <array>
 #include <span>
 #include <string>
+#include <vector>
 
 inline constexpr std::size_t
     KDF_METADATA_REGION_BYTES = 56,
     KDF_MAGIC_OFFSET          = 0,
     KDF_ALG_OFFSET            = 4,
     KDF_SENTINEL_OFFSET       = 5,
+    KDF_CIPHER_OFFSET         = 6,
+    KDF_FRAME_SIZE_OFFSET     = 7,
     KDF_SALT_OFFSET           = 8,
-    KDF_NONCE_OFFSET          = 24;
+    KDF_NONCE_OFFSET          = 24,
+    KDF_OPSLIMIT_OFFSET       = 48,
+    KDF_MEMLIMIT_OFFSET       = 49,
+    KDF_SUBKEY_ID_OFFSET      = 50;
 
 inline constexpr Byte KDF_ALG_ARGON2ID13 = 1;
 inline constexpr Byte KDF_SENTINEL = 0xA5;
 
 inline constexpr auto KDF_METADATA_MAGIC_V2 = std::to_array<Byte>({'K', 'D', 'F', '2'});
 inline constexpr auto KDF_METADATA_MAGIC_V3 = std::to_array<Byte>({'K', 'D', 'F', '3'});
+inline constexpr auto KDF_METADATA_MAGIC_V4 = std::to_array<Byte>({'K', 'D', 'F', '4'});
+inline constexpr auto KDF_METADATA_MAGIC_V5 = std::to_array<Byte>({'K', 'D', 'F', '5'});
+inline constexpr auto KDF_METADATA_MAGIC_V6 = std::to_array<Byte>({'K', 'D', 'F', '6'});
 
 // V3 authenticates the payload interpretation on every secretstream frame.
 // The JPEG metadata remains readable for routing, but changing its compression
 // marker can no longer make valid ciphertext be decoded with different rules.
 inline constexpr Byte STREAM_MODE_ZLIB = 1;
 inline constexpr Byte STREAM_MODE_RAW  = 2;
+inline constexpr Byte STREAM_MODE_ZSTD = 3;
 
 inline constexpr std::size_t STREAM_CHUNK_SIZE = 1 * 1024 * 1024;
 inline constexpr std::size_t STREAM_FRAME_LEN_BYTES = 4;
 
+// V4 keeps the V3 framing but seals every frame on its own with an AEAD
+// (KDF_CIPHER_OFFSET holds the CipherSuite: XChaCha20-Poly1305-IETF or
+// AES-256-GCM) instead of chaining them through a secretstream, so frames can
+// be sealed and opened in parallel. KDF_FRAME_SIZE_OFFSET holds log2 of the
+// plaintext frame size; every frame but the last is exactly that full. The
+// 24-byte stream header slot holds a random nonce base: frame i's nonce is the
+// first NPUBBYTES - 8 bytes of it followed by i (little-endian u64), i.e. 16
+// random bytes for XChaCha20 and 4 for AES-GCM, whose uniqueness rests on the
+// index alone (every image has its own key). Each frame's associated data is
+//   [mode][i:u64 BE][final]
+// and final is set on the last frame only; recover sets it from the frame's
+// position in the file, so a dropped, repeated, reordered or appended frame
+// fails to open.
+inline constexpr std::size_t PARALLEL_FRAME_ABYTES = crypto_aead_xchacha20poly1305_ietf_ABYTES;
+static_assert(crypto_aead_aes256gcm_ABYTES == PARALLEL_FRAME_ABYTES);
+static_assert(crypto_aead_aes256gcm_KEYBYTES == crypto_aead_xchacha20poly1305_ietf_KEYBYTES);
+inline constexpr std::size_t PARALLEL_FRAME_AD_BYTES = 10;
+
+// V5 is V4 plus the image's own Argon2id cost: KDF_OPSLIMIT_OFFSET holds the
+// opslimit and KDF_MEMLIMIT_OFFSET log2 of the memlimit in bytes. Earlier
+// versions always used the KdfCost defaults.
+
+// V6 is V5 for an image concealed as part of a batch: the Argon2id output is
+// the batch's master key, shared by every image made with the same PIN and
+// salt, and the image's key is crypto_kdf_derive_from_key(master, id) with the
+// big-endian u48 id at KDF_SUBKEY_ID_OFFSET. Each image still has its own key,
+// which is what the AES-GCM nonce scheme above relies on.
+
+// Smallest ciphertext any supported version can produce: one empty frame.
+inline constexpr std::size_t MIN_STREAM_CIPHERTEXT_BYTES =
+    STREAM_FRAME_LEN_BYTES + std::min<std::size_t>(crypto_secretstream_xchacha20poly1305_ABYTES, PARALLEL_FRAME_ABYTES);
+
 enum class KdfMetadataVersion : Byte {
     none = 0,
     v2_secretstream = 2,
     v3_secretstream_authenticated_mode = 3,
+    v4_parallel_frames = 4,
+    v5_kdf_cost = 5,
+    v6_batch_subkey = 6,
 };
 
-[[nodiscard]] constexpr Byte streamModeByte(bool is_compressed_payload) noexcept {
-    return is_compressed_payload ? STREAM_MODE_ZLIB : STREAM_MODE_RAW;
+[[nodiscard]] constexpr bool hasParallelFrames(KdfMetadataVersion version) noexcept {
+    return version == KdfMetadataVersion::v4_parallel_frames ||
+           version == KdfMetadataVersion::v5_kdf_cost ||
+           version == KdfMetadataVersion::v6_batch_subkey;
+}
+
+[[nodiscard]] constexpr bool hasKdfCost(KdfMetadataVersion version) noexcept {
+    return version == KdfMetadataVersion::v5_kdf_cost || version == KdfMetadataVersion::v6_batch_subkey;
+}
+
+[[nodiscard]] constexpr Byte streamModeByte(PayloadCodec codec) noexcept {
+    switch (codec) {
+        case PayloadCodec::raw:  return STREAM_MODE_RAW;
+        case PayloadCodec::zstd: return STREAM_MODE_ZSTD;
+        case PayloadCodec::zlib: break;
+    }
+    return STREAM_MODE_ZLIB;
 }
 
-[[nodiscard]] std::size_t computeStreamEncryptedSize(std::size_t plaintext_size);
+// Framed ciphertext size of plaintext_size bytes in the format conceal writes.
+[[nodiscard]] std::size_t computeStreamEncryptedSize(std::size_t plaintext_size, std::size_t frame_size);
 
 // Reads pin.value for the KDF; does not wipe `pin` (caller may still need it).
 // Any stack copy of the integer made inside is zeroed before return.
-void deriveKeyFromPin(Key& out_key, const SecurePin& pin, const Salt& salt);
+void deriveKeyFromPin(Key& out_key, const SecurePin& pin, const Salt& salt, const KdfCost& cost);
 [[nodiscard]] KdfMetadataVersion getKdfMetadataVersion(std::span<const Byte> data, std::size_t base_index);
-[[nodiscard]] SecurePin generateRecoveryPin();
 
-void encryptFileWithSecretStreamPrefixed(
-    const fs::path& data_path,
-    std::size_t input_size,
+void encryptParallelFramesPrefixed(
+    const PayloadSource& source,
     std::span<const Byte> prefix_plaintext,
     Byte authenticated_mode,
-    const Key& key,
-    std::array<Byte, crypto_secretstream_xchacha20poly1305_HEADERBYTES>& header,
+    const FrameFormat& frames,
+    PendingKey& key,
+    StreamHeader& header,
+    const EncryptedSizeLimit& limit,
     vBytes& output_vec);
 
-void encryptFileWithSecretStreamPrefixedToFile(
-    const fs::path& data_path,
-    std::size_t input_size,
+// Passes each frame to sink.write as it is sealed: its length field, then its
+// ciphertext, both valid until the sink.end_round that closes the frame's round.
+void encryptParallelFramesPrefixedToSink(
+    const PayloadSource& source,
     std::span<const Byte> prefix_plaintext,
     Byte authenticated_mode,
-    const Key& key,
-    std::array<Byte, crypto_secretstream_xchacha20poly1305_HEADERBYTES>& header,
-    const fs::path& output_path);
+    const FrameFormat& frames,
+    PendingKey& key,
+    StreamHeader& header,
+    const EncryptedSizeLimit& limit,
+    const CipherSink& sink);
 
-[[nodiscard]] bool decryptWithSecretStreamFileInputToFileExtractingFilename(
+[[nodiscard]] bool decryptStreamFileInputToFileExtractingFilename(
     const fs::path& encrypted_input_path,
     const Key& key,
     const std::array<Byte, crypto_secretstream_xchacha20poly1305_HEADERBYTES>& header,
-    KdfMetadataVersion metadata_version,
-    bool is_compressed_payload,
+    const StreamFormat& format,
+    PayloadCodec codec,
     const fs::path& output_path,
     std::size_t& output_size,
     std::string& decrypted_filename);
+
+// What authenticating a stream learned: every frame opened, the prefix parsed,
+// and payload_size bytes of payload (still compressed, for a compressed codec)
+// followed it.
+struct StreamAuthentication {
+    std::string filename{};
+    PayloadLayout layout{};
+    std::size_t payload_size{0};
+};
+
+// Decrypts the ciphertext held in extents of path (see ReadAheadFile) and
+// discards the plaintext; false if any frame fails to open.
+[[nodiscard]] bool authenticateStreamExtents(
+    const fs::path& path,
+    std::vector<FileExtent> extents,
+    const Key& key,
+    const StreamHeader& header,
+    const StreamFormat& format,
+    PayloadCodec codec,
+    StreamAuthentication& result);
+
+// The same, for ciphertext already in memory.
+[[nodiscard]] bool authenticateStreamBuffer(
+    std::span<const Byte> ciphertext,
+    const Key& key,
+    const StreamHeader& header,
+    const StreamFormat& format,
+    PayloadCodec codec,
+    StreamAuthentication& result);
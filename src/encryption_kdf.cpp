@@ -4,10 +4,30 @@
 
 #include <array>
 #include <charconv>
+#include <csignal>
+#include <pthread.h>
 #include <ranges>
 #include <stdexcept>
 
-void deriveKeyFromPin(Key& out_key, const SecurePin& pin, const Salt& salt) {
+static_assert(DEFAULT_KDF_OPSLIMIT == crypto_pwhash_OPSLIMIT_INTERACTIVE);
+static_assert(DEFAULT_KDF_MEMLIMIT == crypto_pwhash_MEMLIMIT_INTERACTIVE);
+static_assert(MIN_KDF_OPSLIMIT >= crypto_pwhash_OPSLIMIT_MIN && MIN_KDF_MEMLIMIT >= crypto_pwhash_MEMLIMIT_MIN);
+static_assert(std::tuple_size_v<Key> == crypto_kdf_KEYBYTES);
+static_assert(std::tuple_size_v<Key> >= crypto_kdf_BYTES_MIN && std::tuple_size_v<Key> <= crypto_kdf_BYTES_MAX);
+
+namespace {
+// crypto_kdf context for batch image keys; fixed, as the subkey id is what
+// tells the images apart.
+constexpr char BATCH_SUBKEY_CONTEXT[crypto_kdf_CONTEXTBYTES + 1] = "jdvrifbk";
+
+void deriveBatchSubkey(Key& out_key, const Key& master, std::uint64_t subkey_id) {
+    if (crypto_kdf_derive_from_key(out_key.data(), out_key.size(), subkey_id, BATCH_SUBKEY_CONTEXT, master.data()) != 0) {
+        throw std::runtime_error("KDF Error: Unable to derive encryption key.");
+    }
+}
+} // namespace
+
+void deriveKeyFromPin(Key& out_key, const SecurePin& pin, const Salt& salt, const KdfCost& cost) {
     throwIfSignalCancellationRequested();
     // Local copy so the caller's SecurePin can outlive the KDF (encrypt still
     // needs the PIN for the user). Wipe this copy on every exit path.
@@ -28,8 +48,8 @@ void deriveKeyFromPin(Key& out_key, const SecurePin& pin, const Salt& salt) {
         pin_buf.data(),
         pin_len,
         salt.data(),
-        crypto_pwhash_OPSLIMIT_INTERACTIVE,
-        crypto_pwhash_MEMLIMIT_INTERACTIVE,
+        static_cast<unsigned long long>(cost.opslimit),
+        cost.memlimit,
         crypto_pwhash_ALG_ARGON2ID13
     );
 
@@ -43,6 +63,84 @@ void deriveKeyFromPin(Key& out_key, const SecurePin& pin, const Salt& salt) {
     }
 }
 
+PendingKey::~PendingKey() {
+    if (worker_.joinable()) worker_.join();
+}
+
+void PendingKey::start(const SecurePin& pin, const Salt& salt, const KdfCost& cost,
+                       std::optional<std::uint64_t> subkey_id) {
+    if (started_) {
+        throw std::logic_error("key derivation: already started");
+    }
+    pin_.value = pin.value;
+    salt_ = salt;
+    cost_ = cost;
+    subkey_id_ = subkey_id;
+    started_ = true;
+    worker_ = std::thread([this] {
+        sigset_t blocked;
+        sigfillset(&blocked);
+        (void)::pthread_sigmask(SIG_BLOCK, &blocked, nullptr);
+        try {
+            if (subkey_id_) {
+                SecureBuffer<Key> master;
+                deriveKeyFromPin(master.buf, pin_, salt_, cost_);
+                deriveBatchSubkey(key_.buf, master.buf, *subkey_id_);
+            } else {
+                deriveKeyFromPin(key_.buf, pin_, salt_, cost_);
+            }
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+        pin_.wipe();
+    });
+}
+
+void PendingKey::startSubkey(PendingKey& master, std::uint64_t subkey_id) {
+    if (started_) {
+        throw std::logic_error("key derivation: already started");
+    }
+    master_ = &master;
+    subkey_id_ = subkey_id;
+    started_ = true;
+}
+
+const Key& PendingKey::get() {
+    if (!started_) {
+        throw std::logic_error("key derivation: not started");
+    }
+    if (worker_.joinable()) worker_.join();
+    if (master_) {
+        deriveBatchSubkey(key_.buf, master_->get(), *subkey_id_);
+        master_ = nullptr;
+    }
+    if (error_) std::rethrow_exception(error_);
+    return key_.buf;
+}
+
+BatchKey::BatchKey(const KdfCost& cost)
+    : pin_(generateRecoveryPin()),
+      cost_(cost) {
+    randombytes_buf(salt_.data(), salt_.size());
+    master_.start(pin_, salt_, cost_);
+}
+
+ImageKey::ImageKey(const SecurePin& pin, const KdfCost& cost)
+    : cost_(cost) {
+    randombytes_buf(salt_.data(), salt_.size());
+    key_.start(pin, salt_, cost_);
+}
+
+ImageKey::ImageKey(BatchKey& batch, std::uint64_t subkey_id)
+    : salt_(batch.salt_),
+      cost_(batch.cost_),
+      subkey_id_(subkey_id) {
+    if (subkey_id > MAX_BATCH_SUBKEY_ID) {
+        throw std::logic_error("key derivation: batch subkey id out of range");
+    }
+    key_.startSubkey(batch.master_, subkey_id);
+}
+
 [[nodiscard]] KdfMetadataVersion getKdfMetadataVersion(std::span<const Byte> data, std::size_t base_index) {
     if (!spanHasRange(data, base_index, KDF_METADATA_REGION_BYTES)) {
         return KdfMetadataVersion::none;
@@ -65,10 +163,19 @@ void deriveKeyFromPin(Key& out_key, const SecurePin& pin, const Salt& salt) {
     if (std::ranges::equal(header, KDF_METADATA_MAGIC_V3)) {
         return KdfMetadataVersion::v3_secretstream_authenticated_mode;
     }
+    if (std::ranges::equal(header, KDF_METADATA_MAGIC_V4)) {
+        return KdfMetadataVersion::v4_parallel_frames;
+    }
+    if (std::ranges::equal(header, KDF_METADATA_MAGIC_V5)) {
+        return KdfMetadataVersion::v5_kdf_cost;
+    }
+    if (std::ranges::equal(header, KDF_METADATA_MAGIC_V6)) {
+        return KdfMetadataVersion::v6_batch_subkey;
+    }
     return KdfMetadataVersion::none;
 }
 
-[[nodiscard]] SecurePin generateRecoveryPin() {
+SecurePin generateRecoveryPin() {
     SecurePin pin;
     while (pin.value == 0) {
         randombytes_buf(&pin.value, sizeof(pin.value));
@@ -1,14 +1,16 @@
 #include "encryption_internal.h"
 #include "encryption_stream_shared.h"
 #include "file_utils.h"
+#include "parallel_utils.h"
+#include "read_ahead.h"
 #include "signal_utils.h"
 
 #include <algorithm>
 #include <array>
+#include <bit>
+#include <cstdint>
 #include <cstring>
-#include <fstream>
 #include <limits>
-#include <memory>
 #include <span>
 #include <stdexcept>
 
@@ -26,71 +28,58 @@ namespace {
     };
 }
 
-[[nodiscard]] std::size_t checkedCipherChunkSize(std::size_t plain_size) {
-    constexpr std::size_t STREAM_ABYTES = crypto_secretstream_xchacha20poly1305_ABYTES;
-    const std::size_t cipher_size = plain_size + STREAM_ABYTES;
-    if (cipher_size > static_cast<std::size_t>(std::numeric_limits<uint32_t>::max())) {
-        throw std::runtime_error("File Size Error: Stream chunk exceeds size limit.");
-    }
-    return cipher_size;
-}
-
-template<typename EmitFrameFn>
-void pushSecretStreamFrame(
-    crypto_secretstream_xchacha20poly1305_state& state,
-    std::span<const Byte> plain_chunk,
-    std::span<const Byte> associated_data,
-    bool is_final,
-    CipherChunk& cipher_chunk,
-    EmitFrameFn&& emit_frame) {
-
-    const std::size_t cipher_size = checkedCipherChunkSize(plain_chunk.size());
-    unsigned long long written = 0;
-    const unsigned char tag = is_final ? crypto_secretstream_xchacha20poly1305_TAG_FINAL : 0;
-
-    if (crypto_secretstream_xchacha20poly1305_push(
-            &state,
-            cipher_chunk.data(),
-            &written,
-            plain_chunk.data(),
-            static_cast<unsigned long long>(plain_chunk.size()),
-            associated_data.data(),
-            static_cast<unsigned long long>(associated_data.size()),
-            tag) != 0) {
-        throw std::runtime_error("crypto_secretstream push failed");
-    }
-    if (written != cipher_size) {
-        throw std::runtime_error("crypto_secretstream push produced unexpected size");
-    }
-
-    emit_frame(std::span<const Byte>(cipher_chunk.data(), cipher_size));
-}
-
-template<typename SourceFn, typename EmitFrameFn>
-void encryptSecretStreamFrames(
-    const Key& key,
+// Collects plaintext chunks into rounds, seals each round's frames on the
+// pool, then emits them in order and calls end_round, after which their
+// buffers are reused. Only the sealing is parallel: the source (usually the
+// compressor) and emit_frame still run on this thread. The key is first
+// needed to seal the first round, so the source fills that round while the
+// KDF is still running.
+template<typename SourceFn, typename EmitFrameFn, typename EndRoundFn>
+void encryptParallelFrames(
+    PendingKey& pending_key,
     StreamHeader& header,
-    std::span<const Byte> associated_data,
+    Byte authenticated_mode,
+    const FrameFormat& frames,
     SourceFn&& source,
-    EmitFrameFn&& emit_frame) {
-
-    SecretStreamStateGuard stream_state;
-    if (crypto_secretstream_xchacha20poly1305_init_push(&stream_state.state, header.data(), key.data()) != 0) {
-        throw std::runtime_error("crypto_secretstream init_push failed");
-    }
-
-    auto cipher_chunk = std::make_unique<CipherChunk>();
-    ZeroGuard<CipherChunk> cipher_chunk_guard{cipher_chunk.get()};
+    EmitFrameFn&& emit_frame,
+    EndRoundFn&& end_round) {
+
+    randombytes_buf(header.data(), header.size());
+
+    const std::size_t threads = resolveWorkerThreads(frames.threads);
+    const std::size_t round_frames = parallelRoundFrames(threads, frames.frame_size);
+    WorkerPool pool(std::min(threads, round_frames));
+    std::array<ParallelFrameSlot, PARALLEL_FRAMES_PER_ROUND> slots{};
+    std::size_t filled = 0;
+    uint64_t next_index = 0;
+
+    auto seal_round = [&] {
+        const Key& key = pending_key.get();
+        const uint64_t base_index = next_index;
+        pool.run(filled, [&](std::size_t i) {
+            throwIfSignalCancellationRequested();
+            sealParallelFrame(key, header, frames.cipher, authenticated_mode, base_index + i, slots[i]);
+        });
+        for (std::size_t i = 0; i < filled; ++i) {
+            ParallelFrameSlot& slot = slots[i];
+            emit_frame(std::span<const Byte>(slot.cipher.data(), slot.cipher_size));
+            sodium_memzero(slot.plain.data(), slot.plain_size);
+        }
+        end_round();
+        next_index += filled;
+        filled = 0;
+    };
 
     source([&](std::span<const Byte> plain_chunk, bool is_final) {
         throwIfSignalCancellationRequested();
-        pushSecretStreamFrame(
-            stream_state.state,
-            plain_chunk,
-            associated_data,
-            is_final,
-            *cipher_chunk,
-            emit_frame);
+        ParallelFrameSlot& slot = slots[filled++];
+        slot.allocate(frames.frame_size);
+        std::memcpy(slot.plain.data(), plain_chunk.data(), plain_chunk.size());
+        slot.plain_size = plain_chunk.size();
+        slot.is_final = is_final;
+        if (filled == round_frames || is_final) {
+            seal_round();
+        }
     });
 }
 
@@ -108,114 +97,136 @@ void appendFramedCipherBytes(vBytes& output_vec, std::span<const Byte> cipher_fr
     std::memcpy(out + frame_len.size(), cipher_frame.data(), cipher_frame.size());
 }
 
-void writeFramedCipherBytes(std::ostream& output, std::span<const Byte> cipher_frame) {
-    const auto frame_len = encodeFrameLength(cipher_frame.size());
-    writeBytesOrThrow(output, frame_len, WRITE_COMPLETE_ERROR);
-    writeBytesOrThrow(output, cipher_frame, WRITE_COMPLETE_ERROR);
-}
-
+// Cuts the filename prefix followed by everything `source` produces into
+// chunk_size plaintext chunks. The source's total size is not known up
+// front (compressed output), so a full chunk is held back until more data
+// arrives: only then is it certain not to be the final one. The resulting
+// frame boundaries match a file of the same size read chunk by chunk.
 template<typename ChunkFn>
-void forEachPrefixedPlainChunkFromFile(
-    const fs::path& data_path,
-    std::size_t input_size,
-    std::span<const Byte> prefix_plaintext,
-    ChunkFn&& chunk_fn);
-
-template<typename EmitFrameFn>
-void encryptFileWithSecretStreamPrefixedImpl(
-    const fs::path& data_path,
-    std::size_t input_size,
-    std::span<const Byte> prefix_plaintext,
-    Byte authenticated_mode,
-    const Key& key,
-    StreamHeader& header,
-    EmitFrameFn&& emit_frame) {
-    const std::array<Byte, 1> associated_data{authenticated_mode};
-    encryptSecretStreamFrames(
-        key,
-        header,
-        associated_data,
-        [&](auto&& emit_plain_chunk) { forEachPrefixedPlainChunkFromFile(data_path, input_size, prefix_plaintext, emit_plain_chunk); },
-        emit_frame);
-}
-
-template<typename ChunkFn>
-void forEachPrefixedPlainChunkFromFile(
-    const fs::path& data_path,
-    std::size_t input_size,
+void forEachPrefixedPlainChunk(
+    const PayloadSource& source,
     std::span<const Byte> prefix_plaintext,
+    std::size_t chunk_size,
     ChunkFn&& chunk_fn) {
 
-    if (input_size == 0) {
-        throw std::runtime_error("Data File Error: File is empty.");
-    }
-    (void)checkedAdd(input_size, prefix_plaintext.size(), "File Size Error: Encrypted output overflow.");
-
-    std::ifstream input = openBinaryInputOrThrow(data_path, "Read Error: Failed to open file for encryption.");
+    vBytes in_chunk(chunk_size);
+    ZeroGuard<vBytes> in_chunk_guard{&in_chunk};
 
-    auto in_chunk_ptr = std::make_unique<std::array<Byte, STREAM_CHUNK_SIZE>>();
-    auto& in_chunk = *in_chunk_ptr;
-    ZeroGuard<std::array<Byte, STREAM_CHUNK_SIZE>> in_chunk_guard{&in_chunk};
+    std::size_t filled = 0;
+    std::size_t payload_size = 0;
 
-    std::size_t prefix_offset = 0;
-    std::size_t input_left = input_size;
+    auto append = [&](std::span<const Byte> bytes) {
+        while (!bytes.empty()) {
+            if (filled == in_chunk.size()) {
+                chunk_fn(std::span<const Byte>(in_chunk.data(), filled), false);
+                sodium_memzero(in_chunk.data(), filled);
+                filled = 0;
+            }
+            const std::size_t take = std::min(bytes.size(), in_chunk.size() - filled);
+            std::memcpy(in_chunk.data() + static_cast<std::ptrdiff_t>(filled), bytes.data(), take);
+            filled += take;
+            bytes = bytes.subspan(take);
+        }
+    };
 
-    while (prefix_offset < prefix_plaintext.size() || input_left > 0) {
+    append(prefix_plaintext);
+    source([&](std::span<const Byte> payload) {
         throwIfSignalCancellationRequested();
-        std::size_t filled = 0;
-
-        if (prefix_offset < prefix_plaintext.size()) {
-            const std::size_t prefix_bytes = std::min(
-                STREAM_CHUNK_SIZE,
-                prefix_plaintext.size() - prefix_offset);
-            std::memcpy(
-                in_chunk.data(),
-                prefix_plaintext.data() + static_cast<std::ptrdiff_t>(prefix_offset),
-                prefix_bytes);
-            prefix_offset += prefix_bytes;
-            filled = prefix_bytes;
-        }
+        payload_size = checkedAdd(payload_size, payload.size(), "File Size Error: Encrypted output overflow.");
+        append(payload);
+    });
 
-        if (filled < STREAM_CHUNK_SIZE && input_left > 0) {
-            const std::size_t file_bytes = std::min(STREAM_CHUNK_SIZE - filled, input_left);
-            const std::streamsize read_count = readSomeOrThrow(
-                input,
-                in_chunk.data() + static_cast<std::ptrdiff_t>(filled),
-                file_bytes,
-                "Read Error: Failed while reading input file.");
-            if (read_count != static_cast<std::streamsize>(file_bytes)) {
-                throw std::runtime_error("Read Error: Failed to read full input while encrypting.");
+    if (payload_size == 0) {
+        throw std::runtime_error("Data File Error: File is empty.");
+    }
+    chunk_fn(std::span<const Byte>(in_chunk.data(), filled), true);
+    sodium_memzero(in_chunk.data(), filled);
+    throwIfSignalCancellationRequested();
+}
+
+template<typename EmitFrameFn, typename EndRoundFn>
+void encryptParallelFramesPrefixedImpl(
+    const PayloadSource& source,
+    std::span<const Byte> prefix_plaintext,
+    Byte authenticated_mode,
+    const FrameFormat& frames,
+    PendingKey& key,
+    StreamHeader& header,
+    const EncryptedSizeLimit& limit,
+    EmitFrameFn&& emit_frame,
+    EndRoundFn&& end_round) {
+    if (frames.frame_size < MIN_STREAM_FRAME_SIZE || frames.frame_size > MAX_STREAM_FRAME_SIZE ||
+        !std::has_single_bit(frames.frame_size)) {
+        throw std::logic_error("encryption: unsupported frame size");
+    }
+    std::size_t encrypted_size = 0;
+    encryptParallelFrames(
+        key,
+        header,
+        authenticated_mode,
+        frames,
+        [&](auto&& emit_plain_chunk) {
+            forEachPrefixedPlainChunk(source, prefix_plaintext, frames.frame_size, emit_plain_chunk);
+        },
+        [&](std::span<const Byte> cipher_frame) {
+            // Enforced per frame so an over-limit payload fails as soon as it
+            // crosses the limit, not after the whole input has been processed.
+            const std::size_t framed_size = STREAM_FRAME_LEN_BYTES + cipher_frame.size();
+            if (framed_size > limit.max_bytes || encrypted_size > limit.max_bytes - framed_size) {
+                throw std::runtime_error(limit.error_message);
             }
+            encrypted_size += framed_size;
+            emit_frame(cipher_frame);
+        },
+        end_round);
+}
+} // namespace
 
-            filled += file_bytes;
-            input_left -= file_bytes;
-        }
+void sealParallelFrame(
+    const Key& key,
+    const StreamHeader& header,
+    CipherSuite cipher,
+    Byte authenticated_mode,
+    uint64_t frame_index,
+    ParallelFrameSlot& slot) {
 
-        if (filled == 0) {
-            throw std::runtime_error("Internal Error: Plaintext size accounting mismatch.");
-        }
+    const ParallelFrameCipher aead = parallelFrameCipher(cipher);
+    const ParallelFrameNonce nonce = parallelFrameNonce(header, frame_index, aead.nonce_bytes);
+    const ParallelFrameAd associated_data = parallelFrameAd(authenticated_mode, frame_index, slot.is_final);
+    unsigned long long written = 0;
 
-        const bool is_final = (prefix_offset == prefix_plaintext.size() && input_left == 0);
-        chunk_fn(std::span<const Byte>(in_chunk.data(), filled), is_final);
-        sodium_memzero(in_chunk.data(), filled);
+    if (aead.encrypt(
+            slot.cipher.data(),
+            &written,
+            slot.plain.data(),
+            static_cast<unsigned long long>(slot.plain_size),
+            associated_data.data(),
+            static_cast<unsigned long long>(associated_data.size()),
+            nullptr,
+            nonce.data(),
+            key.data()) != 0) {
+        throw std::runtime_error("AEAD frame encryption failed");
     }
-
-    if (prefix_offset != prefix_plaintext.size() || input_left != 0) {
-        throw std::runtime_error("Internal Error: Plaintext size accounting mismatch.");
+    if (written != slot.plain_size + PARALLEL_FRAME_ABYTES) {
+        throw std::runtime_error("AEAD frame encryption produced unexpected size");
     }
+    slot.cipher_size = static_cast<std::size_t>(written);
+}
 
-    requireNoTrailingDataOrThrow(input, "Read Error: Input file changed while encrypting.");
-    throwIfSignalCancellationRequested();
+bool isCipherSuiteAvailable(CipherSuite cipher) noexcept {
+    return cipher != CipherSuite::aes256gcm || crypto_aead_aes256gcm_is_available() == 1;
 }
-} // namespace
 
-[[nodiscard]] std::size_t computeStreamEncryptedSize(std::size_t plaintext_size) {
-    constexpr std::size_t STREAM_ABYTES = crypto_secretstream_xchacha20poly1305_ABYTES;
+std::string_view cipherSuiteName(CipherSuite cipher) noexcept {
+    return cipher == CipherSuite::aes256gcm ? "AES-256-GCM" : "XChaCha20-Poly1305";
+}
+
+[[nodiscard]] std::size_t computeStreamEncryptedSize(std::size_t plaintext_size, std::size_t frame_size) {
     if (plaintext_size == 0) {
         return 0;
     }
-    const std::size_t chunk_count = 1 + ((plaintext_size - 1) / STREAM_CHUNK_SIZE);
-    const std::size_t per_chunk_overhead = STREAM_ABYTES + STREAM_FRAME_LEN_BYTES;
+    const std::size_t chunk_count = 1 + ((plaintext_size - 1) / frame_size);
+    const std::size_t per_chunk_overhead = PARALLEL_FRAME_ABYTES + STREAM_FRAME_LEN_BYTES;
 
     if (chunk_count > (std::numeric_limits<std::size_t>::max() - plaintext_size) / per_chunk_overhead) {
         throw std::runtime_error("File Size Error: Encrypted output overflow.");
@@ -225,60 +236,100 @@ void forEachPrefixedPlainChunkFromFile(
 
 [[nodiscard]] std::size_t computeStreamEncryptedSizePrefixed(
     std::size_t input_plaintext_size,
-    std::size_t prefix_plaintext_size) {
+    std::size_t prefix_plaintext_size,
+    std::size_t frame_size) {
     if (prefix_plaintext_size > std::numeric_limits<std::size_t>::max() - input_plaintext_size) {
         throw std::runtime_error("File Size Error: Encrypted output overflow.");
     }
-    return computeStreamEncryptedSize(input_plaintext_size + prefix_plaintext_size);
+    return computeStreamEncryptedSize(input_plaintext_size + prefix_plaintext_size, frame_size);
 }
 
-void encryptFileWithSecretStreamPrefixed(
-    const fs::path& data_path,
-    std::size_t input_size,
+// The file is read on a ReadAheadFile thread, so the next block is already
+// in memory while the current one is compressed or sealed.
+PayloadSource payloadSourceFromFile(const fs::path& data_path, std::size_t input_size) {
+    return [data_path, input_size](const ByteSink& sink) {
+        if (input_size == 0) {
+            throw std::runtime_error("Data File Error: File is empty.");
+        }
+        ReadAheadFile input(
+            data_path,
+            "Read Error: Failed to open file for encryption.",
+            "Read Error: Failed while reading input file.");
+
+        std::size_t input_left = input_size;
+        while (input_left > 0) {
+            throwIfSignalCancellationRequested();
+            const std::span<const Byte> block = input.next();
+            if (block.empty()) {
+                throw std::runtime_error("Read Error: Failed to read full input while encrypting.");
+            }
+            if (block.size() > input_left) {
+                throw std::runtime_error("Read Error: Input file changed while encrypting.");
+            }
+            input_left -= block.size();
+            sink(block);
+        }
+
+        if (!input.atEnd()) {
+            throw std::runtime_error("Read Error: Input file changed while encrypting.");
+        }
+    };
+}
+
+void encryptParallelFramesPrefixed(
+    const PayloadSource& source,
     std::span<const Byte> prefix_plaintext,
     Byte authenticated_mode,
-    const Key& key,
-    std::array<Byte, crypto_secretstream_xchacha20poly1305_HEADERBYTES>& header,
+    const FrameFormat& frames,
+    PendingKey& key,
+    StreamHeader& header,
+    const EncryptedSizeLimit& limit,
     vBytes& output_vec) {
 
-    const std::size_t total_plain_size = checkedAdd(
-        input_size,
-        prefix_plaintext.size(),
-        "File Size Error: Encrypted output overflow.");
-
     output_vec.clear();
-    output_vec.reserve(computeStreamEncryptedSize(total_plain_size));
-    encryptFileWithSecretStreamPrefixedImpl(
-        data_path,
-        input_size,
+    encryptParallelFramesPrefixedImpl(
+        source,
         prefix_plaintext,
         authenticated_mode,
+        frames,
         key,
         header,
+        limit,
         [&](std::span<const Byte> cipher_frame) {
             appendFramedCipherBytes(output_vec, cipher_frame);
-        });
+        },
+        [] {});
 }
 
-void encryptFileWithSecretStreamPrefixedToFile(
-    const fs::path& data_path,
-    std::size_t input_size,
+void encryptParallelFramesPrefixedToSink(
+    const PayloadSource& source,
     std::span<const Byte> prefix_plaintext,
     Byte authenticated_mode,
-    const Key& key,
-    std::array<Byte, crypto_secretstream_xchacha20poly1305_HEADERBYTES>& header,
-    const fs::path& output_path) {
-
-    std::ofstream output = openBinaryOutputForWriteOrThrow(output_path);
-    encryptFileWithSecretStreamPrefixedImpl(
-        data_path,
-        input_size,
+    const FrameFormat& frames,
+    PendingKey& key,
+    StreamHeader& header,
+    const EncryptedSizeLimit& limit,
+    const CipherSink& sink) {
+
+    // Length fields must outlive their round too; one per frame slot.
+    std::array<std::array<Byte, STREAM_FRAME_LEN_BYTES>, PARALLEL_FRAMES_PER_ROUND> frame_lens{};
+    std::size_t frames_in_round = 0;
+    encryptParallelFramesPrefixedImpl(
+        source,
         prefix_plaintext,
         authenticated_mode,
+        frames,
         key,
         header,
+        limit,
         [&](std::span<const Byte> cipher_frame) {
-            writeFramedCipherBytes(output, cipher_frame);
+            std::array<Byte, STREAM_FRAME_LEN_BYTES>& frame_len = frame_lens[frames_in_round++];
+            frame_len = encodeFrameLength(cipher_frame.size());
+            sink.write(frame_len);
+            sink.write(cipher_frame);
+        },
+        [&] {
+            sink.end_round();
+            frames_in_round = 0;
         });
-    closeOutputOrThrow(output, WRITE_COMPLETE_ERROR);
 }
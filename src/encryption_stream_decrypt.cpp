@@ -1,23 +1,52 @@
 #include "encryption_stream_shared.h"
+#include "compression.h"
 #include "file_utils.h"
+#include "parallel_utils.h"
+#include "payload_prefix.h"
+#include "read_ahead.h"
 #include "signal_utils.h"
 
+#include <libdeflate.h>
 #include <zlib.h>
+#include <zstd.h>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <cstring>
 #include <format>
 #include <fstream>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <span>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <utility>
+#include <variant>
+#include <vector>
 
 namespace {
-constexpr std::size_t STREAM_INFLATE_OUT_CHUNK_SIZE = 2 * 1024 * 1024;
-constexpr std::size_t STREAM_INFLATE_MAX_OUTPUT = 3ULL * 1024 * 1024 * 1024;
+constexpr std::size_t STREAM_DECODE_OUT_CHUNK_SIZE = 2 * 1024 * 1024;
+constexpr std::size_t STREAM_DECODE_MAX_OUTPUT = 3ULL * 1024 * 1024 * 1024;
+
+// zlib payloads whose ciphertext is at most WHOLE_BUFFER_INPUT_LIMIT are
+// decompressed in one libdeflate call (see WholeBufferInflateToFile), as long
+// as the output fits in WHOLE_BUFFER_EXPANSION times the input, capped at
+// WHOLE_BUFFER_OUTPUT_LIMIT. Together they bound the extra RSS of the fast
+// path; anything larger streams through zlib.
+constexpr std::size_t
+    WHOLE_BUFFER_INPUT_LIMIT  = 64  * 1024 * 1024,
+    WHOLE_BUFFER_OUTPUT_LIMIT = 256 * 1024 * 1024,
+    WHOLE_BUFFER_MIN_OUTPUT   = 1   * 1024 * 1024,
+    WHOLE_BUFFER_EXPANSION    = 8;
+
+// Largest zstd window accepted on recover. Conceal's long-distance matching
+// uses a 128 MiB (2^27) window; refusing more bounds decoder memory for a
+// crafted frame header.
+constexpr int ZSTD_MAX_WINDOW_LOG = 27;
 constexpr const char* CORRUPT_FILENAME_ERROR = "File Extraction Error: Corrupt encrypted filename metadata.";
 
 [[nodiscard]] uint32_t decodeFrameLength(std::span<const Byte, STREAM_FRAME_LEN_BYTES> frame_len_bytes) {
@@ -68,23 +97,33 @@ template<typename ConsumeFn>
     return true;
 }
 
-template<typename ConsumeFn>
-[[nodiscard]] bool decryptWithSecretStreamFileInputChunks(
-    const fs::path& encrypted_input_path,
+// Ciphertext already in memory, read the way the loops below read a
+// ReadAheadFile.
+class SpanInput {
+public:
+    explicit SpanInput(std::span<const Byte> bytes) : rest_(bytes) {}
+
+    [[nodiscard]] bool readExact(Byte* dst, std::size_t size) {
+        if (size > rest_.size()) return false;
+        std::copy_n(rest_.data(), size, dst);
+        rest_ = rest_.subspan(size);
+        return true;
+    }
+
+    [[nodiscard]] bool atEnd() const noexcept { return rest_.empty(); }
+
+private:
+    std::span<const Byte> rest_;
+};
+
+template<typename Input, typename ConsumeFn>
+[[nodiscard]] bool decryptWithSecretStreamInputChunks(
+    Input& input,
     const Key& key,
     const StreamHeader& header,
     std::span<const Byte> associated_data,
     ConsumeFn&& consume) {
 
-    std::ifstream input = openBinaryInputOrThrow(
-        encrypted_input_path,
-        "Read Error: Failed to open encrypted stream input.");
-
-    (void)checkedFileSize(
-        encrypted_input_path,
-        "Read Error: Invalid encrypted stream input size.",
-        true);
-
     SecretStreamStateGuard stream_state;
     if (crypto_secretstream_xchacha20poly1305_init_pull(&stream_state.state, header.data(), key.data()) != 0) {
         return false;
@@ -99,12 +138,12 @@ template<typename ConsumeFn>
     while (true) {
         throwIfSignalCancellationRequested();
         std::array<Byte, STREAM_FRAME_LEN_BYTES> frame_len_bytes{};
-        if (!tryReadExact(input, frame_len_bytes.data(), frame_len_bytes.size())) {
+        if (!input.readExact(frame_len_bytes.data(), frame_len_bytes.size())) {
             return false;
         }
 
         const uint32_t frame_len = decodeFrameLength(frame_len_bytes);
-        if (frame_len > cipher_chunk->size() || !tryReadExact(input, cipher_chunk->data(), frame_len)) {
+        if (frame_len > cipher_chunk->size() || !input.readExact(cipher_chunk->data(), frame_len)) {
             return false;
         }
         if (!pullSecretStreamFrame(
@@ -122,18 +161,167 @@ template<typename ConsumeFn>
         }
     }
 
-    try {
-        requireNoTrailingDataOrThrow(input, "Read Error: Invalid encrypted stream input size.");
-    } catch (const std::exception&) {
+    return input.atEnd();
+}
+
+[[nodiscard]] bool openParallelFrame(
+    const Key& key,
+    const StreamHeader& header,
+    const ParallelFrameCipher& aead,
+    Byte authenticated_mode,
+    uint64_t frame_index,
+    ParallelFrameSlot& slot) {
+
+    const ParallelFrameNonce nonce = parallelFrameNonce(header, frame_index, aead.nonce_bytes);
+    const ParallelFrameAd associated_data = parallelFrameAd(authenticated_mode, frame_index, slot.is_final);
+    unsigned long long plain_size = 0;
+
+    if (aead.decrypt(
+            slot.plain.data(),
+            &plain_size,
+            nullptr,
+            slot.cipher.data(),
+            static_cast<unsigned long long>(slot.cipher_size),
+            associated_data.data(),
+            static_cast<unsigned long long>(associated_data.size()),
+            nonce.data(),
+            key.data()) != 0) {
         return false;
     }
+    if (plain_size != slot.cipher_size - PARALLEL_FRAME_ABYTES) {
+        return false;
+    }
+    slot.plain_size = static_cast<std::size_t>(plain_size);
     return true;
 }
 
+// V4: reads a round of frames, opens them on the pool, then passes their
+// plaintext to consume in order. A frame is opened as final exactly when it
+// ends at input_size, which is what makes truncation at a frame
+// boundary (or appended frames) fail authentication.
+template<typename Input, typename ConsumeFn>
+[[nodiscard]] bool decryptParallelFramesInputChunks(
+    Input& input,
+    std::size_t input_size,
+    const Key& key,
+    const StreamHeader& header,
+    const FrameFormat& frames,
+    Byte authenticated_mode,
+    ConsumeFn&& consume) {
+
+    const ParallelFrameCipher aead = parallelFrameCipher(frames.cipher);
+    const std::size_t threads = resolveWorkerThreads(frames.threads);
+    const std::size_t round_frames = parallelRoundFrames(threads, frames.frame_size);
+    WorkerPool pool(std::min(threads, round_frames));
+    std::array<ParallelFrameSlot, PARALLEL_FRAMES_PER_ROUND> slots{};
+
+    std::size_t offset = 0;
+    uint64_t next_index = 0;
+    while (offset < input_size) {
+        std::size_t filled = 0;
+        while (filled < round_frames && offset < input_size) {
+            throwIfSignalCancellationRequested();
+            std::array<Byte, STREAM_FRAME_LEN_BYTES> frame_len_bytes{};
+            if (!input.readExact(frame_len_bytes.data(), frame_len_bytes.size())) {
+                return false;
+            }
+
+            const uint32_t frame_len = decodeFrameLength(frame_len_bytes);
+            if (frame_len < PARALLEL_FRAME_ABYTES || frame_len > frames.frame_size + PARALLEL_FRAME_ABYTES) {
+                return false;
+            }
+            ParallelFrameSlot& slot = slots[filled];
+            slot.allocate(frames.frame_size);
+            if (!input.readExact(slot.cipher.data(), frame_len)) {
+                return false;
+            }
+            offset += STREAM_FRAME_LEN_BYTES + frame_len;
+            slot.cipher_size = frame_len;
+            slot.is_final = offset >= input_size;
+            // Only the last frame may be short.
+            if (!slot.is_final && frame_len != frames.frame_size + PARALLEL_FRAME_ABYTES) {
+                return false;
+            }
+            ++filled;
+        }
+
+        std::atomic<bool> opened{true};
+        pool.run(filled, [&](std::size_t i) {
+            throwIfSignalCancellationRequested();
+            if (!openParallelFrame(key, header, aead, authenticated_mode, next_index + i, slots[i])) {
+                opened.store(false, std::memory_order_relaxed);
+            }
+        });
+        if (!opened.load(std::memory_order_relaxed)) {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < filled; ++i) {
+            ParallelFrameSlot& slot = slots[i];
+            if (slot.plain_size > 0) {
+                consume(std::span<const Byte>(slot.plain.data(), slot.plain_size));
+            }
+            sodium_memzero(slot.plain.data(), slot.plain_size);
+        }
+        next_index += filled;
+    }
+    if (next_index == 0) {
+        return false;
+    }
+
+    return input.atEnd();
+}
+
+// Where the ofstream-based decoders write: passes bytes straight through, or
+// with a payload filter collects them into PAYLOAD_FILTER_BLOCK_SIZE blocks
+// and reverses the filter on each before it is written.
+class DecodedOutput {
+public:
+    DecodedOutput(const fs::path& output_path, const PayloadFilter& filter)
+        : output_(openBinaryOutputForWriteOrThrow(output_path)),
+          filter_(filter) {
+        if (filter_.active()) block_.reserve(PAYLOAD_FILTER_BLOCK_SIZE);
+    }
+
+    void write(std::span<const Byte> bytes) {
+        if (!filter_.active()) {
+            writeBytesOrThrow(output_, bytes, WRITE_COMPLETE_ERROR);
+            return;
+        }
+        while (!bytes.empty()) {
+            const std::size_t take = std::min(PAYLOAD_FILTER_BLOCK_SIZE - block_.size(), bytes.size());
+            block_.insert(block_.end(), bytes.begin(), bytes.begin() + static_cast<std::ptrdiff_t>(take));
+            bytes = bytes.subspan(take);
+            if (block_.size() == PAYLOAD_FILTER_BLOCK_SIZE) writeBlock();
+        }
+    }
+
+    void close() {
+        if (!block_.empty()) writeBlock();
+        closeOutputOrThrow(output_, WRITE_COMPLETE_ERROR);
+    }
+
+private:
+    void writeBlock() {
+        reversePayloadFilter(filter_, block_, block_offset_);
+        writeBytesOrThrow(output_, block_, WRITE_COMPLETE_ERROR);
+        block_offset_ += block_.size();
+        block_.clear();
+    }
+
+    std::ofstream output_{};
+    PayloadFilter filter_{};
+    vBytes block_{};
+    std::size_t block_offset_{0};
+};
+
 class StreamInflateToFile {
 public:
-    explicit StreamInflateToFile(const fs::path& output_path)
-        : output_(openBinaryOutputForWriteOrThrow(output_path)) {
+    StreamInflateToFile(const fs::path& output_path, const PayloadFilter& filter)
+        : StreamInflateToFile(DecodedOutput(output_path, filter)) {}
+
+    explicit StreamInflateToFile(DecodedOutput output)
+        : output_(std::move(output)) {
         if (inflateInit(&stream_) != Z_OK) {
             throw std::runtime_error("zlib: inflateInit failed");
         }
@@ -168,6 +356,10 @@ public:
             const int ret = inflate(&stream_, Z_NO_FLUSH);
             writeProduced(out_chunk_.size() - stream_.avail_out);
 
+            if (ret == Z_NEED_DICT) {
+                setPresetDictionary();
+                continue;
+            }
             if (ret == Z_STREAM_END) {
                 finished_ = true;
                 if (stream_.avail_in != 0) {
@@ -217,7 +409,7 @@ public:
             }
         }
 
-        closeOutputOrThrow(output_, WRITE_COMPLETE_ERROR);
+        output_.close();
         if (output_size_ == 0) {
             throw std::runtime_error("Zlib Compression Error: Output file is empty. Inflating file failed.");
         }
@@ -225,185 +417,611 @@ public:
     }
 
 private:
+    // inflate() stops with Z_NEED_DICT after the header of a stream compressed
+    // against a preset dictionary, leaving its DICTID in stream_.adler.
+    void setPresetDictionary() {
+        const std::span<const Byte> dictionary = presetDeflateDictionary(static_cast<uint32_t>(stream_.adler));
+        if (dictionary.empty() ||
+            inflateSetDictionary(&stream_, dictionary.data(), static_cast<uInt>(dictionary.size())) != Z_OK) {
+            throw std::runtime_error("zlib inflate error: unknown preset dictionary");
+        }
+    }
+
     void writeProduced(std::size_t produced) {
         if (produced == 0) return;
-        if (produced > STREAM_INFLATE_MAX_OUTPUT || output_size_ > STREAM_INFLATE_MAX_OUTPUT - produced) {
+        if (produced > STREAM_DECODE_MAX_OUTPUT || output_size_ > STREAM_DECODE_MAX_OUTPUT - produced) {
             throw std::runtime_error("zlib inflate error: output exceeds safe size limit");
         }
-        writeBytesOrThrow(
-            output_,
-            std::span<const Byte>(out_chunk_.data(), produced),
-            WRITE_COMPLETE_ERROR);
+        output_.write(std::span<const Byte>(out_chunk_.data(), produced));
         output_size_ += produced;
     }
 
     z_stream stream_{};
     bool initialized_{false};
     bool finished_{false};
-    std::ofstream output_{};
-    vBytes out_chunk_ = vBytes(STREAM_INFLATE_OUT_CHUNK_SIZE);
+    DecodedOutput output_;
+    vBytes out_chunk_ = vBytes(STREAM_DECODE_OUT_CHUNK_SIZE);
     std::size_t output_size_{0};
 };
 
-class FilenamePrefixExtractor {
+// Fast path for zlib payloads of bounded size: the decrypted stream is
+// collected whole and decompressed by one libdeflate_zlib_decompress_ex call,
+// roughly 2-3x faster than zlib's inflate. libdeflate needs the output size up
+// front, which a zlib stream does not record, so there is one attempt with a
+// buffer of WHOLE_BUFFER_EXPANSION times the input; retrying larger would
+// decode the stream again from the start. Streams libdeflate cannot take (a
+// preset dictionary), output that does not fit and any decode failure are
+// replayed through StreamInflateToFile, which gives the same result and the
+// same errors. Both buffers hold plaintext and are wiped before release.
+class WholeBufferInflateToFile {
 public:
-    FilenamePrefixExtractor() = default;
-    FilenamePrefixExtractor(const FilenamePrefixExtractor&) = delete;
-    FilenamePrefixExtractor& operator=(const FilenamePrefixExtractor&) = delete;
+    WholeBufferInflateToFile(const fs::path& output_path, const PayloadFilter& filter, std::size_t encrypted_size)
+        : output_(output_path, filter) {
+        // Reserved up front so appending never reallocates (and leaves a copy unwiped).
+        compressed_.reserve(encrypted_size);
+    }
+
+    ~WholeBufferInflateToFile() {
+        sodium_memzero(compressed_.data(), compressed_.size());
+    }
+
+    WholeBufferInflateToFile(const WholeBufferInflateToFile&) = delete;
+    WholeBufferInflateToFile& operator=(const WholeBufferInflateToFile&) = delete;
+
+    void consume(std::span<const Byte> compressed_chunk) {
+        throwIfSignalCancellationRequested();
+        if (fallback_) {
+            fallback_->consume(compressed_chunk);
+            return;
+        }
+        if (compressed_chunk.size() > WHOLE_BUFFER_INPUT_LIMIT - compressed_.size()) {
+            startFallback();
+            fallback_->consume(compressed_chunk);
+            return;
+        }
+        compressed_.insert(compressed_.end(), compressed_chunk.begin(), compressed_chunk.end());
+    }
+
+    [[nodiscard]] std::size_t finish() {
+        if (!fallback_) {
+            if (const std::optional<std::size_t> size = tryWholeBufferInflate()) {
+                return *size;
+            }
+            startFallback();
+        }
+        return fallback_->finish();
+    }
+
+private:
+    struct DecompressorGuard {
+        libdeflate_decompressor* d{libdeflate_alloc_decompressor()};
+        DecompressorGuard() = default;
+        ~DecompressorGuard() { if (d) libdeflate_free_decompressor(d); }
+        DecompressorGuard(const DecompressorGuard&) = delete;
+        DecompressorGuard& operator=(const DecompressorGuard&) = delete;
+    };
+
+    struct WipeGuard {
+        vBytes& buffer;
+        ~WipeGuard() { sodium_memzero(buffer.data(), buffer.size()); }
+    };
+
+    [[nodiscard]] std::optional<std::size_t> tryWholeBufferInflate() {
+        constexpr Byte ZLIB_FLG_FDICT = 0x20;
+        if (compressed_.size() < 2 || (compressed_[1] & ZLIB_FLG_FDICT) != 0) {
+            return std::nullopt;
+        }
+        DecompressorGuard decompressor;
+        if (!decompressor.d) {
+            return std::nullopt;
+        }
 
-    ~FilenamePrefixExtractor() {
-        if (!filename_.empty()) {
-            sodium_memzero(filename_.data(), filename_.size());
+        throwIfSignalCancellationRequested();
+        vBytes output(std::clamp(
+            compressed_.size() * WHOLE_BUFFER_EXPANSION,
+            WHOLE_BUFFER_MIN_OUTPUT,
+            WHOLE_BUFFER_OUTPUT_LIMIT));
+        const WipeGuard output_wipe{output};
+        std::size_t in_used = 0;
+        std::size_t out_used = 0;
+        const libdeflate_result result = libdeflate_zlib_decompress_ex(
+            decompressor.d,
+            compressed_.data(), compressed_.size(),
+            output.data(), output.size(),
+            &in_used, &out_used);
+        if (result != LIBDEFLATE_SUCCESS || in_used != compressed_.size() || out_used == 0) {
+            return std::nullopt;
+        }
+        output_.write(std::span<const Byte>(output.data(), out_used));
+        output_.close();
+        return out_used;
+    }
+
+    void startFallback() {
+        fallback_.emplace(std::move(output_));
+        fallback_->consume(compressed_);
+        sodium_memzero(compressed_.data(), compressed_.size());
+        vBytes{}.swap(compressed_);
+    }
+
+    DecodedOutput output_;
+    vBytes compressed_{};
+    std::optional<StreamInflateToFile> fallback_{};
+};
+
+// zstd counterpart of StreamInflateToFile: same consume/finish contract, same
+// output cap, and the payload must be exactly one complete frame.
+class StreamZstdDecodeToFile {
+public:
+    StreamZstdDecodeToFile(const fs::path& output_path, const PayloadFilter& filter)
+        : output_(output_path, filter),
+          dctx_(ZSTD_createDCtx()) {
+        if (!dctx_ ||
+            ZSTD_isError(ZSTD_DCtx_setParameter(dctx_, ZSTD_d_windowLogMax, ZSTD_MAX_WINDOW_LOG))) {
+            ZSTD_freeDCtx(dctx_);
+            throw std::runtime_error("zstd: failed to create decompression context");
         }
     }
 
-    template<typename PayloadFn>
-    void consume(std::span<const Byte> chunk, PayloadFn&& payload_consume) {
-        std::size_t pos = 0;
+    StreamZstdDecodeToFile(const StreamZstdDecodeToFile&) = delete;
+    StreamZstdDecodeToFile& operator=(const StreamZstdDecodeToFile&) = delete;
+
+    ~StreamZstdDecodeToFile() {
+        ZSTD_freeDCtx(dctx_);
+    }
+
+    void consume(std::span<const Byte> compressed_chunk) {
+        throwIfSignalCancellationRequested();
+        if (compressed_chunk.empty()) return;
+        if (finished_) {
+            throw std::runtime_error("zstd decode error: trailing compressed data");
+        }
 
-        if (!has_length_) {
-            if (chunk.empty()) {
-                return;
+        ZSTD_inBuffer in{compressed_chunk.data(), compressed_chunk.size(), 0};
+        while (in.pos < in.size) {
+            throwIfSignalCancellationRequested();
+            ZSTD_outBuffer out{out_chunk_.data(), out_chunk_.size(), 0};
+            const std::size_t ret = ZSTD_decompressStream(dctx_, &out, &in);
+            if (ZSTD_isError(ret)) {
+                throw std::runtime_error(std::format("zstd decode error: {}", ZSTD_getErrorName(ret)));
             }
-            expected_len_ = chunk[pos++];
-            has_length_ = true;
-            if (expected_len_ == 0) {
-                throw std::runtime_error(CORRUPT_FILENAME_ERROR);
+            writeProduced(out.pos);
+
+            if (ret == 0) {
+                finished_ = true;
+                if (in.pos != in.size) {
+                    throw std::runtime_error("zstd decode error: trailing compressed data");
+                }
+                break;
             }
-            filename_.reserve(expected_len_);
         }
+    }
 
-        if (filename_.size() < expected_len_) {
-            const std::size_t need = expected_len_ - filename_.size();
-            const std::size_t take = std::min(need, chunk.size() - pos);
-            if (take > 0) {
-                filename_.append(
-                    reinterpret_cast<const char*>(chunk.data() + static_cast<std::ptrdiff_t>(pos)),
-                    take);
-                pos += take;
+    [[nodiscard]] std::size_t finish() {
+        // Flush output the decoder still holds once all input is in.
+        while (!finished_) {
+            throwIfSignalCancellationRequested();
+            ZSTD_inBuffer in{nullptr, 0, 0};
+            ZSTD_outBuffer out{out_chunk_.data(), out_chunk_.size(), 0};
+            const std::size_t ret = ZSTD_decompressStream(dctx_, &out, &in);
+            if (ZSTD_isError(ret)) {
+                throw std::runtime_error(std::format("zstd decode error: {}", ZSTD_getErrorName(ret)));
+            }
+            writeProduced(out.pos);
+            if (ret == 0) {
+                finished_ = true;
+                break;
             }
+            if (out.pos == 0) {
+                throw std::runtime_error("zstd decode error: truncated or corrupt input");
+            }
+        }
+
+        output_.close();
+        if (output_size_ == 0) {
+            throw std::runtime_error("Zstd Compression Error: Output file is empty. Decoding file failed.");
         }
+        return output_size_;
+    }
 
-        if (pos < chunk.size()) {
-            payload_consume(chunk.subspan(pos));
+private:
+    void writeProduced(std::size_t produced) {
+        if (produced == 0) return;
+        if (produced > STREAM_DECODE_MAX_OUTPUT || output_size_ > STREAM_DECODE_MAX_OUTPUT - produced) {
+            throw std::runtime_error("zstd decode error: output exceeds safe size limit");
         }
+        output_.write(std::span<const Byte>(out_chunk_.data(), produced));
+        output_size_ += produced;
+    }
+
+    DecodedOutput output_;
+    ZSTD_DCtx* dctx_{nullptr};
+    bool finished_{false};
+    vBytes out_chunk_ = vBytes(STREAM_DECODE_OUT_CHUNK_SIZE);
+    std::size_t output_size_{0};
+};
+
+// Recover side of the member framing in payload_prefix.h. Members are
+// collected as they are decrypted and inflated a round at a time across a
+// WorkerPool, each with one libdeflate call into a buffer of its exact size,
+// then written in place with OutputFile::writeAt. A round holds at most
+// MEMBER_ROUND_LIMIT of output (plus its compressed input), whatever the
+// payload size. Every buffer holds plaintext and is wiped before release.
+class MemberInflateToFile {
+public:
+    MemberInflateToFile(const fs::path& output_path, const PayloadLayout& layout, std::size_t threads)
+        : output_(output_path, 0),
+          layout_(layout),
+          member_count_(layout.memberCount()),
+          pool_(std::min(resolveWorkerThreads(threads), membersPerRound(layout))) {
+        if (layout_.total_input_size > STREAM_DECODE_MAX_OUTPUT) {
+            throw std::runtime_error("zlib inflate error: output exceeds safe size limit");
+        }
+        round_.reserve(membersPerRound(layout_));
+    }
+
+    ~MemberInflateToFile() {
+        wipeRound();
+        sodium_memzero(member_.data(), member_.size());
     }
 
-    [[nodiscard]] bool isComplete() const noexcept { return has_length_ && filename_.size() == expected_len_; }
-    [[nodiscard]] const std::string& filename() const noexcept { return filename_; }
+    MemberInflateToFile(const MemberInflateToFile&) = delete;
+    MemberInflateToFile& operator=(const MemberInflateToFile&) = delete;
+
+    void consume(std::span<const Byte> compressed_chunk) {
+        throwIfSignalCancellationRequested();
+        while (!compressed_chunk.empty()) {
+            if (length_filled_ < length_bytes_.size()) {
+                if (next_member_ == member_count_) {
+                    throw std::runtime_error("zlib inflate error: trailing compressed data");
+                }
+                const std::size_t take = std::min(length_bytes_.size() - length_filled_, compressed_chunk.size());
+                std::copy_n(compressed_chunk.begin(), take, length_bytes_.begin() + static_cast<std::ptrdiff_t>(length_filled_));
+                length_filled_ += take;
+                compressed_chunk = compressed_chunk.subspan(take);
+                if (length_filled_ == length_bytes_.size()) {
+                    startMember(decodeFrameLength(length_bytes_));
+                }
+                continue;
+            }
+
+            const std::size_t take = std::min(member_length_ - member_.size(), compressed_chunk.size());
+            member_.insert(member_.end(), compressed_chunk.begin(), compressed_chunk.begin() + static_cast<std::ptrdiff_t>(take));
+            compressed_chunk = compressed_chunk.subspan(take);
+            if (member_.size() == member_length_) {
+                round_.push_back(Member{next_member_++, std::move(member_)});
+                member_ = vBytes{};
+                length_filled_ = 0;
+                if (round_.size() == round_.capacity()) {
+                    inflateRound();
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] std::size_t finish() {
+        if (length_filled_ != 0 || next_member_ != member_count_) {
+            throw std::runtime_error("zlib inflate error: truncated or corrupt input");
+        }
+        inflateRound();
+        output_.close(WRITE_COMPLETE_ERROR);
+        return layout_.total_input_size;
+    }
 
 private:
-    bool has_length_{false};
-    std::size_t expected_len_{0};
-    std::string filename_{};
+    static constexpr std::size_t MEMBER_ROUND_LIMIT = 128 * 1024 * 1024;
+
+    struct Member {
+        std::size_t index{0};
+        vBytes compressed{};
+    };
+
+    [[nodiscard]] static std::size_t membersPerRound(const PayloadLayout& layout) noexcept {
+        return std::max<std::size_t>(1, MEMBER_ROUND_LIMIT / layout.member_input_size);
+    }
+
+    [[nodiscard]] std::size_t memberOutputSize(std::size_t index) const noexcept {
+        return std::min(layout_.member_input_size, layout_.total_input_size - index * layout_.member_input_size);
+    }
+
+    void startMember(std::size_t length) {
+        // Stored deflate blocks bound a member at 5 bytes per 64 KiB of input,
+        // plus the zlib header and trailer.
+        const std::size_t max_length = layout_.member_input_size + layout_.member_input_size / 1024 + 64;
+        if (length == 0 || length > max_length) {
+            throw std::runtime_error("zlib inflate error: corrupt member length");
+        }
+        member_length_ = length;
+        member_.reserve(length);
+    }
+
+    void inflateRound() {
+        if (round_.empty()) return;
+        pool_.run(round_.size(), [&](std::size_t i) { inflateMember(round_[i]); });
+        wipeRound();
+    }
+
+    void wipeRound() noexcept {
+        for (Member& member : round_) {
+            sodium_memzero(member.compressed.data(), member.compressed.size());
+        }
+        round_.clear();
+    }
+
+    void inflateMember(const Member& member) {
+        throwIfSignalCancellationRequested();
+        libdeflate_decompressor* decompressor = libdeflate_alloc_decompressor();
+        if (!decompressor) {
+            throw std::runtime_error("libdeflate: failed to allocate decompressor");
+        }
+        vBytes output(memberOutputSize(member.index));
+        const ZeroGuard<vBytes> output_guard{&output};
+        std::size_t in_used = 0;
+        std::size_t out_used = 0;
+        const libdeflate_result result = libdeflate_zlib_decompress_ex(
+            decompressor,
+            member.compressed.data(), member.compressed.size(),
+            output.data(), output.size(),
+            &in_used, &out_used);
+        libdeflate_free_decompressor(decompressor);
+
+        if (result != LIBDEFLATE_SUCCESS || in_used != member.compressed.size() || out_used != output.size()) {
+            throw std::runtime_error("zlib inflate error: corrupt compressed member");
+        }
+        reversePayloadFilter(layout_.filter, output, member.index * layout_.member_input_size);
+        output_.writeAt(member.index * layout_.member_input_size, output, WRITE_COMPLETE_ERROR);
+    }
+
+    OutputFile output_;
+    PayloadLayout layout_;
+    std::size_t member_count_;
+    WorkerPool pool_;
+    std::vector<Member> round_{};
+    std::array<Byte, STREAM_FRAME_LEN_BYTES> length_bytes_{};
+    std::size_t length_filled_{0};
+    std::size_t member_length_{0};
+    vBytes member_{};
+    std::size_t next_member_{0};
 };
 
-void appendOutputChunkToFile(std::ostream& output, std::span<const Byte> chunk, std::size_t& output_size) {
-    if (chunk.size() > std::numeric_limits<std::size_t>::max() - output_size) {
-        throw std::runtime_error("File Size Error: Decrypted output size overflow.");
+// A raw payload is written as decrypted.
+class PlainPayloadToFile {
+public:
+    PlainPayloadToFile(const fs::path& output_path, const PayloadFilter& filter)
+        : output_(output_path, filter) {}
+
+    void consume(std::span<const Byte> chunk) {
+        if (chunk.size() > std::numeric_limits<std::size_t>::max() - output_size_) {
+            throw std::runtime_error("File Size Error: Decrypted output size overflow.");
+        }
+        output_.write(chunk);
+        output_size_ += chunk.size();
     }
-    writeBytesOrThrow(output, chunk, WRITE_COMPLETE_ERROR);
-    output_size += chunk.size();
-}
 
-template<typename DecryptFn>
-[[nodiscard]] bool decryptCompressedPayloadToFile(
-    DecryptFn&& decrypt_fn,
-    const fs::path& output_path,
-    std::size_t& output_size,
-    std::string& decrypted_filename) {
+    [[nodiscard]] std::size_t finish() {
+        output_.close();
+        return output_size_;
+    }
 
-    FilenamePrefixExtractor prefix_extractor;
-    StreamInflateToFile inflater(output_path);
+private:
+    DecodedOutput output_;
+    std::size_t output_size_{0};
+};
 
-    const bool ok = decrypt_fn([&](std::span<const Byte> chunk) {
-        prefix_extractor.consume(chunk, [&](std::span<const Byte> payload) {
-            inflater.consume(payload);
-        });
-    });
-    if (!ok || !prefix_extractor.isComplete()) return false;
+// The decoder depends on the payload layout, which is only known once the
+// prefix has been decrypted, so it is constructed then, in place.
+using PayloadDecoder = std::variant<
+    std::monostate,
+    PlainPayloadToFile,
+    StreamInflateToFile,
+    WholeBufferInflateToFile,
+    StreamZstdDecodeToFile,
+    MemberInflateToFile>;
 
-    output_size = inflater.finish();
-    decrypted_filename = prefix_extractor.filename();
-    return true;
+void startPayloadDecoder(
+    PayloadDecoder& decoder,
+    PayloadCodec codec,
+    const PayloadLayout& layout,
+    std::size_t encrypted_size,
+    std::size_t threads,
+    const fs::path& output_path) {
+
+    if (layout.hasMembers()) {
+        if (codec != PayloadCodec::zlib) {
+            throw std::runtime_error(CORRUPT_FILENAME_ERROR);
+        }
+        decoder.emplace<MemberInflateToFile>(output_path, layout, threads);
+        return;
+    }
+    switch (codec) {
+        case PayloadCodec::zlib:
+            if (encrypted_size <= WHOLE_BUFFER_INPUT_LIMIT) {
+                decoder.emplace<WholeBufferInflateToFile>(output_path, layout.filter, encrypted_size);
+            } else {
+                decoder.emplace<StreamInflateToFile>(output_path, layout.filter);
+            }
+            return;
+        case PayloadCodec::zstd:
+            decoder.emplace<StreamZstdDecodeToFile>(output_path, layout.filter);
+            return;
+        case PayloadCodec::raw:
+            break;
+    }
+    decoder.emplace<PlainPayloadToFile>(output_path, layout.filter);
 }
 
 template<typename DecryptFn>
-[[nodiscard]] bool decryptPlainPayloadToFile(
+[[nodiscard]] bool decryptToFileExtractingFilenameImpl(
     DecryptFn&& decrypt_fn,
+    PayloadCodec codec,
+    std::size_t encrypted_size,
+    std::size_t threads,
     const fs::path& output_path,
     std::size_t& output_size,
     std::string& decrypted_filename) {
 
-    FilenamePrefixExtractor prefix_extractor;
-    std::ofstream output = openBinaryOutputForWriteOrThrow(output_path);
+    output_size = 0;
+    decrypted_filename.clear();
+
+    PayloadPrefixParser prefix;
+    PayloadDecoder decoder;
+    auto start_decoder = [&] {
+        startPayloadDecoder(decoder, codec, prefix.layout(), encrypted_size, threads, output_path);
+    };
 
     const bool ok = decrypt_fn([&](std::span<const Byte> chunk) {
-        prefix_extractor.consume(chunk, [&](std::span<const Byte> payload) {
-            appendOutputChunkToFile(output, payload, output_size);
-        });
+        const std::span<const Byte> payload = prefix.consume(chunk);
+        if (!prefix.isComplete()) return;
+        if (std::holds_alternative<std::monostate>(decoder)) {
+            start_decoder();
+        }
+        std::visit([&]<typename Decoder>(Decoder& d) {
+            if constexpr (!std::is_same_v<Decoder, std::monostate>) d.consume(payload);
+        }, decoder);
     });
-    if (!ok || !prefix_extractor.isComplete()) return false;
+    if (!ok || !prefix.isComplete()) return false;
 
-    closeOutputOrThrow(output, WRITE_COMPLETE_ERROR);
-    decrypted_filename = prefix_extractor.filename();
+    if (std::holds_alternative<std::monostate>(decoder)) {
+        start_decoder();
+    }
+    output_size = std::visit([]<typename Decoder>(Decoder& d) -> std::size_t {
+        if constexpr (std::is_same_v<Decoder, std::monostate>) {
+            return 0;
+        } else {
+            return d.finish();
+        }
+    }, decoder);
+    decrypted_filename = prefix.filename();
     return true;
 }
 
-template<typename DecryptFn>
-[[nodiscard]] bool decryptToFileExtractingFilenameImpl(
-    DecryptFn&& decrypt_fn,
-    bool is_compressed_payload,
-    const fs::path& output_path,
-    std::size_t& output_size,
-    std::string& decrypted_filename) {
+// Decrypts input_size bytes of ciphertext from input in the layout format
+// records, passing the plaintext to consume.
+template<typename Input, typename ConsumeFn>
+[[nodiscard]] bool decryptStreamInput(
+    Input& input,
+    std::size_t input_size,
+    const Key& key,
+    const StreamHeader& header,
+    const StreamFormat& format,
+    PayloadCodec codec,
+    ConsumeFn&& consume) {
 
-    output_size = 0;
-    decrypted_filename.clear();
+    const KdfMetadataVersion metadata_version = format.version;
+    // zstd postdates V2, whose frames do not authenticate the mode: a V2 image
+    // claiming zstd has had its flag byte altered.
+    if (codec == PayloadCodec::zstd && metadata_version == KdfMetadataVersion::v2_secretstream) {
+        return false;
+    }
 
-    if (is_compressed_payload) {
-        return decryptCompressedPayloadToFile(
-            std::forward<DecryptFn>(decrypt_fn),
-            output_path,
-            output_size,
-            decrypted_filename);
+    const Byte authenticated_mode = streamModeByte(codec);
+    const std::array<Byte, 1> mode_data{authenticated_mode};
+    const std::span<const Byte> associated_data =
+        metadata_version == KdfMetadataVersion::v3_secretstream_authenticated_mode
+            ? std::span<const Byte>(mode_data)
+            : std::span<const Byte>{};
+
+    if (hasParallelFrames(metadata_version)) {
+        return decryptParallelFramesInputChunks(
+            input,
+            input_size,
+            key,
+            header,
+            format.frames,
+            authenticated_mode,
+            consume);
     }
+    return decryptWithSecretStreamInputChunks(
+        input,
+        key,
+        header,
+        associated_data,
+        consume);
+}
 
-    return decryptPlainPayloadToFile(
-        std::forward<DecryptFn>(decrypt_fn),
-        output_path,
-        output_size,
-        decrypted_filename);
+// Counts the payload that follows the prefix; nothing is kept.
+template<typename Input>
+[[nodiscard]] bool authenticateStreamInput(
+    Input& input,
+    std::size_t input_size,
+    const Key& key,
+    const StreamHeader& header,
+    const StreamFormat& format,
+    PayloadCodec codec,
+    StreamAuthentication& result) {
+
+    result = StreamAuthentication{};
+    PayloadPrefixParser prefix;
+    const bool ok = decryptStreamInput(input, input_size, key, header, format, codec,
+        [&](std::span<const Byte> chunk) {
+            result.payload_size += prefix.consume(chunk).size();
+        });
+    if (!ok || !prefix.isComplete()) return false;
+
+    result.filename = prefix.filename();
+    result.layout = prefix.layout();
+    return true;
 }
 } // namespace
 
-[[nodiscard]] bool decryptWithSecretStreamFileInputToFileExtractingFilename(
+[[nodiscard]] bool decryptStreamFileInputToFileExtractingFilename(
     const fs::path& encrypted_input_path,
     const Key& key,
     const StreamHeader& header,
-    KdfMetadataVersion metadata_version,
-    bool is_compressed_payload,
+    const StreamFormat& format,
+    PayloadCodec codec,
     const fs::path& output_path,
     std::size_t& output_size,
     std::string& decrypted_filename) {
 
-    const std::array<Byte, 1> mode_data{streamModeByte(is_compressed_payload)};
-    const std::span<const Byte> associated_data =
-        metadata_version == KdfMetadataVersion::v3_secretstream_authenticated_mode
-            ? std::span<const Byte>(mode_data)
-            : std::span<const Byte>{};
+    ReadAheadFile input(
+        encrypted_input_path,
+        "Read Error: Failed to open encrypted stream input.",
+        "Read Error: Failed while reading encrypted stream input.");
+    const std::size_t input_size =
+        checkedFileSize(encrypted_input_path, "Read Error: Invalid encrypted stream input size.", true);
 
     return decryptToFileExtractingFilenameImpl(
         [&](auto&& consume) {
-            return decryptWithSecretStreamFileInputChunks(
-                encrypted_input_path,
-                key,
-                header,
-                associated_data,
-                consume);
+            return decryptStreamInput(input, input_size, key, header, format, codec, consume);
         },
-        is_compressed_payload,
+        codec,
+        input_size,
+        format.frames.threads,
         output_path,
         output_size,
         decrypted_filename);
 }
+
+[[nodiscard]] bool authenticateStreamExtents(
+    const fs::path& path,
+    std::vector<FileExtent> extents,
+    const Key& key,
+    const StreamHeader& header,
+    const StreamFormat& format,
+    PayloadCodec codec,
+    StreamAuthentication& result) {
+
+    std::size_t input_size = 0;
+    for (const FileExtent& extent : extents) {
+        input_size += extent.size;
+    }
+    ReadAheadFile input(
+        path,
+        std::move(extents),
+        "Read Error: Failed to open image file.",
+        "Read Error: Failed while reading encrypted payload.");
+    return authenticateStreamInput(input, input_size, key, header, format, codec, result);
+}
+
+[[nodiscard]] bool authenticateStreamBuffer(
+    std::span<const Byte> ciphertext,
+    const Key& key,
+    const StreamHeader& header,
+    const StreamFormat& format,
+    PayloadCodec codec,
+    StreamAuthentication& result) {
+
+    SpanInput input(ciphertext);
+    return authenticateStreamInput(input, ciphertext.size(), key, header, format, codec, result);
+}
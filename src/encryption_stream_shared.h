@@ -2,12 +2,98 @@
 
 #include "encryption_internal.h"
 
+#include <algorithm>
 #include <array>
+#include <cstdint>
 
 // StreamHeader is defined in common.h (shared with the public decrypt API).
 using PlainChunk = std::array<Byte, STREAM_CHUNK_SIZE>;
 using CipherChunk = std::array<Byte, STREAM_CHUNK_SIZE + crypto_secretstream_xchacha20poly1305_ABYTES>;
 
+using ParallelFrameNonce = std::array<Byte, crypto_aead_xchacha20poly1305_ietf_NPUBBYTES>;
+using ParallelFrameAd = std::array<Byte, PARALLEL_FRAME_AD_BYTES>;
+
+// V4 frames sealed or opened per WorkerPool batch: at most
+// PARALLEL_FRAMES_PER_ROUND, two per thread, and no more than
+// PARALLEL_ROUND_MAX_BYTES of plaintext, which bounds the buffers held at once.
+inline constexpr std::size_t
+    PARALLEL_FRAMES_PER_ROUND = 32,
+    PARALLEL_ROUND_MAX_BYTES  = 128 * 1024 * 1024;
+
+[[nodiscard]] inline std::size_t parallelRoundFrames(std::size_t threads, std::size_t frame_size) noexcept {
+    return std::max<std::size_t>(1, std::min({PARALLEL_FRAMES_PER_ROUND, 2 * threads, PARALLEL_ROUND_MAX_BYTES / frame_size}));
+}
+
+// One V4 frame of a round, sealed or opened by a pool task. Buffers are
+// allocated on first use, so a payload of a few frames never holds a full
+// round's worth.
+struct ParallelFrameSlot {
+    vBytes plain;
+    vBytes cipher;
+    std::size_t plain_size{0};
+    std::size_t cipher_size{0};
+    bool is_final{false};
+
+    ParallelFrameSlot() = default;
+    ParallelFrameSlot(const ParallelFrameSlot&) = delete;
+    ParallelFrameSlot& operator=(const ParallelFrameSlot&) = delete;
+
+    ~ParallelFrameSlot() {
+        sodium_memzero(plain.data(), plain.size());
+        sodium_memzero(cipher.data(), cipher.size());
+    }
+
+    void allocate(std::size_t frame_size) {
+        if (plain.size() == frame_size) return;
+        sodium_memzero(plain.data(), plain.size());
+        plain.assign(frame_size, 0);
+        cipher.assign(frame_size + PARALLEL_FRAME_ABYTES, 0);
+    }
+};
+
+// Both libsodium AEADs share one signature, so a suite is just a function
+// pair and its nonce length.
+struct ParallelFrameCipher {
+    decltype(&crypto_aead_xchacha20poly1305_ietf_encrypt) encrypt;
+    decltype(&crypto_aead_xchacha20poly1305_ietf_decrypt) decrypt;
+    std::size_t nonce_bytes;
+};
+
+[[nodiscard]] inline ParallelFrameCipher parallelFrameCipher(CipherSuite cipher) noexcept {
+    if (cipher == CipherSuite::aes256gcm) {
+        return {&crypto_aead_aes256gcm_encrypt, &crypto_aead_aes256gcm_decrypt, crypto_aead_aes256gcm_NPUBBYTES};
+    }
+    return {
+        &crypto_aead_xchacha20poly1305_ietf_encrypt,
+        &crypto_aead_xchacha20poly1305_ietf_decrypt,
+        crypto_aead_xchacha20poly1305_ietf_NPUBBYTES};
+}
+
+// Fills the first nonce_bytes of the result; AES-GCM ignores the rest.
+[[nodiscard]] inline ParallelFrameNonce parallelFrameNonce(
+    const StreamHeader& header,
+    uint64_t frame_index,
+    std::size_t nonce_bytes) noexcept {
+
+    const std::size_t base_bytes = nonce_bytes - sizeof(uint64_t);
+    ParallelFrameNonce nonce{};
+    std::copy_n(header.begin(), base_bytes, nonce.begin());
+    for (std::size_t i = 0; i < sizeof(uint64_t); ++i) {
+        nonce[base_bytes + i] = static_cast<Byte>(frame_index >> (8 * i));
+    }
+    return nonce;
+}
+
+[[nodiscard]] inline ParallelFrameAd parallelFrameAd(Byte mode, uint64_t frame_index, bool is_final) noexcept {
+    ParallelFrameAd ad{};
+    ad[0] = mode;
+    for (std::size_t i = 0; i < sizeof(uint64_t); ++i) {
+        ad[1 + i] = static_cast<Byte>(frame_index >> (8 * (sizeof(uint64_t) - 1 - i)));
+    }
+    ad[PARALLEL_FRAME_AD_BYTES - 1] = is_final ? 1 : 0;
+    return ad;
+}
+
 template<typename Buffer>
 struct ZeroGuard {
     Buffer* buf;
@@ -28,3 +114,12 @@ struct SecretStreamStateGuard {
         sodium_memzero(&state, sizeof(state));
     }
 };
+
+// Seals slot.plain into slot.cipher as frame frame_index (encryption_stream.cpp).
+void sealParallelFrame(
+    const Key& key,
+    const StreamHeader& header,
+    CipherSuite cipher,
+    Byte authenticated_mode,
+    uint64_t frame_index,
+    ParallelFrameSlot& slot);
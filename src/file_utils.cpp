@@ -1,4 +1,5 @@
 #include "file_utils.h"
+#include "io_ring.h"
 #include "signal_utils.h"
 
 #include <algorithm>
@@ -10,13 +11,19 @@
 #include <fstream>
 #include <ios>
 #include <limits>
+#include <optional>
 #include <ranges>
 #include <stdexcept>
 #include <system_error>
+#include <vector>
 #include <version>
 
 #include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
 #include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 static_assert(sizeof(void*) == 8 && sizeof(std::size_t) == 8 && sizeof(off_t) >= 8,
@@ -32,6 +39,12 @@ namespace {
 constexpr std::size_t MINIMUM_IMAGE_SIZE = 134;
 constexpr std::size_t MAX_IMAGE_SIZE = 8 * 1024 * 1024;
 constexpr std::size_t MAX_FILE_SIZE = 3ULL * 1024 * 1024 * 1024;
+// iovecs per writev(2) call: IOV_MAX on Linux.
+constexpr std::size_t GATHER_IOV_LIMIT = 1024;
+// Depth of OutputFile's io_uring.
+constexpr unsigned    IO_RING_ENTRIES = 128;
+// Buffer for copies that fall back to pread(2)/pwrite(2).
+constexpr std::size_t FALLBACK_CHUNK_SIZE = 1 * 1024 * 1024;
 constexpr std::size_t MAX_FILENAME_STREAM_SIZE =
     static_cast<std::size_t>(std::numeric_limits<std::streamsize>::max());
 
@@ -182,44 +195,55 @@ constexpr const char* OUTPUT_CREATE_ERROR =
     return output;
 }
 
+// Cross-device commit (the hard link failed). A reflink (FICLONE) shares the
+// staged file's extents where source and output sit on one filesystem (btrfs
+// or XFS across bind mounts), making the copy a metadata operation; otherwise
+// sendFileRangeToFd moves the bytes, by copy_file_range(2) first.
 [[nodiscard]] bool copyFileNoReplace(const fs::path& source_path, const fs::path& output_path, std::string_view error_message) {
-    std::ifstream input = openBinaryInputOrThrow(source_path, std::format("{}: failed to reopen staged file", error_message));
+    const int in_fd = ::open(source_path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat source_stat{};
+    if (in_fd < 0 || ::fstat(in_fd, &source_stat) != 0) {
+        if (in_fd >= 0) ::close(in_fd);
+        throw std::runtime_error(std::format("{}: failed to reopen staged file", error_message));
+    }
 
-    // Same exclusive 0600 create path as openBinaryOutputForWriteOrThrow — no
+    // Same exclusive 0600 create as openBinaryOutputForWriteOrThrow — no
     // create-then-chmod window on the committed output either.
-    std::ofstream output;
+    int out_fd = -1;
     try {
-        output = openBinaryOutputForWriteOrThrow(output_path);
+        out_fd = openExclusiveOwnerOnlyFdOrThrow(output_path, OUTPUT_CREATE_ERROR);
     } catch (const std::exception&) {
+        ::close(in_fd);
         if (pathEntryExists(output_path)) return false;
         throw std::runtime_error(std::format("{}: unable to create output file", error_message));
     }
 
     try {
-        constexpr std::size_t COPY_CHUNK_SIZE = 2 * 1024 * 1024;
-        vBytes buffer(COPY_CHUNK_SIZE);
-        while (true) {
-            const std::streamsize got = readSomeOrThrow(
-                input,
-                buffer.data(),
-                buffer.size(),
-                "Read Error: Failed while committing staged output.");
-            if (got == 0) break;
-            writeBytesOrThrow(
-                output,
-                std::span<const Byte>(buffer.data(), static_cast<std::size_t>(got)),
+        throwIfSignalCancellationRequested();
+        if (::ioctl(out_fd, FICLONE, in_fd) != 0) {
+            (void)sendFileRangeToFd(
+                out_fd,
+                in_fd,
+                0,
+                static_cast<std::size_t>(source_stat.st_size),
                 error_message);
         }
-
-        closeOutputOrThrow(output, error_message);
         // The staged original was already fsynced; keep the committed copy just
         // as durable before the caller announces success.
-        syncPathDataOrThrow(output_path, error_message);
+        const int sync_rc = ::fsync(out_fd);
+        const int close_rc = ::close(out_fd);
+        out_fd = -1;
+        if (sync_rc != 0 || close_rc != 0) {
+            throw std::runtime_error(std::string(error_message));
+        }
     } catch (...) {
+        if (out_fd >= 0) ::close(out_fd);
+        ::close(in_fd);
         cleanupPathNoThrow(output_path);
         throw;
     }
 
+    ::close(in_fd);
     cleanupPathNoThrow(source_path);
     return true;
 }
@@ -314,12 +338,14 @@ std::ofstream openBinaryOutputForWriteOrThrow(const fs::path& path) {
     return ofstreamFromExclusiveFdOrThrow(fd, path);
 }
 
-void writeAllToFd(int fd, std::span<const Byte> bytes, std::string_view error_message) {
+std::size_t writeAllToFd(int fd, std::span<const Byte> bytes, std::string_view error_message) {
     const Byte* data = bytes.data();
     std::size_t left = bytes.size();
+    std::size_t calls = 0;
     while (left > 0) {
         throwIfSignalCancellationRequested();
         const ssize_t got = ::write(fd, data, left);
+        ++calls;
         if (got < 0) {
             if (errno == EINTR) {
                 throwIfSignalCancellationRequested();
@@ -333,39 +359,158 @@ void writeAllToFd(int fd, std::span<const Byte> bytes, std::string_view error_me
         data += got;
         left -= static_cast<std::size_t>(got);
     }
+    return calls;
 }
 
 namespace {
-void sendRangeFallbackFdToFd(int out_fd, int in_fd, std::size_t in_offset, std::size_t length, std::string_view error_message) {
-    constexpr std::size_t FALLBACK_CHUNK_SIZE = 1 * 1024 * 1024;
+void preadExactAt(int fd, std::span<Byte> dst, std::size_t offset, std::string_view error_message) {
+    std::size_t got_total = 0;
+    while (got_total < dst.size()) {
+        throwIfSignalCancellationRequested();
+        const ssize_t got = ::pread(fd, dst.data() + got_total, dst.size() - got_total, static_cast<off_t>(offset + got_total));
+        if (got < 0) {
+            if (errno == EINTR) {
+                throwIfSignalCancellationRequested();
+                continue;
+            }
+            throw std::runtime_error(std::string(error_message));
+        }
+        if (got == 0) throw std::runtime_error(std::string(error_message));  // unexpected EOF
+        got_total += static_cast<std::size_t>(got);
+    }
+}
+
+std::size_t sendRangeFallbackFdToFd(int out_fd, int in_fd, std::size_t in_offset, std::size_t length, std::string_view error_message) {
     vBytes buffer(std::min(length, FALLBACK_CHUNK_SIZE));
 
-    off_t off = static_cast<off_t>(in_offset);
     std::size_t left = length;
+    std::size_t calls = 0;
     while (left > 0) {
         const std::size_t want = std::min(left, buffer.size());
-        std::size_t got_total = 0;
-        while (got_total < want) {
+        preadExactAt(in_fd, std::span<Byte>(buffer.data(), want), in_offset, error_message);
+        calls += writeAllToFd(out_fd, std::span<const Byte>(buffer.data(), want), error_message);
+        in_offset += want;
+        left -= want;
+    }
+    return calls;
+}
+
+// pieces with the first skip bytes dropped.
+[[nodiscard]] std::vector<std::span<const Byte>> piecesAfter(std::span<const std::span<const Byte>> pieces, std::size_t skip) {
+    std::vector<std::span<const Byte>> rest;
+    for (const std::span<const Byte> piece : pieces) {
+        const std::size_t drop = std::min(skip, piece.size());
+        skip -= drop;
+        if (drop < piece.size()) rest.push_back(piece.subspan(drop));
+    }
+    return rest;
+}
+
+// writev(2) (or pwritev(2) from offset) of pieces in order, in batches of
+// GATHER_IOV_LIMIT; a short write resumes mid-piece. Returns the calls made.
+std::size_t gatherToFd(
+    int fd,
+    std::span<const std::span<const Byte>> pieces,
+    std::optional<std::size_t> offset,
+    std::string_view error_message) {
+
+    std::array<iovec, GATHER_IOV_LIMIT> iov{};
+    std::size_t calls = 0;
+    std::size_t next = 0;  // First piece not yet fully written.
+    std::size_t done = 0;  // Bytes of pieces[next] already written.
+    while (true) {
+        std::size_t count = 0;
+        for (std::size_t i = next; i < pieces.size() && count < iov.size(); ++i) {
+            const std::span<const Byte> piece = i == next ? pieces[i].subspan(done) : pieces[i];
+            if (piece.empty()) continue;
+            iov[count++] = iovec{const_cast<Byte*>(piece.data()), piece.size()};
+        }
+        if (count == 0) return calls;
+
+        throwIfSignalCancellationRequested();
+        if (offset && *offset > static_cast<std::size_t>(std::numeric_limits<off_t>::max())) {
+            throw std::runtime_error(std::string(error_message));
+        }
+        const ssize_t got = offset
+            ? ::pwritev(fd, iov.data(), static_cast<int>(count), static_cast<off_t>(*offset))
+            : ::writev(fd, iov.data(), static_cast<int>(count));
+        ++calls;
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string(error_message));
+        }
+        if (got == 0) {
+            throw std::runtime_error(std::string(error_message));
+        }
+
+        std::size_t left = static_cast<std::size_t>(got);
+        if (offset) *offset += left;
+        while (left > 0) {
+            const std::size_t rest = pieces[next].size() - done;
+            if (left < rest) {
+                done += left;
+                break;
+            }
+            left -= rest;
+            ++next;
+            done = 0;
+        }
+    }
+}
+
+// copy_file_range(2) of the whole range, to out_fd's current position or
+// (without moving it) to out_offset; nullopt if the first call is refused
+// (files on different filesystem types, one not a regular file, an old
+// kernel) and nothing has been copied.
+[[nodiscard]] std::optional<std::size_t> copyFileRangeToFd(
+    int out_fd,
+    int in_fd,
+    std::size_t in_offset,
+    std::size_t length,
+    std::optional<std::size_t> out_offset,
+    std::string_view error_message) {
+
+    if (in_offset > static_cast<std::size_t>(std::numeric_limits<loff_t>::max()) ||
+        (out_offset && *out_offset > static_cast<std::size_t>(std::numeric_limits<loff_t>::max()))) {
+        throw std::runtime_error(std::string(error_message));
+    }
+    loff_t offset = static_cast<loff_t>(in_offset);
+    loff_t out_position = out_offset ? static_cast<loff_t>(*out_offset) : 0;
+    std::size_t left = length;
+    std::size_t calls = 0;
+    while (left > 0) {
+        throwIfSignalCancellationRequested();
+        constexpr std::size_t COPY_RANGE_MAX = 0x7ffff000;  // Linux per-call cap, as for sendfile
+        const ssize_t n = ::copy_file_range(
+            in_fd, &offset, out_fd, out_offset ? &out_position : nullptr, std::min(left, COPY_RANGE_MAX), 0);
+        ++calls;
+        if (n < 0 && errno == EINTR) {
             throwIfSignalCancellationRequested();
-            const ssize_t got = ::pread(in_fd, buffer.data() + got_total, want - got_total, off + static_cast<off_t>(got_total));
-            if (got < 0) {
-                if (errno == EINTR) {
-                    throwIfSignalCancellationRequested();
-                    continue;
-                }
-                throw std::runtime_error(std::string(error_message));
+            continue;
+        }
+        if (n <= 0) {
+            // Before anything is copied, leave the range to sendfile, which
+            // also reports a genuine error (a zero here can also mean a
+            // filesystem that cannot copy this way).
+            if (left == length && (n == 0 || errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                                   errno == EOPNOTSUPP || errno == EBADF || errno == EPERM ||
+                                   errno == ETXTBSY)) {
+                return std::nullopt;
             }
-            if (got == 0) throw std::runtime_error(std::string(error_message));  // unexpected EOF
-            got_total += static_cast<std::size_t>(got);
+            throw std::runtime_error(std::string(error_message));
         }
-        writeAllToFd(out_fd, std::span<const Byte>(buffer.data(), want), error_message);
-        off  += static_cast<off_t>(want);
-        left -= want;
+        left -= static_cast<std::size_t>(n);
     }
+    return calls;
 }
 } // namespace
 
-void sendFileRangeToFd(int out_fd, int in_fd, std::size_t in_offset, std::size_t length, std::string_view error_message) {
+std::size_t sendFileRangeToFd(int out_fd, int in_fd, std::size_t in_offset, std::size_t length, std::string_view error_message) {
+    if (const std::optional<std::size_t> copied = copyFileRangeToFd(out_fd, in_fd, in_offset, length, std::nullopt, error_message)) {
+        return *copied;
+    }
+    std::size_t calls = 1;  // The refused copy_file_range.
+
     off_t offset = static_cast<off_t>(in_offset);
     std::size_t left = length;
     while (left > 0) {
@@ -373,6 +518,7 @@ void sendFileRangeToFd(int out_fd, int in_fd, std::size_t in_offset, std::size_t
         constexpr std::size_t SENDFILE_MAX = 0x7ffff000;  // Linux per-call cap (~2 GiB)
         const std::size_t want = std::min(left, SENDFILE_MAX);
         const ssize_t n = ::sendfile(out_fd, in_fd, &offset, want);
+        ++calls;
         if (n < 0) {
             if (errno == EINTR) {
                 throwIfSignalCancellationRequested();
@@ -381,14 +527,14 @@ void sendFileRangeToFd(int out_fd, int in_fd, std::size_t in_offset, std::size_t
             if ((errno == EINVAL || errno == ENOSYS) && left == length) {
                 // sendfile unsupported here (e.g. some virtual filesystems):
                 // copy the whole region the slow way instead.
-                sendRangeFallbackFdToFd(out_fd, in_fd, in_offset, length, error_message);
-                return;
+                return calls + sendRangeFallbackFdToFd(out_fd, in_fd, in_offset, length, error_message);
             }
             throw std::runtime_error(std::string(error_message));
         }
         if (n == 0) throw std::runtime_error(std::string(error_message));  // unexpected EOF
         left -= static_cast<std::size_t>(n);
     }
+    return calls;
 }
 
 OutputFile::OutputFile(const fs::path& path, std::size_t buffer_capacity)
@@ -403,7 +549,7 @@ OutputFile::~OutputFile() noexcept {
 
 void OutputFile::drain(std::string_view error_message) {
     if (fill_ == 0) return;
-    writeAllToFd(fd_, std::span<const Byte>(buffer_.data(), fill_), error_message);
+    write_calls_ += writeAllToFd(fd_, std::span<const Byte>(buffer_.data(), fill_), error_message);
     fill_ = 0;
 }
 
@@ -412,7 +558,7 @@ void OutputFile::write(std::span<const Byte> bytes, std::string_view error_messa
     throwIfSignalCancellationRequested();
     if (bytes.size() >= buffer_.size()) {
         drain(error_message);
-        writeAllToFd(fd_, bytes, error_message);
+        write_calls_ += writeAllToFd(fd_, bytes, error_message);
         return;
     }
     if (fill_ + bytes.size() > buffer_.size()) {
@@ -425,7 +571,136 @@ void OutputFile::write(std::span<const Byte> bytes, std::string_view error_messa
 void OutputFile::sendFrom(int in_fd, std::size_t in_offset, std::size_t length, std::string_view error_message) {
     throwIfSignalCancellationRequested();
     drain(error_message);  // buffered bytes must land before the sendfile region
-    sendFileRangeToFd(fd_, in_fd, in_offset, length, error_message);
+    write_calls_ += sendFileRangeToFd(fd_, in_fd, in_offset, length, error_message);
+}
+
+void OutputFile::writeGather(std::span<const std::span<const Byte>> pieces, std::string_view error_message) {
+    throwIfSignalCancellationRequested();
+    std::vector<std::span<const Byte>> queued;
+    queued.reserve(pieces.size() + 1);
+    if (fill_ > 0) {
+        queued.emplace_back(buffer_.data(), fill_);
+    }
+    queued.insert(queued.end(), pieces.begin(), pieces.end());
+    fill_ = 0;
+    write_calls_ += gatherToFd(fd_, queued, std::nullopt, error_message);
+}
+
+void OutputFile::writeGatherAt(std::size_t offset, std::span<const std::span<const Byte>> pieces, std::string_view error_message) {
+    throwIfSignalCancellationRequested();
+    write_calls_ += gatherToFd(fd_, pieces, offset, error_message);
+}
+
+bool OutputFile::enableIoRing() {
+    if (!ring_) {
+        ring_ = IoRing::tryCreate(IO_RING_ENTRIES);
+    }
+    return ring_ != nullptr;
+}
+
+void OutputFile::writeGatherBatchAt(std::span<const GatherWrite> writes, std::string_view error_message) {
+    throwIfSignalCancellationRequested();
+    if (!ring_) {
+        for (const GatherWrite& write : writes) {
+            write_calls_ += gatherToFd(fd_, write.pieces, write.offset, error_message);
+        }
+        return;
+    }
+
+    std::vector<iovec> iov;
+    std::vector<int> results;
+    while (!writes.empty()) {
+        const std::span<const GatherWrite> batch = writes.first(std::min(writes.size(), ring_->capacity()));
+        writes = writes.subspan(batch.size());
+
+        std::size_t iov_count = 0;
+        for (const GatherWrite& write : batch) {
+            iov_count += write.pieces.size();
+        }
+        iov.clear();
+        iov.reserve(iov_count);  // Queued requests point into iov: no reallocation.
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            const std::size_t first = iov.size();
+            for (const std::span<const Byte> piece : batch[i].pieces) {
+                if (piece.empty()) continue;
+                iov.push_back(iovec{const_cast<Byte*>(piece.data()), piece.size()});
+            }
+            ring_->writev(fd_, std::span<const iovec>(iov).subspan(first), batch[i].offset, i);
+        }
+        results.assign(batch.size(), 0);
+        write_calls_ += ring_->submitAll([&](std::uint64_t tag, int result) { results[tag] = result; });
+
+        // A short or failed write is finished with pwritev(2), which reports
+        // the error if it is a real one.
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            const std::size_t done = results[i] > 0 ? static_cast<std::size_t>(results[i]) : 0;
+            const std::vector<std::span<const Byte>> rest = piecesAfter(batch[i].pieces, done);
+            if (!rest.empty()) {
+                write_calls_ += gatherToFd(fd_, rest, batch[i].offset + done, error_message);
+            }
+        }
+        throwIfSignalCancellationRequested();
+    }
+}
+
+void OutputFile::copyRangeAt(int in_fd, std::size_t in_offset, std::size_t out_offset, std::size_t length, std::string_view error_message) {
+    if (const std::optional<std::size_t> copied = copyFileRangeToFd(fd_, in_fd, in_offset, length, out_offset, error_message)) {
+        write_calls_ += *copied;
+        return;
+    }
+    ++write_calls_;  // The refused copy_file_range.
+
+    vBytes buffer(std::min(length, FALLBACK_CHUNK_SIZE));
+    while (length > 0) {
+        const std::span<Byte> chunk(buffer.data(), std::min(length, buffer.size()));
+        preadExactAt(in_fd, chunk, in_offset, error_message);
+        writeAt(out_offset, chunk, error_message);
+        in_offset += chunk.size();
+        out_offset += chunk.size();
+        length -= chunk.size();
+    }
+}
+
+void OutputFile::preallocate(std::size_t size, std::string_view error_message) {
+    if (size == 0) return;
+    if (size > static_cast<std::size_t>(std::numeric_limits<off_t>::max())) {
+        throw std::runtime_error(std::string(error_message));
+    }
+    while (::fallocate(fd_, 0, 0, static_cast<off_t>(size)) != 0) {
+        if (errno == EINTR) {
+            throwIfSignalCancellationRequested();
+            continue;
+        }
+        if (errno == ENOSPC || errno == EDQUOT || errno == EFBIG) {
+            throw std::runtime_error(std::string(error_message));
+        }
+        return;  // EOPNOTSUPP and the like: the writes allocate as they go.
+    }
+}
+
+void OutputFile::flush(std::string_view error_message) {
+    throwIfSignalCancellationRequested();
+    drain(error_message);
+}
+
+void OutputFile::writeAt(std::size_t offset, std::span<const Byte> bytes, std::string_view error_message) {
+    while (!bytes.empty()) {
+        throwIfSignalCancellationRequested();
+        if (offset > static_cast<std::size_t>(std::numeric_limits<off_t>::max())) {
+            throw std::runtime_error(std::string(error_message));
+        }
+        const ssize_t got = ::pwrite(fd_, bytes.data(), bytes.size(), static_cast<off_t>(offset));
+        ++write_calls_;
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string(error_message));
+        }
+        if (got == 0) {
+            throw std::runtime_error(std::string(error_message));
+        }
+        bytes = bytes.subspan(static_cast<std::size_t>(got));
+        offset += static_cast<std::size_t>(got);
+    }
 }
 
 void OutputFile::close(std::string_view error_message, bool durable) {
@@ -2,9 +2,11 @@
 
 #include "common.h"
 
+#include <atomic>
 #include <fstream>
 #include <initializer_list>
 #include <limits>
+#include <memory>
 #include <optional>
 #include <span>
 #include <stdexcept>
@@ -78,12 +80,15 @@ void syncPathDataOrThrow(const fs::path& path, std::string_view error_message);
 // survives a crash. Failure is not fatal: some filesystems refuse directory
 // fsync, and the data itself is already durable by this point.
 void syncParentDirectoryNoThrow(const fs::path& path) noexcept;
-void writeAllToFd(int fd, std::span<const Byte> bytes, std::string_view error_message);
+// Both return the number of write-side system calls they made.
+std::size_t writeAllToFd(int fd, std::span<const Byte> bytes, std::string_view error_message);
 // Kernel-to-kernel copy of [in_offset, in_offset + length) from in_fd to
-// out_fd's current position via sendfile(2), capped per call at the Linux
-// limit. If the kernel/filesystem rejects sendfile outright (EINVAL/ENOSYS on
-// the first call), falls back to a pread/write copy loop.
-void sendFileRangeToFd(int out_fd, int in_fd, std::size_t in_offset, std::size_t length, std::string_view error_message);
+// out_fd's current position, capped per call at the Linux limit. Tries
+// copy_file_range(2) first, which lets the filesystem reflink or copy
+// server-side (btrfs/XFS, NFS 4.2, SMB); where that is refused on the first
+// call, sendfile(2); and where sendfile is too (EINVAL/ENOSYS), a pread/write
+// copy loop.
+std::size_t sendFileRangeToFd(int out_fd, int in_fd, std::size_t in_offset, std::size_t length, std::string_view error_message);
 [[nodiscard]] bool tryCommitStagedFileNoReplace(const fs::path& staged_path, const fs::path& output_path, std::string_view error_message);
 void commitStagedFileNoReplaceOrThrow(const fs::path& staged_path, const fs::path& output_path, std::string_view error_message);
 [[nodiscard]] std::size_t validateFileForRead(
@@ -93,6 +98,14 @@ void commitStagedFileNoReplaceOrThrow(const fs::path& staged_path, const fs::pat
     const fs::path& path,
     FileTypeCheck file_type = FileTypeCheck::data_file);
 
+class IoRing;
+
+// One of several independent positional gathers (see OutputFile).
+struct GatherWrite {
+    std::size_t offset{0};
+    std::span<const std::span<const Byte>> pieces{};
+};
+
 // Buffered, fd-backed output sink for the staged final-image write. Replaces a
 // std::ofstream + pubsetbuf: the internal buffer coalesces the many small
 // segment-header writes into few write(2) calls (the property pubsetbuf gave us),
@@ -117,18 +130,63 @@ public:
     // preserved.
     void sendFrom(int in_fd, std::size_t in_offset, std::size_t length, std::string_view error_message);
 
+    // Append of pieces, in order, in as few writev(2) calls as IOV_MAX allows,
+    // with anything still buffered going out first in the same calls. For
+    // large pieces that already sit in memory (ICC segment data and the
+    // headers between them), this saves copying them through the buffer.
+    void writeGather(std::span<const std::span<const Byte>> pieces, std::string_view error_message);
+
+    // writeAt for pieces laid end to end from offset, via pwritev(2).
+    // Unbuffered and, like writeAt, safe from several threads for disjoint
+    // ranges.
+    void writeGatherAt(std::size_t offset, std::span<const std::span<const Byte>> pieces, std::string_view error_message);
+
+    // writeGatherAt for each write, in any order. On the io_uring path they
+    // go to the kernel together, a ring's worth per io_uring_enter(2).
+    void writeGatherBatchAt(std::span<const GatherWrite> writes, std::string_view error_message);
+
+    // Moves writeGatherBatchAt onto an io_uring (see IoRing) if the kernel
+    // allows one; false if it does not, in which case it keeps to the plain
+    // system calls.
+    bool enableIoRing();
+
+    // Reserves size bytes of disk for the file up front (fallocate(2)), so a
+    // full disk fails here rather than part way through. Where the filesystem
+    // cannot preallocate, this does nothing.
+    void preallocate(std::size_t size, std::string_view error_message);
+
+    // Write out buffered bytes now, e.g. before patching them with writeAt().
+    void flush(std::string_view error_message);
+
+    // Copy of [in_offset, in_offset + length) from in_fd to out_offset by
+    // copy_file_range(2) (which may reflink or copy server-side), or where
+    // that is refused, pread(2)/pwrite(2). Like writeAt, unbuffered and safe
+    // from several threads at once for disjoint ranges.
+    void copyRangeAt(int in_fd, std::size_t in_offset, std::size_t out_offset, std::size_t length, std::string_view error_message);
+
+    // Unbuffered pwrite(2) of bytes at an absolute offset; safe to call from
+    // several threads at once for disjoint ranges. Bytes still buffered by
+    // write() must be flushed before writeAt() touches their range.
+    void writeAt(std::size_t offset, std::span<const Byte> bytes, std::string_view error_message);
+
     // Flush remaining buffered bytes and close, surfacing any write error --
     // including one the kernel only reports at close(2) (NFS, delayed-allocation
     // ENOSPC/EDQUOT). With `durable`, fsync first so the bytes have reached
     // stable storage before the caller reports success.
     void close(std::string_view error_message, bool durable = false);
 
+    // write(2), writev(2), pwrite(2), sendfile(2), copy_file_range(2) and
+    // io_uring_enter(2) calls made so far, for --stats.
+    [[nodiscard]] std::size_t writeCalls() const noexcept { return write_calls_; }
+
 private:
     void drain(std::string_view error_message);
 
     int         fd_ = -1;
     vBytes      buffer_;
     std::size_t fill_ = 0;
+    std::atomic<std::size_t> write_calls_{0};
+    std::unique_ptr<IoRing> ring_{};
 };
 
 struct TempFileCleanupGuard {
@@ -0,0 +1,173 @@
+#include "io_ring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+using namespace std::chrono_literals;
+
+// How often submitAll() looks for completions when it cannot wait for them.
+constexpr auto COMPLETION_POLL_INTERVAL = 1ms;
+
+// The ring's head and tail indices are shared with the kernel.
+[[nodiscard]] unsigned loadAcquire(unsigned* p) noexcept {
+    return std::atomic_ref<unsigned>(*p).load(std::memory_order_acquire);
+}
+
+void storeRelease(unsigned* p, unsigned value) noexcept {
+    std::atomic_ref<unsigned>(*p).store(value, std::memory_order_release);
+}
+
+[[nodiscard]] unsigned* ringField(void* map, std::uint32_t offset) noexcept {
+    return reinterpret_cast<unsigned*>(static_cast<char*>(map) + offset);
+}
+
+[[nodiscard]] void* mapRing(int fd, std::size_t size, off_t offset) noexcept {
+    void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return p == MAP_FAILED ? nullptr : p;
+}
+
+void requireRequestSize(std::size_t size, std::size_t offset) {
+    if (size > std::numeric_limits<std::uint32_t>::max() ||
+        offset > static_cast<std::size_t>(std::numeric_limits<off_t>::max())) {
+        throw std::runtime_error("Internal Error: I/O request out of range.");
+    }
+}
+} // namespace
+
+std::unique_ptr<IoRing> IoRing::tryCreate(unsigned entries) noexcept {
+    if (const char* disabled = std::getenv("JDVRIF_DISABLE_IO_URING"); disabled != nullptr && *disabled != '\0') {
+        return nullptr;
+    }
+
+    std::unique_ptr<IoRing> ring;
+    try {
+        ring.reset(new IoRing());
+    } catch (...) {
+        return nullptr;
+    }
+
+    io_uring_params params{};
+    ring->ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (ring->ring_fd_ < 0) return nullptr;  // ENOSYS, or EPERM from a policy.
+
+    ring->sq_map_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_map = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_map) {
+        ring->sq_map_size_ = std::max(ring->sq_map_size_, ring->cq_map_size_);
+    }
+    ring->sq_map_ = mapRing(ring->ring_fd_, ring->sq_map_size_, IORING_OFF_SQ_RING);
+    if (ring->sq_map_ == nullptr) return nullptr;
+    if (single_map) {
+        ring->cq_map_ = ring->sq_map_;
+    } else {
+        ring->cq_map_ = mapRing(ring->ring_fd_, ring->cq_map_size_, IORING_OFF_CQ_RING);
+        if (ring->cq_map_ == nullptr) return nullptr;
+    }
+    ring->sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes_ = static_cast<io_uring_sqe*>(mapRing(ring->ring_fd_, ring->sqes_size_, IORING_OFF_SQES));
+    if (ring->sqes_ == nullptr) return nullptr;
+
+    ring->sq_head_  = ringField(ring->sq_map_, params.sq_off.head);
+    ring->sq_tail_  = ringField(ring->sq_map_, params.sq_off.tail);
+    ring->sq_mask_  = ringField(ring->sq_map_, params.sq_off.ring_mask);
+    ring->sq_array_ = ringField(ring->sq_map_, params.sq_off.array);
+    ring->cq_head_  = ringField(ring->cq_map_, params.cq_off.head);
+    ring->cq_tail_  = ringField(ring->cq_map_, params.cq_off.tail);
+    ring->cq_mask_  = ringField(ring->cq_map_, params.cq_off.ring_mask);
+    ring->cqes_ = reinterpret_cast<io_uring_cqe*>(static_cast<char*>(ring->cq_map_) + params.cq_off.cqes);
+    ring->sq_entries_ = params.sq_entries;
+    return ring;
+}
+
+IoRing::~IoRing() {
+    if (sqes_ != nullptr) ::munmap(sqes_, sqes_size_);
+    if (cq_map_ != nullptr && cq_map_ != sq_map_) ::munmap(cq_map_, cq_map_size_);
+    if (sq_map_ != nullptr) ::munmap(sq_map_, sq_map_size_);
+    if (ring_fd_ >= 0) ::close(ring_fd_);
+}
+
+io_uring_sqe* IoRing::nextSqe(std::uint64_t tag) {
+    if (queued_ == sq_entries_) {
+        throw std::runtime_error("Internal Error: I/O ring queue overflow.");
+    }
+    // Only this thread moves the submission tail, so it can be read plainly.
+    const unsigned index = (*sq_tail_ + queued_) & *sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = tag;
+    sq_array_[index] = index;
+    ++queued_;
+    return sqe;
+}
+
+void IoRing::writev(int fd, std::span<const iovec> iov, std::size_t offset, std::uint64_t tag) {
+    requireRequestSize(iov.size(), offset);
+    io_uring_sqe* sqe = nextSqe(tag);
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<std::uint64_t>(iov.data());
+    sqe->len = static_cast<std::uint32_t>(iov.size());
+}
+
+std::size_t IoRing::submitAll(const Completion& on_complete) {
+    if (queued_ == 0) return 0;
+    const unsigned tail = *sq_tail_ + queued_;
+    storeRelease(sq_tail_, tail);
+    std::size_t pending = queued_;
+    queued_ = 0;
+
+    std::size_t calls = 0;
+    bool submit_failed = false;
+    bool wait_failed = false;
+    while (true) {
+        unsigned head = *cq_head_;
+        const unsigned cq_tail = loadAcquire(cq_tail_);
+        while (head != cq_tail) {
+            const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+            on_complete(cqe.user_data, cqe.res);
+            ++head;
+            --pending;
+        }
+        storeRelease(cq_head_, head);
+        if (pending == 0) break;
+        if (wait_failed) {
+            // Requests in flight still complete on their own, and the caller
+            // frees their buffers once this returns, so poll until they have.
+            std::this_thread::sleep_for(COMPLETION_POLL_INTERVAL);
+            continue;
+        }
+
+        const unsigned to_submit = submit_failed ? 0 : tail - loadAcquire(sq_head_);
+        const long rc = ::syscall(__NR_io_uring_enter, ring_fd_, to_submit, static_cast<unsigned>(pending), IORING_ENTER_GETEVENTS, nullptr, 0);
+        ++calls;
+        if (rc >= 0 || errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+        submit_failed = true;
+        if (to_submit != 0) {
+            // Withdraw the requests the kernel did not take; those it did are
+            // still waited for, as their buffers are in use.
+            storeRelease(sq_tail_, loadAcquire(sq_head_));
+            pending -= to_submit;
+        } else {
+            wait_failed = true;
+        }
+    }
+    if (submit_failed) {
+        throw std::runtime_error("Write Error: I/O ring submission failed.");
+    }
+    return calls;
+}
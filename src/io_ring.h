@@ -0,0 +1,74 @@
+#pragma once
+
+#include "common.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+
+#include <sys/uio.h>
+
+// A small io_uring(7) instance driven through the raw system calls (no
+// liburing). Requests are queued, then submitAll() hands the whole queue to
+// the kernel in one io_uring_enter(2) and waits for every completion, so a
+// batch of a hundred writes costs a single system call. Linux only;
+// tryCreate() returns null where io_uring is missing (old kernels) or refused
+// (seccomp filters, kernel.io_uring_disabled), and callers fall back to the
+// ordinary system calls. Setting JDVRIF_DISABLE_IO_URING to a non-empty value
+// forces that fallback, for testing it on kernels that do have io_uring.
+//
+// Its only user is IccSegmentWriter's reserved output, which conceal takes
+// when the encrypted size is known up front: a raw (uncompressed) payload.
+// Compressed conceal and every recover path never create a ring.
+class IoRing {
+public:
+    // Called once per request with its tag and result: the byte count, or a
+    // negated errno.
+    using Completion = std::function<void(std::uint64_t tag, int result)>;
+
+    [[nodiscard]] static std::unique_ptr<IoRing> tryCreate(unsigned entries) noexcept;
+    ~IoRing();
+
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    // Requests that may be queued before submitAll().
+    [[nodiscard]] std::size_t capacity() const noexcept { return sq_entries_; }
+
+    // Queues a pwritev(2) of iov at offset. iov must stay valid until
+    // submitAll() returns.
+    void writev(int fd, std::span<const iovec> iov, std::size_t offset, std::uint64_t tag);
+
+    // Submits the queue and waits for all of it. Neither a signal nor a failed
+    // io_uring_enter cuts the wait short while a submitted request is still
+    // in flight (the kernel may still be using its buffers); the caller
+    // checks for cancellation afterwards. Returns io_uring_enter calls made.
+    std::size_t submitAll(const Completion& on_complete);
+
+private:
+    IoRing() = default;
+
+    struct io_uring_sqe* nextSqe(std::uint64_t tag);
+
+    int ring_fd_{-1};
+    void* sq_map_{nullptr};
+    std::size_t sq_map_size_{0};
+    void* cq_map_{nullptr};
+    std::size_t cq_map_size_{0};
+    struct io_uring_sqe* sqes_{nullptr};
+    std::size_t sqes_size_{0};
+
+    unsigned* sq_head_{nullptr};
+    unsigned* sq_tail_{nullptr};
+    unsigned* sq_mask_{nullptr};
+    unsigned* sq_array_{nullptr};
+    unsigned* cq_head_{nullptr};
+    unsigned* cq_tail_{nullptr};
+    unsigned* cq_mask_{nullptr};
+    struct io_uring_cqe* cqes_{nullptr};
+
+    unsigned sq_entries_{0};
+    unsigned queued_{0};
+};
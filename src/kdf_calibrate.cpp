@@ -0,0 +1,83 @@
+#include "kdf_calibrate.h"
+#include "signal_utils.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <print>
+#include <stdexcept>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Milliseconds one derivation at this cost takes here. The password, salt and
+// key are random and thrown away.
+[[nodiscard]] double measureDerivationMs(const KdfCost& cost) {
+    throwIfSignalCancellationRequested();
+    std::array<char, 20> password{};
+    std::array<Byte, crypto_pwhash_SALTBYTES> salt{};
+    std::array<Byte, crypto_aead_xchacha20poly1305_ietf_KEYBYTES> key{};
+    randombytes_buf(password.data(), password.size());
+    randombytes_buf(salt.data(), salt.size());
+
+    const Clock::time_point start = Clock::now();
+    const int rc = crypto_pwhash(
+        key.data(),
+        key.size(),
+        password.data(),
+        password.size(),
+        salt.data(),
+        static_cast<unsigned long long>(cost.opslimit),
+        cost.memlimit,
+        crypto_pwhash_ALG_ARGON2ID13);
+    const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    sodium_memzero(key.data(), key.size());
+    sodium_memzero(password.data(), password.size());
+    throwIfSignalCancellationRequested();
+    if (rc != 0) {
+        throw std::runtime_error("KDF Error: Unable to derive a key while calibrating (out of memory?).");
+    }
+    return ms;
+}
+} // namespace
+
+// Memory first, then passes: a pass over more memory costs an attacker more
+// than a second pass over the same memory. The memory is the largest power
+// of two that still leaves room for two passes (one pass scales with memory,
+// so the smallest size is timed and scaled); the passes then fill the target.
+void calibrateKdf(std::size_t target_ms) {
+    const auto target = static_cast<double>(target_ms);
+    std::println("\nKey derivation calibration: Argon2id, aiming for about {} ms on this machine.\n", target_ms);
+
+    const double floor_pass_ms = measureDerivationMs(KdfCost{.opslimit = 1, .memlimit = MIN_KDF_MEMLIMIT});
+    std::size_t memlimit = MIN_KDF_MEMLIMIT;
+    while (memlimit < MAX_KDF_MEMLIMIT &&
+           2.0 * floor_pass_ms * static_cast<double>(memlimit * 2 / MIN_KDF_MEMLIMIT) <= target) {
+        memlimit *= 2;
+    }
+
+    // The scaling is only an estimate (large sizes also pay for page faults
+    // and cache misses), so measure and step back while two passes overshoot.
+    double pass_ms = memlimit == MIN_KDF_MEMLIMIT
+        ? floor_pass_ms
+        : measureDerivationMs(KdfCost{.opslimit = 1, .memlimit = memlimit});
+    while (memlimit > MIN_KDF_MEMLIMIT && 2.0 * pass_ms > target) {
+        memlimit /= 2;
+        pass_ms = measureDerivationMs(KdfCost{.opslimit = 1, .memlimit = memlimit});
+    }
+    const auto passes = static_cast<std::size_t>(target / std::max(pass_ms, 1.0));
+    const KdfCost suggested{
+        .opslimit = std::clamp(passes, MIN_KDF_OPSLIMIT, MAX_KDF_OPSLIMIT),
+        .memlimit = memlimit,
+    };
+
+    const double default_ms = measureDerivationMs(KdfCost{});
+    const double suggested_ms = measureDerivationMs(suggested);
+    std::println("  Default:   --kdf-ops {:>2} --kdf-mem {:>4}M  {:>6.0f} ms",
+                 DEFAULT_KDF_OPSLIMIT, DEFAULT_KDF_MEMLIMIT / (1024 * 1024), default_ms);
+    std::println("  Suggested: --kdf-ops {:>2} --kdf-mem {:>4}M  {:>6.0f} ms",
+                 suggested.opslimit, suggested.memlimit / (1024 * 1024), suggested_ms);
+    std::println("\nUse it with \"jdvrif conceal --kdf-ops {} --kdf-mem {}M ...\".\n"
+                 "Recover takes the same memory and passes, so allow for a slower machine there.\n",
+                 suggested.opslimit, suggested.memlimit / (1024 * 1024));
+}
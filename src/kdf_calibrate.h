@@ -0,0 +1,13 @@
+#pragma once
+
+#include "common.h"
+
+// calibrate-kdf aims the suggested key derivation at this many milliseconds.
+inline constexpr std::size_t
+    MIN_KDF_TARGET_MS     = 50,
+    DEFAULT_KDF_TARGET_MS = 500,
+    MAX_KDF_TARGET_MS     = 10000;
+
+// Times Argon2id on this host and suggests the --kdf-ops / --kdf-mem pair
+// that derives a key in about target_ms, within the KdfCost bounds.
+void calibrateKdf(std::size_t target_ms);
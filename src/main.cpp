@@ -1,6 +1,8 @@
+#include "cipher_bench.h"
 #include "common.h"
 #include "conceal.h"
 #include "file_utils.h"
+#include "kdf_calibrate.h"
 #include "program_args.h"
 #include "recover.h"
 #include "signal_utils.h"
@@ -22,11 +24,25 @@ namespace {
     switch (args.mode) {
         case Mode::conceal: {
             vBytes jpg_vec = readFile(args.image_file_path, FileTypeCheck::cover_image);
-            concealData(jpg_vec, args.option, args.data_file_path);
+            concealData(jpg_vec, args.conceal_options, args.data_file_path);
+            return 0;
+        }
+        case Mode::conceal_batch: {
+            const vBytes jpg_vec = readFile(args.image_file_path, FileTypeCheck::cover_image);
+            concealBatch(jpg_vec, args.conceal_options, args.data_file_paths);
             return 0;
         }
         case Mode::recover:
-            recoverData(args.image_file_path);
+            recoverData(args.image_file_path, args.threads);
+            return 0;
+        case Mode::verify:
+            verifyData(args.image_file_path, args.threads);
+            return 0;
+        case Mode::bench_cipher:
+            benchmarkCiphers();
+            return 0;
+        case Mode::calibrate_kdf:
+            calibrateKdf(args.kdf_target_ms);
             return 0;
         default:
             throw std::runtime_error("Internal Error: Unsupported mode.");
@@ -0,0 +1,109 @@
+#include "parallel_utils.h"
+
+#include <algorithm>
+#include <csignal>
+
+#include <pthread.h>
+
+std::size_t resolveWorkerThreads(std::size_t requested) noexcept {
+    std::size_t threads = requested;
+    if (threads == 0) {
+        threads = static_cast<std::size_t>(std::thread::hardware_concurrency());
+    }
+    return std::clamp<std::size_t>(threads, 1, MAX_WORKER_THREADS);
+}
+
+WorkerPool::WorkerPool(std::size_t thread_count) {
+    const std::size_t worker_count = std::clamp<std::size_t>(thread_count, 1, MAX_WORKER_THREADS) - 1;
+    workers_.reserve(worker_count);
+    try {
+        for (std::size_t i = 0; i < worker_count; ++i) {
+            workers_.emplace_back([this] { workerLoop(); });
+        }
+    } catch (...) {
+        // Thread creation can fail under RLIMIT_NPROC / cgroup pids limits.
+        // Stop the workers that did start, then report the failure.
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_) worker.join();
+        throw;
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) worker.join();
+}
+
+void WorkerPool::run(std::size_t task_count, const std::function<void(std::size_t)>& task) {
+    if (task_count == 0) return;
+    if (workers_.empty() || task_count == 1) {
+        for (std::size_t i = 0; i < task_count; ++i) task(i);
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex_);
+        task_ = &task;
+        task_count_ = task_count;
+        next_task_.store(0, std::memory_order_relaxed);
+        failed_.store(false, std::memory_order_relaxed);
+        error_ = nullptr;
+        busy_workers_ = workers_.size();
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    drainTasks();
+
+    std::exception_ptr error;
+    {
+        std::unique_lock lock(mutex_);
+        done_.wait(lock, [this] { return busy_workers_ == 0; });
+        task_ = nullptr;
+        error = std::exchange(error_, nullptr);
+    }
+    if (error) std::rethrow_exception(error);
+}
+
+void WorkerPool::workerLoop() {
+    sigset_t blocked;
+    sigfillset(&blocked);
+    (void)::pthread_sigmask(SIG_BLOCK, &blocked, nullptr);
+
+    std::size_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock(mutex_);
+            wake_.wait(lock, [&] { return stopping_ || generation_ != seen_generation; });
+            if (stopping_) return;
+            seen_generation = generation_;
+        }
+
+        drainTasks();
+
+        std::lock_guard lock(mutex_);
+        if (--busy_workers_ == 0) done_.notify_one();
+    }
+}
+
+void WorkerPool::drainTasks() {
+    while (!failed_.load(std::memory_order_relaxed)) {
+        const std::size_t index = next_task_.fetch_add(1, std::memory_order_relaxed);
+        if (index >= task_count_) return;
+        try {
+            (*task_)(index);
+        } catch (...) {
+            std::lock_guard lock(mutex_);
+            if (!error_) error_ = std::current_exception();
+            failed_.store(true, std::memory_order_relaxed);
+        }
+    }
+}
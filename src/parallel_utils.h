@@ -0,0 +1,56 @@
+#pragma once
+
+#include "common.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline constexpr std::size_t MAX_WORKER_THREADS = 256;
+
+// Resolves a user-requested thread count: 0 means one per hardware thread.
+// The result is clamped to [1, MAX_WORKER_THREADS].
+[[nodiscard]] std::size_t resolveWorkerThreads(std::size_t requested) noexcept;
+
+// Fixed set of worker threads that execute indexed task batches. The calling
+// thread participates in every batch, so a pool of N threads spawns N - 1
+// workers (a pool of 1 runs everything inline). Workers block all signals:
+// cancellation stays with the main thread, whose blocking syscalls are the
+// ones that need EINTR, and tasks still poll throwIfSignalCancellationRequested.
+class WorkerPool {
+public:
+    explicit WorkerPool(std::size_t thread_count);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    [[nodiscard]] std::size_t threadCount() const noexcept { return workers_.size() + 1; }
+
+    // Runs task(i) for every i in [0, task_count) and waits for all of them.
+    // The first exception thrown by any task (including SignalCancellation) is
+    // rethrown here after every worker has left the batch; tasks not yet
+    // started when it was thrown are skipped.
+    void run(std::size_t task_count, const std::function<void(std::size_t)>& task);
+
+private:
+    void workerLoop();
+    void drainTasks();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(std::size_t)>* task_{nullptr};
+    std::size_t task_count_{0};
+    std::atomic<std::size_t> next_task_{0};
+    std::atomic<bool> failed_{false};
+    std::exception_ptr error_{};
+    std::size_t generation_{0};
+    std::size_t busy_workers_{0};
+    bool stopping_{false};
+};
@@ -0,0 +1,239 @@
+#include "payload_filter.h"
+#include "file_utils.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+constexpr std::size_t SNIFF_BYTES = 4096;
+constexpr Byte MAX_DELTA_DISTANCE = 16;
+
+[[nodiscard]] uint32_t loadLe32(const Byte* p) noexcept {
+    return static_cast<uint32_t>(p[0]) |
+           (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) |
+           (static_cast<uint32_t>(p[3]) << 24);
+}
+
+void storeLe32(Byte* p, uint32_t value) noexcept {
+    p[0] = static_cast<Byte>(value);
+    p[1] = static_cast<Byte>(value >> 8);
+    p[2] = static_cast<Byte>(value >> 16);
+    p[3] = static_cast<Byte>(value >> 24);
+}
+
+[[nodiscard]] std::size_t readLe(std::span<const Byte> data, std::size_t index, std::size_t length) noexcept {
+    std::size_t value = 0;
+    for (std::size_t i = length; i-- > 0;) {
+        value = (value << 8) | data[index + i];
+    }
+    return value;
+}
+
+[[nodiscard]] bool hasBytesAt(std::span<const Byte> data, std::size_t index, std::string_view bytes) noexcept {
+    return spanHasRange(data, index, bytes.size()) &&
+           std::memcmp(data.data() + index, bytes.data(), bytes.size()) == 0;
+}
+
+// ------------------------------ sniffing -----------------------------------
+
+constexpr PayloadFilter X86_BCJ{PayloadFilterId::x86_bcj, 0};
+constexpr PayloadFilter ARM64_BCJ{PayloadFilterId::arm64_bcj, 0};
+
+[[nodiscard]] PayloadFilter sniffElf(std::span<const Byte> head) {
+    constexpr std::size_t EI_DATA = 5, E_MACHINE = 18;
+    constexpr Byte ELFDATA2LSB = 1;
+    if (!spanHasRange(head, E_MACHINE, 2) || head[EI_DATA] != ELFDATA2LSB) return {};
+    switch (readLe(head, E_MACHINE, 2)) {
+        case 3:   // EM_386
+        case 62:  // EM_X86_64
+            return X86_BCJ;
+        case 183: // EM_AARCH64
+            return ARM64_BCJ;
+        default:
+            return {};
+    }
+}
+
+[[nodiscard]] PayloadFilter sniffPe(std::span<const Byte> head) {
+    constexpr std::size_t E_LFANEW = 0x3C;
+    if (!spanHasRange(head, E_LFANEW, 4)) return {};
+    const std::size_t pe_offset = readLe(head, E_LFANEW, 4);
+    if (!hasBytesAt(head, pe_offset, std::string_view("PE\0\0", 4)) || !spanHasRange(head, pe_offset + 4, 2)) {
+        return {};
+    }
+    switch (readLe(head, pe_offset + 4, 2)) {
+        case 0x014C:  // IMAGE_FILE_MACHINE_I386
+        case 0x8664:  // IMAGE_FILE_MACHINE_AMD64
+            return X86_BCJ;
+        case 0xAA64:  // IMAGE_FILE_MACHINE_ARM64
+            return ARM64_BCJ;
+        default:
+            return {};
+    }
+}
+
+[[nodiscard]] PayloadFilter sniffMachO(std::span<const Byte> head) {
+    if (!spanHasRange(head, 4, 4)) return {};
+    switch (readLe(head, 4, 4)) {
+        case 0x00000007:  // CPU_TYPE_X86
+        case 0x01000007:  // CPU_TYPE_X86_64
+            return X86_BCJ;
+        case 0x0100000C:  // CPU_TYPE_ARM64
+            return ARM64_BCJ;
+        default:
+            return {};
+    }
+}
+
+// Integer PCM, plain or WAVE_FORMAT_EXTENSIBLE: delta by the frame size
+// (block align), so each sample is taken from the same channel's last one.
+[[nodiscard]] PayloadFilter sniffWav(std::span<const Byte> head) {
+    constexpr std::size_t CHUNK_HEADER_BYTES = 8, FMT_MIN_BYTES = 16;
+    std::size_t pos = 12;
+    while (spanHasRange(head, pos, CHUNK_HEADER_BYTES)) {
+        const std::size_t chunk_size = readLe(head, pos + 4, 4);
+        if (hasBytesAt(head, pos, "fmt ")) {
+            if (chunk_size < FMT_MIN_BYTES || !spanHasRange(head, pos + CHUNK_HEADER_BYTES, FMT_MIN_BYTES)) return {};
+            const std::size_t format = readLe(head, pos + 8, 2);
+            const std::size_t block_align = readLe(head, pos + 20, 2);
+            if ((format != 0x0001 && format != 0xFFFE) || block_align == 0 || block_align > MAX_DELTA_DISTANCE) {
+                return {};
+            }
+            return PayloadFilter{PayloadFilterId::delta, static_cast<Byte>(block_align)};
+        }
+        pos += CHUNK_HEADER_BYTES + chunk_size + (chunk_size & 1);
+    }
+    return {};
+}
+
+[[nodiscard]] PayloadFilter sniffPayloadFilter(std::span<const Byte> head) {
+    if (hasBytesAt(head, 0, "\x7F" "ELF")) return sniffElf(head);
+    if (hasBytesAt(head, 0, "MZ")) return sniffPe(head);
+    if (hasBytesAt(head, 0, "\xCF\xFA\xED\xFE") || hasBytesAt(head, 0, "\xCE\xFA\xED\xFE")) return sniffMachO(head);
+    if (hasBytesAt(head, 0, "RIFF") && hasBytesAt(head, 8, "WAVE")) return sniffWav(head);
+    return {};
+}
+
+// ------------------------------- filters -----------------------------------
+
+// x86: an E8/E9 whose rel32 is a plausible near target (top byte 0x00 or
+// 0xFF, i.e. within +/-16 MiB) has it rewritten as (target mod 2^25), sign
+// extended the same way. The top byte keeps its 0x00/0xFF form, so restore
+// picks out exactly the same instructions. The scan always steps over all
+// four operand bytes, converted or not: otherwise a later conversion could
+// rewrite bytes an earlier decision looked at, and restore would diverge.
+void x86Bcj(std::span<Byte> block, std::size_t block_offset, bool encode) noexcept {
+    constexpr uint32_t ADDRESS_MASK = 0x01FFFFFF, SIGN_BIT = 0x01000000;
+    std::size_t i = 0;
+    while (i + 5 <= block.size()) {
+        const Byte opcode = block[i];
+        if (opcode != 0xE8 && opcode != 0xE9) {
+            ++i;
+            continue;
+        }
+        const uint32_t operand = loadLe32(block.data() + i + 1);
+        const uint32_t top = operand >> 24;
+        if (top == 0x00 || top == 0xFF) {
+            const auto next_ip = static_cast<uint32_t>(block_offset + i + 5);
+            uint32_t value = encode ? operand + next_ip : operand - next_ip;
+            value &= ADDRESS_MASK;
+            if (value & SIGN_BIT) value |= ~ADDRESS_MASK;
+            storeLe32(block.data() + i + 1, value);
+        }
+        i += 5;
+    }
+}
+
+// ARM64: BL imm26 counts instructions from its own address.
+void arm64Bcj(std::span<Byte> block, std::size_t block_offset, bool encode) noexcept {
+    constexpr uint32_t BL_MASK = 0xFC000000, BL_OPCODE = 0x94000000, IMM26_MASK = 0x03FFFFFF;
+    for (std::size_t i = 0; i + 4 <= block.size(); i += 4) {
+        const uint32_t insn = loadLe32(block.data() + i);
+        if ((insn & BL_MASK) != BL_OPCODE) continue;
+        const auto pc = static_cast<uint32_t>((block_offset + i) >> 2);
+        const uint32_t imm = encode ? insn + pc : insn - pc;
+        storeLe32(block.data() + i, BL_OPCODE | (imm & IMM26_MASK));
+    }
+}
+
+void deltaEncode(std::span<Byte> block, std::size_t distance) noexcept {
+    for (std::size_t i = block.size(); i-- > distance;) {
+        block[i] = static_cast<Byte>(block[i] - block[i - distance]);
+    }
+}
+
+void deltaDecode(std::span<Byte> block, std::size_t distance) noexcept {
+    for (std::size_t i = distance; i < block.size(); ++i) {
+        block[i] = static_cast<Byte>(block[i] + block[i - distance]);
+    }
+}
+
+void filterBlocks(const PayloadFilter& filter, std::span<Byte> data, std::size_t stream_offset, bool encode) {
+    if (!filter.active() || data.empty()) return;
+    if (stream_offset % PAYLOAD_FILTER_BLOCK_SIZE != 0) {
+        throw std::logic_error("payload filter: offset is not block aligned");
+    }
+    for (std::size_t pos = 0; pos < data.size(); pos += PAYLOAD_FILTER_BLOCK_SIZE) {
+        const std::span<Byte> block = data.subspan(pos, std::min(PAYLOAD_FILTER_BLOCK_SIZE, data.size() - pos));
+        switch (filter.id) {
+            case PayloadFilterId::x86_bcj:
+                x86Bcj(block, stream_offset + pos, encode);
+                break;
+            case PayloadFilterId::arm64_bcj:
+                arm64Bcj(block, stream_offset + pos, encode);
+                break;
+            case PayloadFilterId::delta:
+                encode ? deltaEncode(block, filter.param) : deltaDecode(block, filter.param);
+                break;
+            case PayloadFilterId::none:
+                break;
+        }
+    }
+}
+} // namespace
+
+bool isSupportedPayloadFilter(const PayloadFilter& filter) noexcept {
+    switch (filter.id) {
+        case PayloadFilterId::none:
+        case PayloadFilterId::x86_bcj:
+        case PayloadFilterId::arm64_bcj:
+            return filter.param == 0;
+        case PayloadFilterId::delta:
+            return filter.param >= 1 && filter.param <= MAX_DELTA_DISTANCE;
+    }
+    return false;
+}
+
+PayloadFilter choosePayloadFilter(const fs::path& path, std::size_t file_size) {
+    std::array<Byte, SNIFF_BYTES> head{};
+    const std::size_t head_size = std::min(file_size, head.size());
+    std::ifstream input = openBinaryInputOrThrow(
+        path,
+        std::format("Failed to open file for compression: {}", path.string()));
+    readExactOrThrow(input, head.data(), head_size, "Read Error: Failed to read data file.");
+    return sniffPayloadFilter(std::span<const Byte>(head.data(), head_size));
+}
+
+std::string_view payloadFilterName(const PayloadFilter& filter) noexcept {
+    switch (filter.id) {
+        case PayloadFilterId::x86_bcj:   return "x86 branch converter";
+        case PayloadFilterId::arm64_bcj: return "ARM64 branch converter";
+        case PayloadFilterId::delta:     return "delta";
+        case PayloadFilterId::none:      break;
+    }
+    return "none";
+}
+
+void applyPayloadFilter(const PayloadFilter& filter, std::span<Byte> data, std::size_t stream_offset) {
+    filterBlocks(filter, data, stream_offset, true);
+}
+
+void reversePayloadFilter(const PayloadFilter& filter, std::span<Byte> data, std::size_t stream_offset) {
+    filterBlocks(filter, data, stream_offset, false);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "common.h"
+
+#include <span>
+#include <string_view>
+
+// Reversible transforms applied to the data file before compression, so that
+// deflate (or zstd) sees more repetition:
+//   - x86 BCJ:   the rel32 operand of E8/E9 call/jmp becomes an absolute
+//                address, so repeated calls to one function repeat bytes.
+//   - ARM64 BCJ: the same for the imm26 of BL.
+//   - delta:     each byte minus the byte `distance` before it, for PCM audio
+//                and similar fixed-width sample data.
+// The data is filtered in independent PAYLOAD_FILTER_BLOCK_SIZE blocks (an
+// instruction that straddles two blocks is left alone), so any block-aligned
+// piece can be filtered or restored on its own: per compression window, per
+// member, or as recover streams the output.
+inline constexpr std::size_t PAYLOAD_FILTER_BLOCK_SIZE = 64 * 1024;
+
+enum class PayloadFilterId : Byte {
+    none      = 0,
+    x86_bcj   = 1,
+    arm64_bcj = 2,
+    delta     = 3
+};
+
+struct PayloadFilter {
+    PayloadFilterId id{PayloadFilterId::none};
+    Byte param{0};  // delta: the distance in bytes (1-16); otherwise 0.
+
+    [[nodiscard]] bool active() const noexcept { return id != PayloadFilterId::none; }
+};
+
+// Whether id/param name a filter this build can undo.
+[[nodiscard]] bool isSupportedPayloadFilter(const PayloadFilter& filter) noexcept;
+
+// Picks a filter from the file's magic bytes: x86/ARM64 ELF, PE and Mach-O
+// executables get BCJ, PCM WAV audio gets delta by its frame size. Anything
+// else, or a file too short to tell, gets none.
+[[nodiscard]] PayloadFilter choosePayloadFilter(const fs::path& path, std::size_t file_size);
+
+[[nodiscard]] std::string_view payloadFilterName(const PayloadFilter& filter) noexcept;
+
+// Filter or restore data in place. stream_offset is the position of data[0]
+// in the whole payload and must be a multiple of PAYLOAD_FILTER_BLOCK_SIZE;
+// data must end on a block boundary unless it is the end of the payload.
+void applyPayloadFilter(const PayloadFilter& filter, std::span<Byte> data, std::size_t stream_offset);
+void reversePayloadFilter(const PayloadFilter& filter, std::span<Byte> data, std::size_t stream_offset);
@@ -0,0 +1,170 @@
+#include "payload_prefix.h"
+#include "binary_io.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+constexpr Byte EXTENDED_PREFIX_FLAG = 0x80;
+constexpr std::size_t MAX_PREFIX_FILENAME_BYTES = EXTENDED_PREFIX_FLAG - 1;
+
+constexpr std::size_t
+    RECORDS_LEN_BYTES    = 2,
+    RECORD_HEADER_BYTES  = 3,
+    MEMBERS_RECORD_BYTES = 12,
+    FILTER_RECORD_BYTES  = 2;
+
+constexpr Byte
+    PREFIX_RECORD_MEMBERS = 0x01,
+    PREFIX_RECORD_FILTER  = 0x02;
+
+// Accepted member sizes on recover. Conceal always writes
+// PAYLOAD_MEMBER_INPUT_SIZE; the ceiling bounds what one worker allocates.
+constexpr std::size_t
+    MIN_MEMBER_INPUT_SIZE = 1  * 1024 * 1024,
+    MAX_MEMBER_INPUT_SIZE = 64 * 1024 * 1024;
+
+constexpr const char* CORRUPT_PREFIX_ERROR = "File Extraction Error: Corrupt encrypted filename metadata.";
+constexpr const char* UNSUPPORTED_PREFIX_ERROR =
+    "File Extraction Error: This file was concealed with a payload format this version of jdvrif does not support.";
+
+[[nodiscard]] std::size_t recordsSize(const PayloadLayout& layout) noexcept {
+    return (layout.hasMembers() ? RECORD_HEADER_BYTES + MEMBERS_RECORD_BYTES : 0) +
+           (layout.filter.active() ? RECORD_HEADER_BYTES + FILTER_RECORD_BYTES : 0);
+}
+} // namespace
+
+std::size_t PayloadLayout::memberCount() const noexcept {
+    if (!hasMembers() || total_input_size == 0) return 0;
+    return (total_input_size - 1) / member_input_size + 1;
+}
+
+std::size_t payloadPrefixSize(std::string_view filename, const PayloadLayout& layout) noexcept {
+    const std::size_t records_size = recordsSize(layout);
+    return 1 + filename.size() + (records_size == 0 ? 0 : RECORDS_LEN_BYTES + records_size);
+}
+
+vBytes encodePayloadPrefix(std::string_view filename, const PayloadLayout& layout) {
+    if (filename.empty() || filename.size() > MAX_PREFIX_FILENAME_BYTES) {
+        throw std::runtime_error("Data File Error: Invalid data filename length.");
+    }
+
+    const std::size_t records_size = recordsSize(layout);
+    vBytes prefix(payloadPrefixSize(filename, layout));
+    prefix[0] = static_cast<Byte>(filename.size() | (records_size == 0 ? 0 : EXTENDED_PREFIX_FLAG));
+    std::memcpy(prefix.data() + 1, filename.data(), filename.size());
+    if (records_size == 0) return prefix;
+
+    std::size_t pos = 1 + filename.size();
+    updateValue(prefix, pos, records_size);
+    pos += RECORDS_LEN_BYTES;
+
+    if (layout.hasMembers()) {
+        prefix[pos] = PREFIX_RECORD_MEMBERS;
+        updateValue(prefix, pos + 1, MEMBERS_RECORD_BYTES);
+        updateValue(prefix, pos + RECORD_HEADER_BYTES, layout.member_input_size, 4);
+        updateValue(prefix, pos + RECORD_HEADER_BYTES + 4, layout.total_input_size, 8);
+        pos += RECORD_HEADER_BYTES + MEMBERS_RECORD_BYTES;
+    }
+    if (layout.filter.active()) {
+        prefix[pos] = PREFIX_RECORD_FILTER;
+        updateValue(prefix, pos + 1, FILTER_RECORD_BYTES);
+        prefix[pos + RECORD_HEADER_BYTES] = static_cast<Byte>(layout.filter.id);
+        prefix[pos + RECORD_HEADER_BYTES + 1] = layout.filter.param;
+    }
+    return prefix;
+}
+
+PayloadPrefixParser::~PayloadPrefixParser() {
+    sodium_memzero(header_.data(), header_.size());
+    sodium_memzero(filename_.data(), filename_.size());
+}
+
+// Prefix length as far as the bytes read so far can tell; it grows as the
+// name length and then the records length become known.
+std::size_t PayloadPrefixParser::bytesNeeded() const {
+    if (header_.empty()) return 1;
+    const std::size_t names_end = 1 + (header_[0] & MAX_PREFIX_FILENAME_BYTES);
+    if ((header_[0] & EXTENDED_PREFIX_FLAG) == 0) return names_end;
+    if (header_.size() < names_end + RECORDS_LEN_BYTES) return names_end + RECORDS_LEN_BYTES;
+    return names_end + RECORDS_LEN_BYTES + getValue(header_, names_end);
+}
+
+std::span<const Byte> PayloadPrefixParser::consume(std::span<const Byte> chunk) {
+    while (!complete_ && !chunk.empty()) {
+        const std::size_t take = std::min(bytesNeeded() - header_.size(), chunk.size());
+        header_.insert(header_.end(), chunk.begin(), chunk.begin() + static_cast<std::ptrdiff_t>(take));
+        chunk = chunk.subspan(take);
+
+        if ((header_[0] & MAX_PREFIX_FILENAME_BYTES) == 0) {
+            throw std::runtime_error(CORRUPT_PREFIX_ERROR);
+        }
+        if (header_.size() < bytesNeeded()) continue;
+
+        const std::size_t name_len = header_[0] & MAX_PREFIX_FILENAME_BYTES;
+        filename_.assign(reinterpret_cast<const char*>(header_.data() + 1), name_len);
+        if ((header_[0] & EXTENDED_PREFIX_FLAG) != 0) {
+            parseRecords();
+        }
+        sodium_memzero(header_.data(), header_.size());
+        header_.clear();
+        complete_ = true;
+    }
+    return complete_ ? chunk : std::span<const Byte>{};
+}
+
+void PayloadPrefixParser::parseRecords() {
+    const std::span<const Byte> header(header_);
+    std::size_t pos = 1 + filename_.size() + RECORDS_LEN_BYTES;
+    bool seen_members = false;
+    bool seen_filter = false;
+
+    while (pos < header.size()) {
+        if (header.size() - pos < RECORD_HEADER_BYTES) {
+            throw std::runtime_error(CORRUPT_PREFIX_ERROR);
+        }
+        const Byte type = header[pos];
+        const std::size_t len = getValue(header, pos + 1);
+        pos += RECORD_HEADER_BYTES;
+        if (header.size() - pos < len) {
+            throw std::runtime_error(CORRUPT_PREFIX_ERROR);
+        }
+
+        switch (type) {
+            case PREFIX_RECORD_MEMBERS:
+                if (seen_members || len != MEMBERS_RECORD_BYTES) {
+                    throw std::runtime_error(CORRUPT_PREFIX_ERROR);
+                }
+                layout_.member_input_size = getValue(header, pos, 4);
+                layout_.total_input_size = getValue(header, pos + 4, 8);
+                if (layout_.member_input_size < MIN_MEMBER_INPUT_SIZE ||
+                    layout_.member_input_size > MAX_MEMBER_INPUT_SIZE ||
+                    layout_.total_input_size == 0) {
+                    throw std::runtime_error(CORRUPT_PREFIX_ERROR);
+                }
+                seen_members = true;
+                break;
+            case PREFIX_RECORD_FILTER:
+                if (seen_filter || len != FILTER_RECORD_BYTES) {
+                    throw std::runtime_error(CORRUPT_PREFIX_ERROR);
+                }
+                layout_.filter = PayloadFilter{static_cast<PayloadFilterId>(header[pos]), header[pos + 1]};
+                if (!layout_.filter.active()) {
+                    throw std::runtime_error(CORRUPT_PREFIX_ERROR);
+                }
+                if (!isSupportedPayloadFilter(layout_.filter)) {
+                    throw std::runtime_error(UNSUPPORTED_PREFIX_ERROR);
+                }
+                seen_filter = true;
+                break;
+            default:
+                throw std::runtime_error(UNSUPPORTED_PREFIX_ERROR);
+        }
+        pos += len;
+    }
+    // Members are unfiltered independently, so each must start on a block.
+    if (seen_members && seen_filter && layout_.member_input_size % PAYLOAD_FILTER_BLOCK_SIZE != 0) {
+        throw std::runtime_error(CORRUPT_PREFIX_ERROR);
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "common.h"
+#include "payload_filter.h"
+
+#include <span>
+#include <string>
+#include <string_view>
+
+// Plaintext that precedes the payload inside the encrypted stream:
+//
+//   [name_len][name]                                       original layout
+//   [0x80 | name_len][name][records_len:u16][records...]   extended layout
+//
+// Each record is [type:u8][len:u16][value], all integers big-endian. Names are
+// at most 20 bytes, so the top bit of name_len was always clear and now marks
+// the extended layout. A payload that needs no records keeps the original
+// layout byte for byte, so older releases still recover it. The records are
+// authenticated with the rest of the stream; an unknown type is refused rather
+// than skipped, because each one changes how the payload must be decoded.
+
+// Filter (PREFIX_RECORD_FILTER): the payload was passed through a
+// payload_filter.h filter before compression; recover reverses it after.
+
+// Member framing: the compressed payload is a run of complete, independently
+// decodable zlib streams, each preceded by its big-endian u32 length. Member i
+// inflates to member_input_size bytes (the last one to the remainder) and
+// belongs at output offset i * member_input_size, so recover can inflate
+// members in parallel and write each in place.
+inline constexpr std::size_t PAYLOAD_MEMBER_INPUT_SIZE = 16 * 1024 * 1024;
+
+struct PayloadLayout {
+    std::size_t member_input_size{0};  // 0 = one compressed stream (original layout).
+    std::size_t total_input_size{0};   // Uncompressed payload size; set with members.
+    PayloadFilter filter{};            // Applied before compression.
+
+    [[nodiscard]] bool hasMembers() const noexcept { return member_input_size != 0; }
+    [[nodiscard]] std::size_t memberCount() const noexcept;
+};
+
+[[nodiscard]] std::size_t payloadPrefixSize(std::string_view filename, const PayloadLayout& layout) noexcept;
+
+[[nodiscard]] vBytes encodePayloadPrefix(std::string_view filename, const PayloadLayout& layout);
+
+// Reads the prefix from the front of the decrypted stream, which may arrive
+// split at any byte. Wipes the filename bytes it held on destruction.
+class PayloadPrefixParser {
+public:
+    PayloadPrefixParser() = default;
+    PayloadPrefixParser(const PayloadPrefixParser&) = delete;
+    PayloadPrefixParser& operator=(const PayloadPrefixParser&) = delete;
+    ~PayloadPrefixParser();
+
+    // Takes prefix bytes from the front of chunk and returns the rest, which
+    // is payload. Returns an empty span until the prefix is complete.
+    [[nodiscard]] std::span<const Byte> consume(std::span<const Byte> chunk);
+
+    [[nodiscard]] bool isComplete() const noexcept { return complete_; }
+    [[nodiscard]] const std::string& filename() const noexcept { return filename_; }
+    [[nodiscard]] const PayloadLayout& layout() const noexcept { return layout_; }
+
+private:
+    [[nodiscard]] std::size_t bytesNeeded() const;
+    void parseRecords();
+
+    vBytes header_{};
+    std::string filename_{};
+    PayloadLayout layout_{};
+    bool complete_{false};
+};
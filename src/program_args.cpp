@@ -1,6 +1,12 @@
 #include "program_args.h"
+#include "parallel_utils.h"
 
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
 #include <format>
+#include <optional>
 #include <print>
 #include <stdexcept>
 #include <string_view>
@@ -12,11 +18,11 @@ constexpr std::string_view INFO_TEXT =
     "any file type within and from a JPG image.\n\n"
     "──────────────────────────\nCompile & run (Linux)\n──────────────────────────\n\n"
     "  $ sudo apt update\n"
-    "  $ sudo apt install g++ cmake ninja-build util-linux libsodium-dev libturbojpeg0-dev zlib1g-dev libdeflate-dev\n\n"
+    "  $ sudo apt install g++ cmake ninja-build util-linux libsodium-dev libturbojpeg0-dev zlib1g-dev libdeflate-dev libzstd-dev\n\n"
     "  $ chmod +x compile_jdvrif.sh\n  $ ./compile_jdvrif.sh\n\n"
     "  $ sudo cp jdvrif /usr/bin\n  $ jdvrif\n\n"
     "──────────────────────────\nUsage\n──────────────────────────\n\n"
-    "  jdvrif conceal [-b] <cover_image> <secret_file>\n  jdvrif recover <cover_image>\n  jdvrif --info\n\n"
+    "  jdvrif conceal [-b] [--codec zlib|zstd] [--cipher xchacha20|aes256gcm] [--frame-size F] [--kdf-ops N] [--kdf-mem M] [--threads N] [--time-budget S] [--target P] [--dictionary] [--indexed] [--stats] <cover_image> <secret_file>\n  jdvrif conceal-batch [conceal options] <cover_image> <secret_file>...\n  jdvrif recover [--threads N] <cover_image>\n  jdvrif verify [--threads N] <cover_image>\n  jdvrif bench-cipher\n  jdvrif calibrate-kdf [--target-ms N]\n  jdvrif --info\n\n"
     "──────────────────────────\nPlatform compatibility & size limits\n──────────────────────────\n\n"
     "Share your \"file-embedded\" JPG image on the following compatible sites.\n\n"
     "Platforms where size limit is measured by the combined size of cover image + compressed data file:\n\n"
@@ -38,10 +44,50 @@ constexpr std::string_view INFO_TEXT =
     "compress especially well, such as text files.\n\n"
     "──────────────────────────\nModes\n──────────────────────────\n\n"
     "conceal - *Compresses, encrypts and embeds your secret data file within a JPG cover image.\n"
+    "conceal-batch - Conceals each secret file in its own copy of the cover image, all under one\n"
+    "                recovery PIN, so the key derivation runs once for the whole batch. Each image\n"
+    "                still recovers on its own. Older jdvrif releases cannot recover these images.\n"
     "recover - Decrypts, uncompresses and extracts the concealed data file from a JPG cover image\n"
-    "          (recovery PIN required).\n\n"
-    "(*Compression: If data file is already a compressed file type (based on file extension: e.g. \".zip\")\n"
-    " and the file is greater than 10MB, skip compression).\n\n"
+    "          (recovery PIN required).\n"
+    "verify - Checks, without writing anything, that the concealed data file is intact and that the\n"
+    "         recovery PIN is right: every frame is decrypted and authenticated, then discarded.\n"
+    "         Reports the file's name and size. Useful after an image has been through a platform.\n"
+    "bench-cipher - Measures each cipher on this machine and reports which one is faster.\n"
+    "calibrate-kdf - Times the key derivation on this machine and suggests --kdf-ops and --kdf-mem\n"
+    "                values that take about N milliseconds (--target-ms N, default 500).\n\n"
+    "(*Compression: jdvrif samples the data file first (magic bytes, entropy and a quick trial\n"
+    " compression). If it is already compressed or encrypted data, compression is skipped.\n"
+    " Executables (x86/ARM64 ELF, PE, Mach-O) and PCM WAV audio first go through a reversible filter\n"
+    " that makes them compress better. Older jdvrif releases cannot recover images made from these).\n\n"
+    "--codec zstd : Compress with Zstandard instead of zlib. Much faster for large files, at an equal or\n"
+    "               better ratio. Not available with -b. Older jdvrif releases cannot recover these images.\n"
+    "--cipher aes256gcm : Encrypt with AES-256-GCM instead of XChaCha20-Poly1305. Only on CPUs with\n"
+    "                     hardware AES (AES-NI, ARMv8 Crypto), where it is usually faster; recover needs\n"
+    "                     the same. Older jdvrif releases cannot recover these images.\n"
+    "--frame-size F : Encrypt in frames of F bytes, a power of two from 64K to 16M (e.g. 256K, 4M).\n"
+    "                 Default: 1M, or 4M for data files over 256 MB. Recover uses the same size, so\n"
+    "                 smaller frames suit low-memory machines. Older jdvrif releases cannot recover these.\n"
+    "--kdf-ops N, --kdf-mem M : Argon2id cost of turning the recovery PIN into the key: N passes (1-16,\n"
+    "                           default 2) over M bytes of memory, a power of two from 16M to 1G\n"
+    "                           (default 64M). Recorded in the image; recover needs the same time and\n"
+    "                           memory. See calibrate-kdf. Older jdvrif releases cannot recover these.\n"
+    "--threads N : Number of threads used to compress and encrypt the data file and write the image\n"
+    "              (default: one per CPU core). Also accepted by recover and verify, where it limits\n"
+    "              the threads that extract, decrypt and decompress.\n"
+    "--time-budget S : Pick the highest zlib compression level whose projected time, measured by trial\n"
+    "                  compressions on this machine, fits in S seconds. Not available with --codec zstd.\n"
+    "--target P : Use the cheapest zlib compression level that makes the output image fit platform P\n"
+    "             (X-Twitter, Tumblr, Mastodon, Pixelfed, PostImage, ImgBB, ImgPile or Flickr), or fail\n"
+    "             before encrypting if none does. Not available with -b, --codec zstd or --time-budget.\n"
+    "--dictionary : Also compress data files of up to 1 MB against built-in dictionaries for prose and\n"
+    "               for structured text (JSON, YAML, TOML, XML, HTML), and keep the smallest result.\n"
+    "               Implied by --target. Not available with --codec zstd or --indexed. Older jdvrif\n"
+    "               releases cannot recover images that used a dictionary.\n"
+    "--indexed  : Split a large zlib payload into independently compressed 16 MB members, so that\n"
+    "             recover can decompress them on every CPU core. Not available with -b, --codec zstd\n"
+    "             or --target. Older jdvrif releases cannot recover these images.\n"
+    "--stats     : Report conceal statistics, such as why compression was used or skipped, and\n"
+    "              the write calls that produced the output image.\n\n"
     "──────────────────────────\nPlatform options for conceal mode\n──────────────────────────\n\n"
     "-b (Bluesky) : Creates compatible \"file-embedded\" JPG images for posting on Bluesky.\n\n"
     "$ jdvrif conceal -b my_image.jpg hidden.doc\n\n"
@@ -97,21 +143,225 @@ constexpr std::string_view INFO_TEXT =
     const std::string prog = programName(argc, argv);
     const std::string indent(PREFIX.size(), ' ');
     return std::format(
-        "{0}{1} conceal [-b] <cover_image> <secret_file>\n"
-        "{2}{1} recover <cover_image>\n"
+        "{0}{1} conceal [-b] [--codec zlib|zstd] [--cipher xchacha20|aes256gcm] [--frame-size F] [--kdf-ops N] [--kdf-mem M] [--threads N] [--time-budget S] [--target P] [--dictionary] [--indexed] [--stats] <cover_image> <secret_file>\n"
+        "{2}{1} conceal-batch [conceal options] <cover_image> <secret_file>...\n"
+        "{2}{1} recover [--threads N] <cover_image>\n"
+        "{2}{1} verify [--threads N] <cover_image>\n"
+        "{2}{1} bench-cipher\n"
+        "{2}{1} calibrate-kdf [--target-ms N]\n"
         "{2}{1} --info",
         PREFIX,
         prog,
         indent);
 }
 
-[[nodiscard]] bool parseConcealOption(std::string_view arg, Option& option) {
+[[nodiscard]] PayloadCodec parseCodec(std::string_view value) {
+    if (value == "zlib") return PayloadCodec::zlib;
+    if (value == "zstd") return PayloadCodec::zstd;
+    throw std::runtime_error("Invalid Input Error: --codec expects \"zlib\" or \"zstd\".");
+}
+
+[[nodiscard]] CipherSuite parseCipher(std::string_view value) {
+    if (value == "xchacha20") return CipherSuite::xchacha20poly1305;
+    if (value == "aes256gcm") return CipherSuite::aes256gcm;
+    throw std::runtime_error("Invalid Input Error: --cipher expects \"xchacha20\" or \"aes256gcm\".");
+}
+
+// A byte count with an optional K, M or G suffix (KiB, MiB, GiB); nullopt if
+// it does not parse or exceeds `max`.
+[[nodiscard]] std::optional<std::size_t> parseByteSize(std::string_view value, std::size_t max) {
+    std::size_t unit = 1;
+    if (!value.empty()) {
+        switch (value.back()) {
+            case 'K': case 'k': unit = std::size_t{1} << 10; break;
+            case 'M': case 'm': unit = std::size_t{1} << 20; break;
+            case 'G': case 'g': unit = std::size_t{1} << 30; break;
+            default: break;
+        }
+        if (unit != 1) value.remove_suffix(1);
+    }
+    std::size_t count = 0;
+    const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), count);
+    if (value.empty() || ec != std::errc{} || ptr != value.data() + value.size() || count > max / unit) {
+        return std::nullopt;
+    }
+    return count * unit;
+}
+
+// A power of two with an optional K or M suffix (KiB, MiB).
+[[nodiscard]] std::size_t parseFrameSize(std::string_view value) {
+    const std::optional<std::size_t> frame_size = parseByteSize(value, MAX_STREAM_FRAME_SIZE);
+    if (!frame_size || *frame_size < MIN_STREAM_FRAME_SIZE || !std::has_single_bit(*frame_size)) {
+        throw std::runtime_error(
+            "Invalid Input Error: --frame-size expects a power of two from 64K to 16M, such as 256K or 4M.");
+    }
+    return *frame_size;
+}
+
+[[nodiscard]] std::size_t parseKdfOps(std::string_view value) {
+    std::size_t ops = 0;
+    const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), ops);
+    if (value.empty() || ec != std::errc{} || ptr != value.data() + value.size() ||
+        ops < MIN_KDF_OPSLIMIT || ops > MAX_KDF_OPSLIMIT) {
+        throw std::runtime_error(std::format(
+            "Invalid Input Error: --kdf-ops expects a whole number from {} to {}.", MIN_KDF_OPSLIMIT, MAX_KDF_OPSLIMIT));
+    }
+    return ops;
+}
+
+[[nodiscard]] std::size_t parseKdfMemory(std::string_view value) {
+    const std::optional<std::size_t> memory = parseByteSize(value, MAX_KDF_MEMLIMIT);
+    if (!memory || *memory < MIN_KDF_MEMLIMIT || !std::has_single_bit(*memory)) {
+        throw std::runtime_error(
+            "Invalid Input Error: --kdf-mem expects a power of two from 16M to 1G, such as 32M or 256M.");
+    }
+    return *memory;
+}
+
+[[nodiscard]] std::size_t parseTargetMilliseconds(std::string_view value) {
+    std::size_t ms = 0;
+    const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), ms);
+    if (value.empty() || ec != std::errc{} || ptr != value.data() + value.size() ||
+        ms < MIN_KDF_TARGET_MS || ms > MAX_KDF_TARGET_MS) {
+        throw std::runtime_error(std::format(
+            "Invalid Input Error: --target-ms expects a whole number of milliseconds from {} to {}.",
+            MIN_KDF_TARGET_MS, MAX_KDF_TARGET_MS));
+    }
+    return ms;
+}
+
+[[nodiscard]] std::size_t parseThreadCount(std::string_view value) {
+    std::size_t threads = 0;
+    const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), threads);
+    if (value.empty() || ec != std::errc{} || ptr != value.data() + value.size() ||
+        threads == 0 || threads > MAX_WORKER_THREADS) {
+        throw std::runtime_error(std::format(
+            "Invalid Input Error: --threads expects a whole number from 1 to {}.", MAX_WORKER_THREADS));
+    }
+    return threads;
+}
+
+[[nodiscard]] double parseTimeBudget(std::string_view value) {
+    double seconds = 0.0;
+    const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), seconds);
+    if (value.empty() || ec != std::errc{} || ptr != value.data() + value.size() ||
+        !std::isfinite(seconds) || seconds <= 0.0) {
+        throw std::runtime_error("Invalid Input Error: --time-budget expects a number of seconds greater than 0.");
+    }
+    return seconds;
+}
+
+// Case-insensitive, so "x-twitter" and "tumblr" work; returns the table's own
+// spelling, which is what the platform report matches on.
+[[nodiscard]] std::string_view parseTargetPlatform(std::string_view value) {
+    const auto lower = [](char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    };
+    for (const PlatformLimits& limits : PLATFORM_LIMITS) {
+        if (std::ranges::equal(limits.name, value, {}, lower, lower)) {
+            return limits.name;
+        }
+    }
+    throw std::runtime_error(
+        "Invalid Input Error: --target expects one of X-Twitter, Tumblr, Mastodon, Pixelfed, "
+        "PostImage, ImgBB, ImgPile or Flickr.");
+}
+
+// Consumes one conceal option (and its value, if any) starting at `index`.
+// Returns false when argv[index] is not an option, i.e. the cover image path.
+[[nodiscard]] bool parseConcealOption(int argc, char** argv, int& index, ConcealOptions& options) {
+    const std::string_view arg = argAt(argc, argv, index);
     if (arg == "-b") {
-        option = Option::Bluesky;
+        options.option = Option::Bluesky;
+        ++index;
+        return true;
+    }
+    if (arg == "--stats") {
+        options.show_stats = true;
+        ++index;
+        return true;
+    }
+    if (arg == "--indexed") {
+        options.indexed = true;
+        ++index;
+        return true;
+    }
+    if (arg == "--dictionary") {
+        options.preset_dictionaries = true;
+        ++index;
+        return true;
+    }
+    if (arg == "--codec") {
+        options.codec = parseCodec(argAt(argc, argv, index + 1));
+        index += 2;
+        return true;
+    }
+    if (arg == "--cipher") {
+        options.cipher = parseCipher(argAt(argc, argv, index + 1));
+        index += 2;
+        return true;
+    }
+    if (arg == "--frame-size") {
+        options.frame_size = parseFrameSize(argAt(argc, argv, index + 1));
+        index += 2;
+        return true;
+    }
+    if (arg == "--kdf-ops") {
+        options.kdf.opslimit = parseKdfOps(argAt(argc, argv, index + 1));
+        index += 2;
+        return true;
+    }
+    if (arg == "--kdf-mem") {
+        options.kdf.memlimit = parseKdfMemory(argAt(argc, argv, index + 1));
+        index += 2;
+        return true;
+    }
+    if (arg == "--threads") {
+        options.threads = parseThreadCount(argAt(argc, argv, index + 1));
+        index += 2;
+        return true;
+    }
+    if (arg == "--target") {
+        options.target_platform = parseTargetPlatform(argAt(argc, argv, index + 1));
+        index += 2;
+        return true;
+    }
+    if (arg == "--time-budget") {
+        options.time_budget_seconds = parseTimeBudget(argAt(argc, argv, index + 1));
+        index += 2;
         return true;
     }
     return false;
 }
+
+// Option combinations conceal and conceal-batch both refuse.
+void validateConcealOptions(const ConcealOptions& options) {
+    if (options.option == Option::Bluesky && options.codec == PayloadCodec::zstd) {
+        throw std::runtime_error("Invalid Input Error: --codec zstd is not supported for Bluesky (-b) images.");
+    }
+    if (options.time_budget_seconds > 0.0 && options.codec == PayloadCodec::zstd) {
+        throw std::runtime_error("Invalid Input Error: --time-budget selects zlib levels and cannot be used with --codec zstd.");
+    }
+    if (!options.target_platform.empty()) {
+        if (options.option == Option::Bluesky ||
+            options.codec == PayloadCodec::zstd ||
+            options.time_budget_seconds > 0.0) {
+            throw std::runtime_error(
+                "Invalid Input Error: --target cannot be combined with -b, --codec zstd or --time-budget.");
+        }
+    }
+    if (options.indexed &&
+        (options.option == Option::Bluesky ||
+         options.codec == PayloadCodec::zstd ||
+         !options.target_platform.empty())) {
+        throw std::runtime_error(
+            "Invalid Input Error: --indexed cannot be combined with -b, --codec zstd or --target.");
+    }
+    if (options.preset_dictionaries && (options.codec == PayloadCodec::zstd || options.indexed)) {
+        throw std::runtime_error(
+            "Invalid Input Error: --dictionary cannot be combined with --codec zstd or --indexed.");
+    }
+}
 } // namespace
 
 void displayInfo() {
@@ -135,26 +385,67 @@ std::optional<ProgramArgs> ProgramArgs::parse(int argc, char** argv) {
 
     if (mode == "conceal") {
         int image_index = 2;
-
-        if (parseConcealOption(argAt(argc, argv, image_index), out.option)) {
-            ++image_index;
+        while (image_index < argc &&
+               parseConcealOption(argc, argv, image_index, out.conceal_options)) {
         }
 
         if (argc != image_index + 2) {
             die(usage);
         }
+        validateConcealOptions(out.conceal_options);
 
         out.image_file_path = argAt(argc, argv, image_index);
         out.data_file_path = argAt(argc, argv, image_index + 1);
         return out;
     }
 
-    if (mode == "recover") {
-        if (argc != 3) {
+    if (mode == "conceal-batch") {
+        int image_index = 2;
+        while (image_index < argc &&
+               parseConcealOption(argc, argv, image_index, out.conceal_options)) {
+        }
+
+        if (argc < image_index + 2) {
+            die(usage);
+        }
+        validateConcealOptions(out.conceal_options);
+
+        out.mode = Mode::conceal_batch;
+        out.image_file_path = argAt(argc, argv, image_index);
+        for (int i = image_index + 1; i < argc; ++i) {
+            out.data_file_paths.emplace_back(argAt(argc, argv, i));
+        }
+        return out;
+    }
+
+    if (mode == "recover" || mode == "verify") {
+        int image_index = 2;
+        if (argc == 5 && argAt(argc, argv, 2) == "--threads") {
+            out.threads = parseThreadCount(argAt(argc, argv, 3));
+            image_index = 4;
+        } else if (argc != 3) {
+            die(usage);
+        }
+        out.mode = mode == "recover" ? Mode::recover : Mode::verify;
+        out.image_file_path = argAt(argc, argv, image_index);
+        return out;
+    }
+
+    if (mode == "bench-cipher") {
+        if (argc != 2) {
+            die(usage);
+        }
+        out.mode = Mode::bench_cipher;
+        return out;
+    }
+
+    if (mode == "calibrate-kdf") {
+        if (argc == 4 && argAt(argc, argv, 2) == "--target-ms") {
+            out.kdf_target_ms = parseTargetMilliseconds(argAt(argc, argv, 3));
+        } else if (argc != 2) {
             die(usage);
         }
-        out.mode = Mode::recover;
-        out.image_file_path = argAt(argc, argv, 2);
+        out.mode = Mode::calibrate_kdf;
         return out;
     }
 
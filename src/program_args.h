@@ -1,17 +1,22 @@
 #pragma once
 
 #include "common.h"
+#include "kdf_calibrate.h"
 
 #include <optional>
 #include <string>
+#include <vector>
 
 void displayInfo();
 
 struct ProgramArgs {
     Mode mode{Mode::conceal};
-    Option option{Option::None};
+    ConcealOptions conceal_options{};
     fs::path image_file_path;
     fs::path data_file_path;
+    std::vector<fs::path> data_file_paths;             // conceal-batch only.
+    std::size_t kdf_target_ms{DEFAULT_KDF_TARGET_MS};  // calibrate-kdf only.
+    std::size_t threads{0};                            // recover and verify only.
 
     static std::optional<ProgramArgs> parse(int argc, char** argv);
 
@@ -0,0 +1,190 @@
+#include "read_ahead.h"
+#include "signal_utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <stdexcept>
+#include <utility>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+namespace {
+// How often a consumer waiting on the reader checks for a pending signal.
+constexpr auto SIGNAL_POLL_INTERVAL = std::chrono::milliseconds(100);
+} // namespace
+
+ReadAheadFile::ReadAheadFile(const fs::path& path, const char* open_error, const char* read_error)
+    : read_error_(read_error) {
+    start(path, open_error);
+}
+
+ReadAheadFile::ReadAheadFile(const fs::path& path, std::vector<FileExtent> extents,
+                             const char* open_error, const char* read_error)
+    : read_error_(read_error), ranged_(true), extents_(std::move(extents)) {
+    std::erase_if(extents_, [](const FileExtent& extent) { return extent.size == 0; });
+    start(path, open_error);
+}
+
+void ReadAheadFile::start(const fs::path& path, const char* open_error) {
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        throw std::runtime_error(open_error);
+    }
+    (void)::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    try {
+        for (Block& block : blocks_) {
+            block.data.resize(READ_AHEAD_BLOCK_SIZE);
+        }
+        reader_ = std::thread([this] { readerLoop(); });
+    } catch (...) {
+        ::close(fd_);
+        throw;
+    }
+}
+
+ReadAheadFile::~ReadAheadFile() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    free_cv_.notify_all();
+    if (reader_.joinable()) reader_.join();
+    for (Block& block : blocks_) {
+        sodium_memzero(block.data.data(), block.data.size());
+    }
+    ::close(fd_);
+}
+
+void ReadAheadFile::readerLoop() {
+    sigset_t blocked;
+    sigfillset(&blocked);
+    (void)::pthread_sigmask(SIG_BLOCK, &blocked, nullptr);
+
+    while (true) {
+        std::size_t index = 0;
+        {
+            std::unique_lock lock(mutex_);
+            free_cv_.wait(lock, [this] { return stopping_ || in_use_ < blocks_.size(); });
+            if (stopping_) return;
+            index = write_index_;
+        }
+
+        // Fill the whole block: a short block only ever means end of file.
+        Block& block = blocks_[index];
+        std::size_t got = 0;
+        const bool failed = !fill(block.data.data(), block.data.size(), got);
+
+        std::lock_guard lock(mutex_);
+        if (failed) {
+            sodium_memzero(block.data.data(), got);
+            error_ = std::make_exception_ptr(std::runtime_error(read_error_));
+        } else if (got > 0) {
+            block.size = got;
+            write_index_ = (index + 1) % blocks_.size();
+            ++filled_count_;
+            ++in_use_;
+        }
+        if (failed || got < block.data.size()) {
+            eof_ = true;
+        }
+        filled_cv_.notify_one();
+        if (eof_) return;
+    }
+}
+
+bool ReadAheadFile::fill(Byte* dst, std::size_t size, std::size_t& got) {
+    got = 0;
+    while (got < size) {
+        std::size_t want = size - got;
+        ssize_t n = 0;
+        if (ranged_) {
+            if (extent_index_ == extents_.size()) return true;
+            const FileExtent& extent = extents_[extent_index_];
+            want = std::min(want, extent.size - extent_pos_);
+            n = ::pread(fd_, dst + got, want, static_cast<off_t>(extent.offset + extent_pos_));
+            if (n == 0) return false;  // The extent runs past the end of the file.
+        } else {
+            n = ::read(fd_, dst + got, want);
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) return true;
+        got += static_cast<std::size_t>(n);
+        if (ranged_) {
+            extent_pos_ += static_cast<std::size_t>(n);
+            if (extent_pos_ == extents_[extent_index_].size) {
+                ++extent_index_;
+                extent_pos_ = 0;
+            }
+        }
+    }
+    return true;
+}
+
+void ReadAheadFile::releaseCurrent() {
+    if (current_ == nullptr) return;
+    sodium_memzero(current_->data.data(), current_->size);
+    current_->size = 0;
+    current_pos_ = 0;
+    {
+        std::lock_guard lock(mutex_);
+        current_ = nullptr;
+        --in_use_;
+    }
+    free_cv_.notify_one();
+}
+
+bool ReadAheadFile::acquireNext() {
+    releaseCurrent();
+    std::unique_lock lock(mutex_);
+    while (filled_count_ == 0 && !eof_ && !error_) {
+        filled_cv_.wait_for(lock, SIGNAL_POLL_INTERVAL);
+        throwIfSignalCancellationRequested();
+    }
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+    if (filled_count_ == 0) {
+        return false;
+    }
+    current_ = &blocks_[read_index_];
+    read_index_ = (read_index_ + 1) % blocks_.size();
+    --filled_count_;
+    return true;
+}
+
+std::span<const Byte> ReadAheadFile::next() {
+    if (current_ == nullptr || current_pos_ == current_->size) {
+        if (!acquireNext()) return {};
+    }
+    const std::span<const Byte> rest(current_->data.data() + current_pos_, current_->size - current_pos_);
+    current_pos_ = current_->size;
+    consumed_ += rest.size();
+    return rest;
+}
+
+bool ReadAheadFile::readExact(Byte* dst, std::size_t size) {
+    while (size > 0) {
+        if (current_ == nullptr || current_pos_ == current_->size) {
+            if (!acquireNext()) return false;
+        }
+        const std::size_t take = std::min(size, current_->size - current_pos_);
+        std::copy_n(current_->data.data() + current_pos_, take, dst);
+        current_pos_ += take;
+        consumed_ += take;
+        dst += take;
+        size -= take;
+    }
+    return true;
+}
+
+bool ReadAheadFile::atEnd() {
+    if (current_ != nullptr && current_pos_ < current_->size) return false;
+    return !acquireNext();
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "common.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+inline constexpr std::size_t
+    READ_AHEAD_BLOCK_SIZE  = 1 * 1024 * 1024,
+    READ_AHEAD_BLOCK_COUNT = 3;
+
+// One byte range of a file.
+struct FileExtent {
+    std::size_t offset{0};
+    std::size_t size{0};
+};
+
+// Sequential reader that keeps a background thread READ_AHEAD_BLOCK_COUNT
+// blocks ahead of the consumer, so reading the next part of the file overlaps
+// with sealing or opening the current one. The blocks are allocated once and
+// recycled; each is wiped with sodium_memzero before the reader may refill it,
+// and all of them again on destruction. The reader thread blocks all signals
+// (as WorkerPool workers do) and the consumer polls
+// throwIfSignalCancellationRequested while it waits.
+class ReadAheadFile {
+public:
+    ReadAheadFile(const fs::path& path, const char* open_error, const char* read_error);
+
+    // Reads only the given ranges, in order, as if they were one contiguous
+    // file. A range that runs past the end of the file is a read error.
+    ReadAheadFile(const fs::path& path, std::vector<FileExtent> extents,
+                  const char* open_error, const char* read_error);
+    ~ReadAheadFile();
+
+    ReadAheadFile(const ReadAheadFile&) = delete;
+    ReadAheadFile& operator=(const ReadAheadFile&) = delete;
+
+    // The rest of the next block, or an empty span at end of file. The bytes
+    // stay valid (and unwiped) until the next call to any member.
+    [[nodiscard]] std::span<const Byte> next();
+
+    // Copies the next `size` bytes to dst; false if the file ends first.
+    [[nodiscard]] bool readExact(Byte* dst, std::size_t size);
+
+    // True once every byte of the file has been consumed.
+    [[nodiscard]] bool atEnd();
+
+    // Bytes handed out so far.
+    [[nodiscard]] std::size_t consumed() const noexcept { return consumed_; }
+
+private:
+    struct Block {
+        vBytes data{};
+        std::size_t size{0};
+    };
+
+    void start(const fs::path& path, const char* open_error);
+    void readerLoop();
+    // Fills dst from the file (or the next extents); sets got to the bytes
+    // read. False on a read error.
+    [[nodiscard]] bool fill(Byte* dst, std::size_t size, std::size_t& got);
+    void releaseCurrent();
+    // Waits for the next filled block; false at end of file. Rethrows a read
+    // error from the reader thread.
+    [[nodiscard]] bool acquireNext();
+
+    int fd_{-1};
+    std::array<Block, READ_AHEAD_BLOCK_COUNT> blocks_{};
+    const char* read_error_{nullptr};
+
+    // Reader-thread state for the extent constructor.
+    bool ranged_{false};
+    std::vector<FileExtent> extents_{};
+    std::size_t extent_index_{0};
+    std::size_t extent_pos_{0};
+
+    std::mutex mutex_;
+    std::condition_variable filled_cv_;
+    std::condition_variable free_cv_;
+    std::size_t filled_count_{0};   // Blocks filled and not yet taken, in ring order.
+    std::size_t in_use_{0};         // Filled blocks plus the one being consumed.
+    std::size_t write_index_{0};    // Next block the reader fills.
+    bool eof_{false};
+    bool stopping_{false};
+    std::exception_ptr error_{};
+
+    std::size_t read_index_{0};     // Next block the consumer takes.
+    Block* current_{nullptr};
+    std::size_t current_pos_{0};
+    std::size_t consumed_{0};
+
+    std::thread reader_{};
+};
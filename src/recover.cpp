@@ -5,6 +5,7 @@
 #include "recover_modes.h"
 
 #include <algorithm>
+#include <format>
 #include <optional>
 #include <stdexcept>
 
@@ -26,19 +27,33 @@ namespace {
         BLUESKY_CIPHER_LAYOUT.encrypted_payload_start_index);
     return findSignatureInFile(image_file_path, JDVRIF_SIGNATURE, header_search_limit, 0);
 }
-} // namespace
 
-void recoverData(const fs::path& image_file_path) {
+void runOnEmbeddedImage(const fs::path& image_file_path, RecoverAction action, std::size_t threads) {
     const std::size_t image_file_size = validateFileForRead(image_file_path, FileTypeCheck::embedded_image);
     if (auto icc_opt = findEmbeddedIccProfile(image_file_path)) {
-        recoverFromIccPath(image_file_path, image_file_size, *icc_opt);
+        recoverFromIccPath(image_file_path, image_file_size, *icc_opt, action, threads);
         return;
     }
 
     if (auto jdvrif_sig_opt = findBlueskyHeaderSignature(image_file_path, image_file_size)) {
-        recoverFromBlueskyPath(image_file_path, image_file_size, *jdvrif_sig_opt);
+        recoverFromBlueskyPath(image_file_path, image_file_size, *jdvrif_sig_opt, action, threads);
         return;
     }
 
     throw std::runtime_error("Image File Error: Signature check failure. This is not a valid jdvrif \"file-embedded\" image.");
 }
+} // namespace
+
+void recoverData(const fs::path& image_file_path, std::size_t threads) {
+    runOnEmbeddedImage(image_file_path, RecoverAction::extract, threads);
+}
+
+void verifyData(const fs::path& image_file_path, std::size_t threads) {
+    // Whatever the cause, a failed verify ends on the same line, so scripts
+    // can tell it from a verified image without parsing every error.
+    try {
+        runOnEmbeddedImage(image_file_path, RecoverAction::verify, threads);
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error(std::format("{}\n\nVerification failed!", e.what()));
+    }
+}
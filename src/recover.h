@@ -2,4 +2,9 @@
 
 #include "common.h"
 
-void recoverData(const fs::path& image_file_path);
+// threads: the --threads limit; 0 = one worker per hardware thread.
+void recoverData(const fs::path& image_file_path, std::size_t threads);
+
+// Authenticates the hidden file without writing it: same PIN prompt, every
+// frame decrypted and discarded.
+void verifyData(const fs::path& image_file_path, std::size_t threads);
@@ -3,6 +3,7 @@
 #include "binary_io.h"
 #include "embedded_layout.h"
 #include "file_utils.h"
+#include "parallel_utils.h"
 #include "signal_utils.h"
 
 #include <algorithm>
@@ -13,6 +14,8 @@
 #include <limits>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -28,13 +31,16 @@ void readExactAt(std::ifstream& input, std::size_t offset, std::span<Byte> out)
 
 namespace {
 constexpr std::size_t EXTRACT_OUTPUT_BUFFER_SIZE = 64 * 1024;
+// Threads copying an extraction plan's runs into the staged ciphertext file.
+constexpr std::size_t EXTRACT_COPY_THREADS = 4;
 
 // ---------------------------------------------------------------------------
-// POSIX fd input wrapper. Used by the extract paths so they can sendfile(2)
-// bytes straight from the input image to the staging cipher file (via
-// OutputFile::sendFrom) without dragging the payload through user space. Sig
-// scans and the small reads at known offsets (preadU16At) continue to use
-// std::ifstream / pread — they are not bandwidth-bound.
+// POSIX fd input wrapper. Used by the extract paths so they can move bytes
+// straight from the input image to the staging cipher file (via
+// OutputFile::sendFrom or copyRangeAt) without dragging the payload through
+// user space. Signature scans and the small reads at known offsets
+// (preadU16At) continue to use std::ifstream / pread — they are not
+// bandwidth-bound.
 // ---------------------------------------------------------------------------
 
 class FdInputFile {
@@ -170,13 +176,14 @@ void scanStreamWindows(std::ifstream& input, std::size_t overlap, std::size_t se
     return found;
 }
 
+template<typename Output>
 [[nodiscard]] std::size_t streamDecodeBase64UntilDelimiterToOutput(
     int in_fd,
     std::size_t offset,
     Byte delimiter,
     std::size_t max_bytes,
     std::size_t expected_decoded_size,
-    OutputFile& output,
+    Output& output,
     const char* corrupt_error) {
 
     if (expected_decoded_size == 0 || max_bytes == 0) {
@@ -258,36 +265,30 @@ void validateIccTrailingMarker(
     }
 }
 
-[[nodiscard]] std::size_t copyDefaultCiphertextPayload(
-    int in_fd,
-    OutputFile& output,
+// The file ranges that hold the embedded ciphertext: one run, or (with
+// profile headers) the runs between the 16-byte headers repeated at each
+// segment boundary.
+[[nodiscard]] std::vector<FileExtent> defaultCiphertextRuns(
     std::size_t payload_start,
     std::size_t embedded_file_size,
     bool has_profile_headers) {
 
+    if (!has_profile_headers) {
+        return {FileExtent{payload_start, embedded_file_size}};
+    }
+
     // Logical cursor into the embedded ciphertext (0..embedded_file_size).
     // The same offset on disk is payload_start + cursor.
+    std::vector<FileExtent> runs;
     std::size_t cursor      = 0;
     std::size_t next_header = ICC_SEGMENT_LAYOUT.profile_header_insert_index;
-    std::size_t written     = 0;
-
-    if (!has_profile_headers) {
-        // Single contiguous run: one sendfile call moves the whole payload
-        // kernel-to-kernel.
-        output.sendFrom(in_fd, payload_start, embedded_file_size,
-                        "Read Error: Failed while extracting encrypted payload.");
-        return embedded_file_size;
-    }
 
     while (cursor < embedded_file_size) {
         const std::size_t header_end = next_header + ICC_SEGMENT_LAYOUT.profile_header_length;
 
         if (cursor >= next_header && cursor < header_end) {
-            // Inside a profile-header gap: advance the logical cursor without
-            // copying. sendfile()'s source-offset argument lets us skip on
-            // the source side too, so we just bump `cursor`.
-            const std::size_t skip_target = std::min(header_end, embedded_file_size);
-            cursor = skip_target;
+            // Inside a profile-header gap: skip it.
+            cursor = std::min(header_end, embedded_file_size);
             if (cursor == header_end) {
                 next_header = checkedAdd(
                     next_header,
@@ -300,27 +301,69 @@ void validateIccTrailingMarker(
         const std::size_t cap_by_header = std::min(embedded_file_size, next_header) - cursor;
         if (cap_by_header == 0) continue;
 
-        output.sendFrom(in_fd, payload_start + cursor, cap_by_header,
-                        "Read Error: Failed while extracting encrypted payload.");
-        cursor  += cap_by_header;
-        written += cap_by_header;
+        runs.push_back(FileExtent{payload_start + cursor, cap_by_header});
+        cursor += cap_by_header;
     }
 
-    return written;
+    return runs;
+}
+
+// One step of an extraction plan: length bytes from source_offset in the
+// image to dest_offset in the staged ciphertext file.
+struct ExtractionCopy {
+    std::size_t source_offset{0};
+    std::size_t dest_offset{0};
+    std::size_t length{0};
+};
+
+// The runs laid end to end in the output. Every step's destination is known
+// up front, so the steps are independent of each other.
+[[nodiscard]] std::vector<ExtractionCopy> extractionPlan(std::span<const FileExtent> runs) {
+    std::vector<ExtractionCopy> plan;
+    plan.reserve(runs.size());
+    std::size_t dest_offset = 0;
+    for (const FileExtent& run : runs) {
+        plan.push_back(ExtractionCopy{run.offset, dest_offset, run.size});
+        dest_offset = checkedAdd(dest_offset, run.size, "File Extraction Error: Embedded data file is corrupt!");
+    }
+    return plan;
 }
 
+// Collects extracted Bluesky ciphertext in memory, for verify. Offers the
+// OutputFile members the extractor uses.
+class MemoryOutput {
+public:
+    explicit MemoryOutput(vBytes& bytes) : bytes_(bytes) {}
+
+    void write(std::span<const Byte> bytes, std::string_view) {
+        bytes_.insert(bytes_.end(), bytes.begin(), bytes.end());
+    }
+
+    void sendFrom(int in_fd, std::size_t in_offset, std::size_t length, std::string_view error_message) {
+        const std::size_t old_size = bytes_.size();
+        bytes_.resize(old_size + length);
+        preadExact(in_fd, std::span<Byte>(bytes_).subspan(old_size), in_offset, error_message);
+    }
+
+    void close(std::string_view) {}
+
+private:
+    vBytes& bytes_;
+};
+
+template<typename Output>
 class BlueskyCiphertextExtractor {
 public:
     BlueskyCiphertextExtractor(
         const fs::path& image_path,
         std::size_t image_size,
         std::size_t embedded_file_size,
-        const fs::path& output_path)
+        Output& output)
         : image_path_(image_path),
           image_size_(image_size),
           embedded_file_size_(embedded_file_size),
           input_fd_(image_path_, "Read Error: Failed to open image file."),
-          output_(output_path, EXTRACT_OUTPUT_BUFFER_SIZE) {
+          output_(output) {
 
         validateInitialRange();
         // Sig scans and the small windowed reads continue to use std::ifstream
@@ -518,7 +561,7 @@ private:
     std::size_t image_size_{0};
     std::size_t embedded_file_size_{0};
     FdInputFile  input_fd_;
-    OutputFile   output_;
+    Output&      output_;
     std::ifstream input_stream_{};
     std::size_t exif_chunk_size_{0};
     std::size_t written_{0};
@@ -584,29 +627,58 @@ private:
     return found;
 }
 
+[[nodiscard]] std::vector<FileExtent> defaultCiphertextExtents(
+    const fs::path& image_path,
+    std::size_t image_size,
+    std::size_t base_offset,
+    std::size_t embedded_file_size,
+    std::uint16_t total_profile_header_segments) {
+    validateDefaultCiphertextRange(image_size, base_offset, embedded_file_size);
+    {
+        FdInputFile input(image_path, "Read Error: Failed to open image file.");
+        validateIccTrailingMarker(input.fd(), image_size, base_offset, total_profile_header_segments);
+    }
+    return defaultCiphertextRuns(
+        base_offset + ICC_CIPHER_LAYOUT.encrypted_payload_start_index,
+        embedded_file_size,
+        total_profile_header_segments != 0);
+}
+
 [[nodiscard]] std::size_t extractDefaultCiphertextToFile(
     const fs::path& image_path,
     std::size_t image_size,
     std::size_t base_offset,
     std::size_t embedded_file_size,
     std::uint16_t total_profile_header_segments,
-    const fs::path& output_path) {
-    validateDefaultCiphertextRange(image_size, base_offset, embedded_file_size);
+    const fs::path& output_path,
+    std::size_t threads) {
+    const std::vector<FileExtent> runs = defaultCiphertextExtents(
+        image_path,
+        image_size,
+        base_offset,
+        embedded_file_size,
+        total_profile_header_segments);
 
-    const std::size_t payload_start = base_offset + ICC_CIPHER_LAYOUT.encrypted_payload_start_index;
+    // The runs skip the header gaps on the source side; the plan places each
+    // at its offset in the output, so disjoint slices of it are copied on a
+    // few threads at once, each run kernel-to-kernel (copy_file_range).
+    const std::vector<ExtractionCopy> plan = extractionPlan(runs);
+    const std::size_t written = plan.empty() ? 0 : plan.back().dest_offset + plan.back().length;
 
     FdInputFile input(image_path, "Read Error: Failed to open image file.");
     OutputFile  output(output_path, EXTRACT_OUTPUT_BUFFER_SIZE);
-
-    validateIccTrailingMarker(input.fd(), image_size, base_offset, total_profile_header_segments);
-
-    const bool has_profile_headers = (total_profile_header_segments != 0);
-    const std::size_t written = copyDefaultCiphertextPayload(
-        input.fd(),
-        output,
-        payload_start,
-        embedded_file_size,
-        has_profile_headers);
+    output.preallocate(written, "Write File Error: Not enough free disk space to extract the encrypted payload.");
+
+    WorkerPool pool(std::min(resolveWorkerThreads(threads), EXTRACT_COPY_THREADS));
+    const std::size_t slices = std::min(pool.threadCount(), plan.size());
+    pool.run(slices, [&](std::size_t slice) {
+        const std::size_t first = plan.size() * slice / slices;
+        const std::size_t last = plan.size() * (slice + 1) / slices;
+        for (std::size_t i = first; i < last; ++i) {
+            output.copyRangeAt(input.fd(), plan[i].source_offset, plan[i].dest_offset, plan[i].length,
+                               "Read Error: Failed while extracting encrypted payload.");
+        }
+    });
 
     output.close(WRITE_COMPLETE_ERROR);
     return written;
@@ -617,9 +689,25 @@ private:
     std::size_t image_size,
     std::size_t embedded_file_size,
     const fs::path& output_path) {
-    return BlueskyCiphertextExtractor(
+    OutputFile output(output_path, EXTRACT_OUTPUT_BUFFER_SIZE);
+    return BlueskyCiphertextExtractor<OutputFile>(
+        image_path,
+        image_size,
+        embedded_file_size,
+        output).run();
+}
+
+[[nodiscard]] vBytes extractBlueskyCiphertextToMemory(
+    const fs::path& image_path,
+    std::size_t image_size,
+    std::size_t embedded_file_size) {
+    vBytes ciphertext;
+    ciphertext.reserve(embedded_file_size);
+    MemoryOutput output(ciphertext);
+    (void)BlueskyCiphertextExtractor<MemoryOutput>(
         image_path,
         image_size,
         embedded_file_size,
-        output_path).run();
+        output).run();
+    return ciphertext;
 }
@@ -1,12 +1,14 @@
 #pragma once
 
 #include "common.h"
+#include "read_ahead.h"
 
 #include <cstddef>
 #include <cstdint>
 #include <fstream>
 #include <optional>
 #include <span>
+#include <vector>
 
 void readExactAt(std::ifstream& input, std::size_t offset, std::span<Byte> out);
 
@@ -24,16 +26,33 @@ void readExactAt(std::ifstream& input, std::size_t offset, std::span<Byte> out);
     std::span<const Byte> second_sig,
     std::size_t second_sig_offset);
 
+// The image's byte ranges holding the ICC-embedded ciphertext, in order, once
+// its declared size and trailing segment marker check out.
+[[nodiscard]] std::vector<FileExtent> defaultCiphertextExtents(
+    const fs::path& image_path,
+    std::size_t image_size,
+    std::size_t base_offset,
+    std::size_t embedded_file_size,
+    std::uint16_t total_profile_header_segments);
+
 [[nodiscard]] std::size_t extractDefaultCiphertextToFile(
     const fs::path& image_path,
     std::size_t image_size,
     std::size_t base_offset,
     std::size_t embedded_file_size,
     std::uint16_t total_profile_header_segments,
-    const fs::path& output_path);
+    const fs::path& output_path,
+    std::size_t threads);
 
 [[nodiscard]] std::size_t extractBlueskyCiphertextToFile(
     const fs::path& image_path,
     std::size_t image_size,
     std::size_t embedded_file_size,
     const fs::path& output_path);
+
+// The Bluesky ciphertext, read into memory (it is at most
+// MAX_EMBEDDED_CIPHERTEXT_BLUESKY bytes).
+[[nodiscard]] vBytes extractBlueskyCiphertextToMemory(
+    const fs::path& image_path,
+    std::size_t image_size,
+    std::size_t embedded_file_size);
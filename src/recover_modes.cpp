@@ -8,14 +8,13 @@
 #include "recover_output.h"
 
 #include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <span>
 #include <stdexcept>
+#include <vector>
 
 namespace {
-// Smallest secretstream ciphertext: 4-byte frame length + empty-frame ABYTES.
-constexpr std::size_t MIN_EMBEDDED_CIPHERTEXT =
-    STREAM_FRAME_LEN_BYTES + crypto_secretstream_xchacha20poly1305_ABYTES;
 
 enum class RecoveryFormat : Byte {
     default_icc,
@@ -40,7 +39,7 @@ void validateDeclaredCipherSize(std::size_t embedded_file_size, RecoveryFormat f
     if (embedded_file_size == 0) {
         throw std::runtime_error("File Extraction Error: Embedded data file is empty.");
     }
-    if (embedded_file_size < MIN_EMBEDDED_CIPHERTEXT) {
+    if (embedded_file_size < MIN_STREAM_CIPHERTEXT_BYTES) {
         throw std::runtime_error("File Extraction Error: Embedded data file is corrupt!");
     }
 
@@ -76,46 +75,88 @@ void finalizeRecoveredOutput(
     printRecoverySuccess(output_path, decrypt_result.output_size);
 }
 
-// Order: validate declared size → PIN/KDF → extract ciphertext → decrypt.
-// Extracting before PIN would let a crafted image force multi-GB staging I/O
-// with no user interaction; size caps also bound work after a wrong PIN.
+// Order: validate declared size → PIN → extract ciphertext (while the KDF
+// runs) → decrypt. Extracting before PIN would let a crafted image force
+// multi-GB staging I/O with no user interaction; size caps also bound work
+// after a wrong PIN.
 template <typename ExtractFn>
 void recoverFromCipherExtractor(
     vBytes& metadata_vec,
     RecoveryFormat format,
-    bool is_data_compressed,
+    PayloadCodec codec,
     std::size_t embedded_file_size,
+    std::size_t threads,
     ExtractFn&& extract_cipher) {
 
     validateDeclaredCipherSize(embedded_file_size, format);
     const bool is_bluesky_file = isBlueskyFormat(format);
 
     runWithRecoverStageFiles([&](TempFileCleanupGuard& cipher_stage, TempFileCleanupGuard& stream_stage) {
-        SecureBuffer<Key> key;
+        PendingKey key;
         StreamHeader stream_header{};
-        const KdfMetadataVersion metadata_version =
-            prepareDecryptKeyFromMetadata(metadata_vec, is_bluesky_file, key.buf, stream_header);
+        StreamFormat stream_format =
+            prepareDecryptKeyFromMetadata(metadata_vec, is_bluesky_file, key, stream_header);
+        stream_format.frames.threads = threads;
 
         if (extract_cipher(cipher_stage.path) == 0) {
             throw std::runtime_error("File Extraction Error: Embedded data file is empty.");
         }
 
         DecryptResult decrypt_result = decryptDataFileWithKey(
-            key.buf,
+            key.get(),
             stream_header,
-            metadata_version,
+            stream_format,
             cipher_stage.path,
             stream_stage.path,
-            is_data_compressed);
+            codec);
         finalizeRecoveredOutput(std::move(decrypt_result), stream_stage);
     });
 }
+
+// Same order as above, but locate_cipher stands in for extraction: it finds
+// the ciphertext (while the KDF runs) and returns the function that
+// authenticates it. Nothing is staged or written.
+template <typename LocateFn>
+void verifyFromCipherSource(
+    vBytes& metadata_vec,
+    RecoveryFormat format,
+    std::size_t embedded_file_size,
+    std::size_t threads,
+    LocateFn&& locate_cipher) {
+
+    validateDeclaredCipherSize(embedded_file_size, format);
+
+    PendingKey key;
+    StreamHeader stream_header{};
+    StreamFormat stream_format =
+        prepareDecryptKeyFromMetadata(metadata_vec, isBlueskyFormat(format), key, stream_header);
+    stream_format.frames.threads = threads;
+
+    auto authenticate = locate_cipher();
+    const Key& ready_key = key.get();
+
+    const auto started = std::chrono::steady_clock::now();
+    VerifyResult result = authenticate(ready_key, stream_header, stream_format);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+
+    if (result.failed) {
+        throw std::runtime_error("File Decryption Error: Invalid recovery PIN or file is corrupt.");
+    }
+    printVerificationSuccess(
+        validatedRecoveryPath(std::move(result.filename)),
+        result.payload_size,
+        result.original_size,
+        embedded_file_size,
+        elapsed.count());
+}
 } // namespace
 
 void recoverFromIccPath(
     const fs::path& image_file_path,
     std::size_t image_file_size,
-    std::size_t icc_profile_sig_index) {
+    std::size_t icc_profile_sig_index,
+    RecoverAction action,
+    std::size_t threads) {
 
     if (icc_profile_sig_index < ICC_PROFILE_SIGNATURE_OFFSET) {
         throw std::runtime_error("File Extraction Error: Corrupt ICC metadata.");
@@ -144,26 +185,45 @@ void recoverFromIccPath(
         throw std::runtime_error("File Extraction Error: Corrupt metadata.");
     }
 
-    const bool is_data_compressed = (metadata_vec[ICC_SEGMENT_LAYOUT.compression_flag_index] != NO_ZLIB_COMPRESSION_ID);
+    const PayloadCodec codec = payloadCodecFromFlag(metadata_vec[ICC_SEGMENT_LAYOUT.compression_flag_index]);
     const auto total_profile_header_segments = static_cast<std::uint16_t>(
         getValue(metadata_vec, ICC_SEGMENT_LAYOUT.embedded_total_profile_header_segments_index));
     const std::size_t embedded_file_size = getValue(metadata_vec, ICC_CIPHER_LAYOUT.file_size_index, 4);
 
-    recoverFromCipherExtractor(metadata_vec, RecoveryFormat::default_icc, is_data_compressed, embedded_file_size, [&](const fs::path& cipher_path) {
+    if (action == RecoverAction::verify) {
+        verifyFromCipherSource(metadata_vec, RecoveryFormat::default_icc, embedded_file_size, threads, [&] {
+            // The ciphertext is read in place, between the profile headers.
+            return [&, extents = defaultCiphertextExtents(
+                           image_file_path,
+                           image_file_size,
+                           base_offset,
+                           embedded_file_size,
+                           total_profile_header_segments)](
+                       const Key& key, const StreamHeader& header, const StreamFormat& stream_format) {
+                return verifyDataFileWithKey(key, header, stream_format, image_file_path, extents, codec);
+            };
+        });
+        return;
+    }
+
+    recoverFromCipherExtractor(metadata_vec, RecoveryFormat::default_icc, codec, embedded_file_size, threads, [&](const fs::path& cipher_path) {
         return extractDefaultCiphertextToFile(
             image_file_path,
             image_file_size,
             base_offset,
             embedded_file_size,
             total_profile_header_segments,
-            cipher_path);
+            cipher_path,
+            threads);
     });
 }
 
 void recoverFromBlueskyPath(
     const fs::path& image_file_path,
     std::size_t image_file_size,
-    std::size_t jdvrif_sig_index) {
+    std::size_t jdvrif_sig_index,
+    RecoverAction action,
+    std::size_t threads) {
 
     if (BLUESKY_CIPHER_LAYOUT.encrypted_payload_start_index > image_file_size) {
         throw std::runtime_error("Image File Error: Corrupt signature metadata.");
@@ -189,12 +249,21 @@ void recoverFromBlueskyPath(
 
     const std::size_t embedded_file_size = getValue(metadata_vec, BLUESKY_CIPHER_LAYOUT.file_size_index, 4);
 
-    // is_data_compressed is hardcoded true for Bluesky. A payload is only stored
-    // uncompressed when conceal bypasses compression (source > COMPRESS_BYPASS_SIZE,
-    // 10 MB), but such a payload always exceeds the 2 MB Bluesky encrypted cap
-    // (MAX_EMBEDDED_CIPHERTEXT_BLUESKY) and is rejected at conceal time — so a valid
-    // Bluesky image is always zlib-compressed. Revisit this coupling if those limits change.
-    recoverFromCipherExtractor(metadata_vec, RecoveryFormat::bluesky, true, embedded_file_size, [&](const fs::path& cipher_path) {
+    // The codec is hardcoded zlib for Bluesky: the Bluesky layout has no
+    // compression flag, so conceal always zlib-compresses in Bluesky mode
+    // (see decideCompression in conceal.cpp). Revisit if that changes.
+    if (action == RecoverAction::verify) {
+        verifyFromCipherSource(metadata_vec, RecoveryFormat::bluesky, embedded_file_size, threads, [&] {
+            // At most MAX_EMBEDDED_CIPHERTEXT_BLUESKY bytes, so held in memory.
+            return [ciphertext = extractBlueskyCiphertextToMemory(image_file_path, image_file_size, embedded_file_size)](
+                       const Key& key, const StreamHeader& header, const StreamFormat& stream_format) {
+                return verifyDataWithKey(key, header, stream_format, ciphertext, PayloadCodec::zlib);
+            };
+        });
+        return;
+    }
+
+    recoverFromCipherExtractor(metadata_vec, RecoveryFormat::bluesky, PayloadCodec::zlib, embedded_file_size, threads, [&](const fs::path& cipher_path) {
         return extractBlueskyCiphertextToFile(image_file_path, image_file_size, embedded_file_size, cipher_path);
     });
 }
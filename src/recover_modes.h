@@ -4,12 +4,25 @@
 
 #include <cstddef>
 
+// extract writes the hidden file out; verify only authenticates it, reading
+// the ciphertext in place and writing nothing.
+enum class RecoverAction : Byte {
+    extract,
+    verify,
+};
+
+// threads limits the workers that copy, decrypt and decompress the payload;
+// 0 = one per hardware thread.
 void recoverFromIccPath(
     const fs::path& image_file_path,
     std::size_t image_file_size,
-    std::size_t icc_profile_sig_index);
+    std::size_t icc_profile_sig_index,
+    RecoverAction action,
+    std::size_t threads);
 
 void recoverFromBlueskyPath(
     const fs::path& image_file_path,
     std::size_t image_file_size,
-    std::size_t jdvrif_sig_index);
+    std::size_t jdvrif_sig_index,
+    RecoverAction action,
+    std::size_t threads);
@@ -80,3 +80,20 @@ void printRecoverySuccess(const fs::path& output_path, std::size_t output_size)
     std::println("\nExtracted hidden file: {} ({} bytes).\n\nComplete! Please check your file.\n",
                 output_path.string(), output_size);
 }
+
+void printVerificationSuccess(
+    const fs::path& filename,
+    std::size_t payload_size,
+    std::optional<std::size_t> original_size,
+    std::size_t ciphertext_size,
+    double seconds) {
+
+    if (original_size) {
+        std::println("\nVerified hidden file: {} ({} bytes).", filename.string(), *original_size);
+    } else {
+        std::println("\nVerified hidden file: {} ({} bytes compressed).", filename.string(), payload_size);
+    }
+    const double rate = seconds > 0.0 ? static_cast<double>(ciphertext_size) / seconds / 1e6 : 0.0;
+    std::println("Authenticated {} bytes of ciphertext in {:.2f} s ({:.0f} MB/s).", ciphertext_size, seconds, rate);
+    std::println("\nComplete! Every frame is intact; nothing was written.\n");
+}
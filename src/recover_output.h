@@ -3,9 +3,16 @@
 #include "file_utils.h"
 
 #include <cstddef>
+#include <optional>
 #include <string>
 
 [[nodiscard]] fs::path validatedRecoveryPath(std::string decrypted_filename);
 [[nodiscard]] fs::path tempRecoveryPath(const fs::path& output_path);
 [[nodiscard]] fs::path commitRecoveredOutput(TempFileCleanupGuard& staged_file, const fs::path& base_output_path);
 void printRecoverySuccess(const fs::path& output_path, std::size_t output_size);
+void printVerificationSuccess(
+    const fs::path& filename,
+    std::size_t payload_size,
+    std::optional<std::size_t> original_size,
+    std::size_t ciphertext_size,
+    double seconds);
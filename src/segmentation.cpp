@@ -2,17 +2,14 @@
 #include "binary_io.h"
 #include "embedded_layout.h"
 #include "file_utils.h"
+#include "parallel_utils.h"
 #include "signal_utils.h"
 
 #include <algorithm>
-#include <cstring>
 #include <limits>
 #include <string>
 #include <stdexcept>
 
-#include <fcntl.h>
-#include <unistd.h>
-
 namespace {
 constexpr std::size_t
     SOI_SIG_LENGTH           = 2,
@@ -23,6 +20,9 @@ constexpr std::size_t
     PROFILE_DATA_SIZE        = ICC_SEGMENT_LAYOUT.profile_data_size,
     PROFILE_SIZE_DIFF        = ICC_SEGMENT_LAYOUT.profile_size_diff,
     VALUE_BYTE_LENGTH        = 4,
+    SEGMENT_STRIDE           = SEGMENT_SIG_LENGTH + SEGMENT_HEADER_LENGTH + SEGMENT_DATA_SIZE,
+    // Writes in flight at once when segments go to precomputed offsets.
+    POSITIONAL_WRITE_THREADS = 4,
     MAX_SINGLE_SEGMENT_SIZE  = SEGMENT_DATA_SIZE + SOI_SIG_LENGTH + SEGMENT_SIG_LENGTH + SEGMENT_HEADER_LENGTH;
 
 constexpr auto ICC_HEADER_TEMPLATE = std::to_array<Byte>({
@@ -40,74 +40,10 @@ constexpr auto ICC_HEADER_TEMPLATE = std::to_array<Byte>({
     return header;
 }
 
-// Payload = an optional in-memory template prefix (the bytes of segment_vec
-// beyond its header) followed by the encrypted file. The encrypted portion is
-// held as a raw fd so it can be streamed to the output via sendfile(2) instead
-// of being copied through user space.
-struct PayloadSource {
-    std::span<const Byte> template_payload{};
-    int         encrypted_fd{-1};
-    std::size_t template_offset{0};
-    std::size_t encrypted_offset{0};
-    std::size_t encrypted_left{0};
-
-    PayloadSource(
-        std::span<const Byte> template_payload_arg,
-        const fs::path& encrypted_path,
-        std::size_t encrypted_size)
-        : template_payload(template_payload_arg),
-          encrypted_left(encrypted_size) {
-        encrypted_fd = ::open(encrypted_path.c_str(), O_RDONLY | O_CLOEXEC);
-        if (encrypted_fd < 0) {
-            throw std::runtime_error("Read Error: Failed to open encrypted payload.");
-        }
-        (void)::posix_fadvise(encrypted_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
-    }
-
-    ~PayloadSource() {
-        if (encrypted_fd >= 0) ::close(encrypted_fd);
-    }
-
-    PayloadSource(const PayloadSource&) = delete;
-    PayloadSource& operator=(const PayloadSource&) = delete;
-
-    // Append `size` payload bytes to output: the template prefix (buffered copy)
-    // first, then the encrypted-file remainder via sendfile (zero-copy).
-    void copyTo(OutputFile& output, std::size_t size) {
-        std::size_t left = size;
-        if (template_offset < template_payload.size()) {
-            const std::size_t take = std::min(left, template_payload.size() - template_offset);
-            output.write(template_payload.subspan(template_offset, take), WRITE_COMPLETE_ERROR);
-            template_offset += take;
-            left -= take;
-        }
-        if (left > 0) {
-            if (left > encrypted_left) {
-                throw std::runtime_error("Read Error: Encrypted payload is shorter than expected.");
-            }
-            output.sendFrom(encrypted_fd, encrypted_offset, left, "Read Error: Failed while reading encrypted payload.");
-            encrypted_offset += left;
-            encrypted_left   -= left;
-        }
-    }
-
-    [[nodiscard]] bool exhausted() const noexcept {
-        return template_offset == template_payload.size() && encrypted_left == 0;
-    }
-};
-
 void writeOutput(OutputFile& output, std::span<const Byte> bytes) {
     output.write(bytes, WRITE_COMPLETE_ERROR);
 }
 
-void copyFileToOutput(const fs::path& input_path, OutputFile& output, std::size_t length) {
-    PayloadSource payload_source(std::span<const Byte>{}, input_path, length);
-    payload_source.copyTo(output, length);
-    if (!payload_source.exhausted()) {
-        throw std::runtime_error("Read Error: Encrypted payload is longer than expected.");
-    }
-}
-
 [[nodiscard]] std::size_t requiredIccSegments(std::size_t payload_size) {
     if (payload_size == 0) {
         throw std::runtime_error("File Size Error: Segment count exceeds supported limit.");
@@ -120,100 +56,73 @@ void copyFileToOutput(const fs::path& input_path, OutputFile& output, std::size_
     return segments_required;
 }
 
-[[nodiscard]] SegmentedEmbedSummary writeIccDataToOutput(
-    OutputFile& output,
-    vBytes& segment_vec,
-    const fs::path& encrypted_path,
-    std::size_t encrypted_size) {
-
-    if (segment_vec.size() < INITIAL_HEADER_BYTES) {
+// Sizes of the ICC segments for a payload, computed exactly as
+// IccSegmentWriter lays them out (jpg size not included).
+[[nodiscard]] SegmentedEmbedSummary iccEmbedSummary(std::size_t template_size, std::size_t encrypted_size) {
+    if (template_size < INITIAL_HEADER_BYTES) {
         throw std::runtime_error("File Extraction Error: Corrupt segment header.");
     }
 
     const std::size_t single_segment_size = checkedAdd(
-        segment_vec.size(),
+        template_size,
         encrypted_size,
         "File Size Error: Segment output size overflow.");
 
     if (single_segment_size <= MAX_SINGLE_SEGMENT_SIZE) {
-        const std::size_t segment_size = single_segment_size - (SOI_SIG_LENGTH + SEGMENT_SIG_LENGTH);
-        const std::size_t profile_size = segment_size - PROFILE_SIZE_DIFF;
-
-        updateValue(segment_vec, ICC_SEGMENT_LAYOUT.segment_header_size_index, segment_size);
-        updateValue(segment_vec, ICC_SEGMENT_LAYOUT.profile_size_index, profile_size);
-        updateValue(segment_vec, ICC_SEGMENT_LAYOUT.encrypted_file_size_index, single_segment_size - PROFILE_DATA_SIZE, VALUE_BYTE_LENGTH);
-
-        writeOutput(output, std::span<const Byte>(segment_vec));
-        copyFileToOutput(encrypted_path, output, encrypted_size);
-
         return SegmentedEmbedSummary{
             .embedded_image_size = single_segment_size,
-            .first_segment_size = static_cast<uint16_t>(segment_size),
+            .first_segment_size = static_cast<uint16_t>(single_segment_size - (SOI_SIG_LENGTH + SEGMENT_SIG_LENGTH)),
             .total_segments = 0,
         };
     }
 
-    const std::size_t payload_prefix_size = segment_vec.size() - INITIAL_HEADER_BYTES;
     const std::size_t payload_size = checkedAdd(
-        payload_prefix_size,
+        template_size - INITIAL_HEADER_BYTES,
         encrypted_size,
         "File Size Error: Segment output size overflow.");
     const std::size_t segments_required = requiredIccSegments(payload_size);
-
-    updateValue(segment_vec, ICC_SEGMENT_LAYOUT.template_total_profile_header_segments_index, segments_required);
-
     const std::size_t total_header_bytes = checkedMul(
         segments_required,
         SEGMENT_SIG_LENGTH + SEGMENT_HEADER_LENGTH,
         "File Size Error: Segment output size overflow.");
-    const std::size_t icc_data_size = checkedAdd(
-        SOI_SIG_LENGTH,
-        checkedAdd(payload_size, total_header_bytes, "File Size Error: Segment output size overflow."),
-        "File Size Error: Segment output size overflow.");
-    updateValue(segment_vec, ICC_SEGMENT_LAYOUT.encrypted_file_size_index, icc_data_size - PROFILE_DATA_SIZE, VALUE_BYTE_LENGTH);
-
-    writeOutput(output, std::span<const Byte>(segment_vec.data(), SOI_SIG_LENGTH));
-
-    PayloadSource payload_source(
-        std::span<const Byte>(segment_vec.data() + INITIAL_HEADER_BYTES, payload_prefix_size),
-        encrypted_path,
-        encrypted_size);
-
-    // Each segment is an 18-byte ICC header (buffered into the OutputFile,
-    // coalescing many headers into few write(2) calls) followed by its data
-    // portion, which copyTo() streams straight from the encrypted file via
-    // sendfile(2) — the payload never passes through user space.
-    std::size_t payload_left = payload_size;
-    for (std::size_t seg = 1; seg <= segments_required; ++seg) {
-        throwIfSignalCancellationRequested();
-        const std::size_t data_size = std::min(payload_left, SEGMENT_DATA_SIZE);
-        const auto header = makeIccHeader(static_cast<uint16_t>(data_size + SEGMENT_HEADER_LENGTH), seg);
-
-        writeOutput(output, std::span<const Byte>(header));
-        payload_source.copyTo(output, data_size);
-
-        payload_left -= data_size;
-    }
-
-    if (payload_left != 0 || !payload_source.exhausted()) {
-        throw std::runtime_error("Read Error: Encrypted payload size mismatch.");
-    }
 
     return SegmentedEmbedSummary{
-        .embedded_image_size = icc_data_size,
+        .embedded_image_size = checkedAdd(
+            SOI_SIG_LENGTH,
+            checkedAdd(payload_size, total_header_bytes, "File Size Error: Segment output size overflow."),
+            "File Size Error: Segment output size overflow."),
         .first_segment_size = static_cast<uint16_t>(std::min(payload_size, SEGMENT_DATA_SIZE) + SEGMENT_HEADER_LENGTH),
         .total_segments = static_cast<uint16_t>(segments_required),
     };
 }
+
 } // namespace
 
+bool platformAccepts(const PlatformLimits& limits, const SegmentedEmbedSummary& summary) noexcept {
+    return summary.embedded_image_size <= limits.max_image_size
+        && summary.first_segment_size <= limits.max_first_segment
+        && summary.total_segments <= limits.max_segments;
+}
+
+SegmentedEmbedSummary predictEmbeddedSummary(std::size_t template_size, std::size_t encrypted_size, std::size_t jpg_size) {
+    SegmentedEmbedSummary summary = iccEmbedSummary(template_size, encrypted_size);
+    summary.embedded_image_size = checkedAdd(
+        summary.embedded_image_size,
+        jpg_size,
+        "File Size Error: Embedded image size overflow.");
+    return summary;
+}
+
 void filterPlatforms(vString& platforms_vec, std::size_t embedded_size, uint16_t first_segment_size, uint16_t total_segments) {
+    const SegmentedEmbedSummary summary{
+        .embedded_image_size = embedded_size,
+        .first_segment_size = first_segment_size,
+        .total_segments = total_segments,
+    };
     std::erase_if(platforms_vec, [&](const std::string& platform) {
-        for (const auto& [name, max_img, max_seg, max_segs] : PLATFORM_LIMITS) {
-            if (platform == name) {
-                return embedded_size > max_img
-                    || first_segment_size > max_seg
-                    || total_segments > max_segs;
+        for (const PlatformLimits& limits : PLATFORM_LIMITS) {
+            if (platform == limits.name) {
+                return !platformAccepts(limits, summary);
             }
         }
         return false;
@@ -227,22 +136,180 @@ void filterPlatforms(vString& platforms_vec, std::size_t embedded_size, uint16_t
     }
 }
 
-[[nodiscard]] SegmentedEmbedSummary writeEmbeddedJpgFromEncryptedFile(
-    OutputFile& output,
-    vBytes& segment_vec,
-    const fs::path& encrypted_path,
-    std::span<const Byte> jpg_vec) {
+IccSegmentWriter::IccSegmentWriter(OutputFile& output, vBytes& segment_vec)
+    : output_(output),
+      segment_vec_(segment_vec) {
+    if (segment_vec_.size() < INITIAL_HEADER_BYTES || segment_vec_.size() - INITIAL_HEADER_BYTES > SEGMENT_DATA_SIZE) {
+        throw std::runtime_error("File Extraction Error: Corrupt segment header.");
+    }
+    // The template's bytes open the first segment. They are copied now only to
+    // fill it; segment_vec itself is written (or patched in) by finish().
+    pending_.reserve(SEGMENT_DATA_SIZE);
+    pending_.assign(segment_vec_.begin() + INITIAL_HEADER_BYTES, segment_vec_.end());
+}
 
-    const std::size_t encrypted_size = checkedFileSize(
-        encrypted_path,
-        "Read Error: Invalid encrypted payload size.",
-        true);
+IccSegmentWriter::~IccSegmentWriter() = default;
 
-    SegmentedEmbedSummary summary = writeIccDataToOutput(output, segment_vec, encrypted_path, encrypted_size);
-    writeOutput(output, jpg_vec);
-    summary.embedded_image_size = checkedAdd(
-        summary.embedded_image_size,
-        jpg_vec.size(),
-        "File Size Error: Embedded image size overflow.");
-    return summary;
+void IccSegmentWriter::reserve(std::size_t encrypted_size, std::span<const Byte> tail, std::size_t threads) {
+    if (encrypted_size_ != 0 || segments_written_ != 0 || reserved_size_) {
+        throw std::runtime_error("Internal Error: Segment output reserved after writing began.");
+    }
+    const std::size_t segments_size = iccEmbedSummary(segment_vec_.size(), encrypted_size).embedded_image_size;
+    output_.preallocate(
+        checkedAdd(segments_size, tail.size(), "File Size Error: Segment output size overflow."),
+        "Write File Error: Not enough free disk space for the output image.");
+    output_.writeAt(segments_size, tail, WRITE_COMPLETE_ERROR);
+    reserved_size_ = encrypted_size;
+    if (!output_.enableIoRing()) {
+        pool_ = std::make_unique<WorkerPool>(std::min(resolveWorkerThreads(threads), POSITIONAL_WRITE_THREADS));
+    }
+}
+
+// A full segment is only queued once more payload is known to follow it:
+// until then the payload may still fit the single-segment layout, and the
+// last segment's header needs its final length. Full segments within bytes
+// are queued as views of bytes itself, with no copy into pending_; a full
+// pending_ is moved to carried_ until it has been written.
+void IccSegmentWriter::append(std::span<const Byte> bytes) {
+    encrypted_size_ = checkedAdd(encrypted_size_, bytes.size(), "File Size Error: Segment output size overflow.");
+    // Past the reserved size, segments would overwrite the tail.
+    if (reserved_size_ && encrypted_size_ > *reserved_size_) {
+        throw std::runtime_error("Read Error: Encrypted payload size mismatch.");
+    }
+    if (!pending_.empty() && pending_.size() < SEGMENT_DATA_SIZE) {
+        const std::size_t take = std::min(bytes.size(), SEGMENT_DATA_SIZE - pending_.size());
+        pending_.insert(pending_.end(), bytes.begin(), bytes.begin() + static_cast<std::ptrdiff_t>(take));
+        bytes = bytes.subspan(take);
+    }
+    if (bytes.empty()) return;
+
+    if (pending_.size() == SEGMENT_DATA_SIZE) {
+        queueSegment(pending_);
+        carried_.push_back(std::move(pending_));
+        if (spare_.empty()) {
+            pending_ = vBytes{};
+        } else {
+            pending_ = std::move(spare_.back());
+            spare_.pop_back();
+        }
+        pending_.clear();
+        pending_.reserve(SEGMENT_DATA_SIZE);
+    }
+    while (bytes.size() > SEGMENT_DATA_SIZE) {
+        queueSegment(bytes.first(SEGMENT_DATA_SIZE));
+        bytes = bytes.subspan(SEGMENT_DATA_SIZE);
+    }
+    pending_.assign(bytes.begin(), bytes.end());
+}
+
+void IccSegmentWriter::queueSegment(std::span<const Byte> data) {
+    if (segments_written_ == std::numeric_limits<uint16_t>::max()) {
+        throw std::runtime_error("File Size Error: Segment count exceeds supported limit.");
+    }
+    // Segment k's header sits at SOI + k * SEGMENT_STRIDE; the first segment's
+    // pieces start with the SOI itself, at 0.
+    batch_segments_.push_back(BatchSegment{
+        .first_piece = gather_.size(),
+        .offset = segments_written_ == 0 ? 0 : SOI_SIG_LENGTH + segments_written_ * SEGMENT_STRIDE,
+    });
+    if (segments_written_ == 0) {
+        gather_.emplace_back(segment_vec_.data(), SOI_SIG_LENGTH);
+    }
+    ++segments_written_;
+    headers_.push_back(makeIccHeader(static_cast<uint16_t>(data.size() + SEGMENT_HEADER_LENGTH), segments_written_));
+    gather_.emplace_back(headers_.back());
+    gather_.push_back(data);
+}
+
+void IccSegmentWriter::flush() {
+    if (batch_segments_.empty()) return;
+    throwIfSignalCancellationRequested();
+
+    const std::span<const std::span<const Byte>> pieces(gather_);
+    const std::size_t segments = batch_segments_.size();
+    if (!reserved_size_) {
+        output_.writeGather(pieces, WRITE_COMPLETE_ERROR);
+    } else if (!pool_) {
+        // One io_uring request per segment, all submitted together.
+        ring_writes_.clear();
+        for (std::size_t i = 0; i < segments; ++i) {
+            const std::size_t piece_begin = batch_segments_[i].first_piece;
+            const std::size_t piece_end = i + 1 < segments ? batch_segments_[i + 1].first_piece : pieces.size();
+            ring_writes_.push_back(GatherWrite{
+                .offset = batch_segments_[i].offset,
+                .pieces = pieces.subspan(piece_begin, piece_end - piece_begin),
+            });
+        }
+        output_.writeGatherBatchAt(ring_writes_, WRITE_COMPLETE_ERROR);
+    } else {
+        // Disjoint runs of whole segments, each one pwritev at its own offset.
+        const std::size_t runs = std::min(pool_->threadCount(), segments);
+        pool_->run(runs, [&](std::size_t run) {
+            const std::size_t first = segments * run / runs;
+            const std::size_t last = segments * (run + 1) / runs;
+            const std::size_t piece_begin = batch_segments_[first].first_piece;
+            const std::size_t piece_end = last < segments ? batch_segments_[last].first_piece : pieces.size();
+            output_.writeGatherAt(
+                batch_segments_[first].offset,
+                pieces.subspan(piece_begin, piece_end - piece_begin),
+                WRITE_COMPLETE_ERROR);
+        });
+    }
+
+    headers_.clear();
+    gather_.clear();
+    batch_segments_.clear();
+    for (vBytes& buffer : carried_) {
+        spare_.push_back(std::move(buffer));
+    }
+    carried_.clear();
+}
+
+SegmentedEmbedSummary IccSegmentWriter::finish() {
+    if (encrypted_size_ == 0 || (reserved_size_ && encrypted_size_ != *reserved_size_)) {
+        throw std::runtime_error("Read Error: Encrypted payload size mismatch.");
+    }
+    const std::size_t template_payload_size = segment_vec_.size() - INITIAL_HEADER_BYTES;
+
+    flush();
+    if (segments_written_ == 0) {
+        const std::size_t single_segment_size = segment_vec_.size() + encrypted_size_;
+        const std::size_t segment_size = single_segment_size - (SOI_SIG_LENGTH + SEGMENT_SIG_LENGTH);
+        const std::size_t profile_size = segment_size - PROFILE_SIZE_DIFF;
+
+        updateValue(segment_vec_, ICC_SEGMENT_LAYOUT.segment_header_size_index, segment_size);
+        updateValue(segment_vec_, ICC_SEGMENT_LAYOUT.profile_size_index, profile_size);
+        updateValue(segment_vec_, ICC_SEGMENT_LAYOUT.encrypted_file_size_index, single_segment_size - PROFILE_DATA_SIZE, VALUE_BYTE_LENGTH);
+
+        if (reserved_size_) {
+            output_.writeAt(0, std::span<const Byte>(segment_vec_), WRITE_COMPLETE_ERROR);
+            output_.writeAt(
+                segment_vec_.size(),
+                std::span<const Byte>(pending_).subspan(template_payload_size),
+                WRITE_COMPLETE_ERROR);
+        } else {
+            writeOutput(output_, std::span<const Byte>(segment_vec_));
+            writeOutput(output_, std::span<const Byte>(pending_).subspan(template_payload_size));
+        }
+    } else {
+        queueSegment(pending_);
+        flush();
+        pending_.clear();
+
+        const SegmentedEmbedSummary summary = iccEmbedSummary(segment_vec_.size(), encrypted_size_);
+        if (summary.total_segments != segments_written_) {
+            throw std::runtime_error("Read Error: Encrypted payload size mismatch.");
+        }
+        updateValue(segment_vec_, ICC_SEGMENT_LAYOUT.template_total_profile_header_segments_index, segments_written_);
+        updateValue(segment_vec_, ICC_SEGMENT_LAYOUT.encrypted_file_size_index, summary.embedded_image_size - PROFILE_DATA_SIZE, VALUE_BYTE_LENGTH);
+
+        // The first segment went out with placeholder sizes and KDF metadata;
+        // it sits at the same offsets as in segment_vec, so patch it in place.
+        output_.flush(WRITE_COMPLETE_ERROR);
+        output_.writeAt(
+            INITIAL_HEADER_BYTES,
+            std::span<const Byte>(segment_vec_).subspan(INITIAL_HEADER_BYTES),
+            WRITE_COMPLETE_ERROR);
+    }
+    return iccEmbedSummary(segment_vec_.size(), encrypted_size_);
 }
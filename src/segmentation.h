@@ -2,9 +2,16 @@
 
 #include "common.h"
 
+#include <array>
+#include <deque>
+#include <memory>
+#include <optional>
 #include <span>
+#include <vector>
 
 class OutputFile;
+class WorkerPool;
+struct GatherWrite;
 
 struct SegmentedEmbedSummary {
     std::size_t embedded_image_size{0};
@@ -12,6 +19,16 @@ struct SegmentedEmbedSummary {
     uint16_t total_segments{0};
 };
 
+// Whether an image with this layout meets one platform's limits.
+[[nodiscard]] bool platformAccepts(const PlatformLimits& limits, const SegmentedEmbedSummary& summary) noexcept;
+
+// The summary IccSegmentWriter::finish would return (plus the cover JPEG's
+// size) for an encrypted payload of this size, computed without writing anything.
+[[nodiscard]] SegmentedEmbedSummary predictEmbeddedSummary(
+    std::size_t template_size,
+    std::size_t encrypted_size,
+    std::size_t jpg_size);
+
 void filterPlatforms(
     vString& platforms_vec,
     std::size_t embedded_size,
@@ -19,8 +36,62 @@ void filterPlatforms(
     uint16_t total_segments);
 
 
-[[nodiscard]] SegmentedEmbedSummary writeEmbeddedJpgFromEncryptedFile(
-    OutputFile& output,
-    vBytes& segment_vec,
-    const fs::path& encrypted_path,
-    std::span<const Byte> jpg_vec);
+// Writes segment_vec and the encrypted payload that follows it as the ICC
+// APP2 segments that open the output image, taking the ciphertext as it is
+// produced so it never has to be staged. Once the payload is complete,
+// finish() fills in the size fields and whatever segment_vec gained in the
+// meantime (the KDF metadata): in place if its first segment has already been
+// written. The caller then appends the cover JPEG, unless reserve() has.
+class IccSegmentWriter {
+public:
+    IccSegmentWriter(OutputFile& output, vBytes& segment_vec);
+    ~IccSegmentWriter();
+
+    IccSegmentWriter(const IccSegmentWriter&) = delete;
+    IccSegmentWriter& operator=(const IccSegmentWriter&) = delete;
+
+    // For a payload whose encrypted size is known before it is produced (an
+    // uncompressed one): lays the whole image out up front. The file is
+    // preallocated, so a full disk fails before any encryption; tail (the
+    // cover JPEG) is written now, at its final offset; and from then on every
+    // segment is written at its own offset, a batch submitted to an io_uring
+    // together (or, without one, split across at most `threads` of a few
+    // threads; 0 = no limit). The caller must not write tail again. Must
+    // precede append().
+    void reserve(std::size_t encrypted_size, std::span<const Byte> tail, std::size_t threads);
+
+    // Queues every segment bytes completes. Full segments within bytes are
+    // queued as views of bytes, which must stay valid until flush().
+    void append(std::span<const Byte> bytes);
+
+    // Writes every segment queued since the last flush, all in one gathered
+    // write (after reserve(): one batch of positioned writes).
+    void flush();
+
+    // Flushes first. The summary excludes the cover JPEG.
+    [[nodiscard]] SegmentedEmbedSummary finish();
+
+private:
+    // Each segment queued adds its header and data to gather_, and its offset
+    // to batch_segments_.
+    void queueSegment(std::span<const Byte> data);
+
+    OutputFile& output_;
+    vBytes& segment_vec_;
+    vBytes pending_{};                  // Current segment's data, not yet queued.
+    std::vector<vBytes> carried_{};     // Earlier pending_ buffers, queued, not yet written.
+    std::vector<vBytes> spare_{};       // Written ones, reused for pending_.
+    struct BatchSegment {
+        std::size_t first_piece{0};     // Index into gather_.
+        std::size_t offset{0};          // Where that piece goes in the file.
+    };
+
+    std::deque<std::array<Byte, 18>> headers_{};  // A deque: gather_ points into it.
+    std::vector<std::span<const Byte>> gather_{};
+    std::vector<BatchSegment> batch_segments_{};
+    std::vector<GatherWrite> ring_writes_{};
+    std::optional<std::size_t> reserved_size_{};
+    std::unique_ptr<WorkerPool> pool_{};  // Set by reserve() when there is no io_uring.
+    std::size_t encrypted_size_{0};
+    std::size_t segments_written_{0};
+};
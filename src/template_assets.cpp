@@ -9,6 +9,10 @@ extern const unsigned char _binary_templates_photoshop_segment_template_bin_star
 extern const unsigned char _binary_templates_photoshop_segment_template_bin_end[];
 extern const unsigned char _binary_templates_xmp_segment_template_bin_start[];
 extern const unsigned char _binary_templates_xmp_segment_template_bin_end[];
+extern const unsigned char _binary_templates_deflate_dict_text_bin_start[];
+extern const unsigned char _binary_templates_deflate_dict_text_bin_end[];
+extern const unsigned char _binary_templates_deflate_dict_structured_bin_start[];
+extern const unsigned char _binary_templates_deflate_dict_structured_bin_end[];
 }
 
 namespace {
@@ -45,3 +49,15 @@ std::span<const Byte> xmpSegmentTemplateBytes() noexcept {
         _binary_templates_xmp_segment_template_bin_start,
         _binary_templates_xmp_segment_template_bin_end);
 }
+
+std::span<const Byte> deflateDictTextBytes() noexcept {
+    return linkedTemplateSpan(
+        _binary_templates_deflate_dict_text_bin_start,
+        _binary_templates_deflate_dict_text_bin_end);
+}
+
+std::span<const Byte> deflateDictStructuredBytes() noexcept {
+    return linkedTemplateSpan(
+        _binary_templates_deflate_dict_structured_bin_start,
+        _binary_templates_deflate_dict_structured_bin_end);
+}
@@ -8,3 +8,5 @@
 [[nodiscard]] std::span<const Byte> blueskyExifTemplateBytes() noexcept;
 [[nodiscard]] std::span<const Byte> photoshopSegmentTemplateBytes() noexcept;
 [[nodiscard]] std::span<const Byte> xmpSegmentTemplateBytes() noexcept;
+[[nodiscard]] std::span<const Byte> deflateDictTextBytes() noexcept;
+[[nodiscard]] std::span<const Byte> deflateDictStructuredBytes() noexcept;
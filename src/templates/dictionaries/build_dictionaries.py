@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+
+"""
+Builds the preset deflate dictionaries embedded in jdvrif:
+
+ ../deflate_dict_text.bin        (English prose)
+ ../deflate_dict_structured.bin  (JSON, YAML, TOML, XML, HTML)
+
+Every input is listed, with its SHA-256, in MANIFEST.txt next to this script.
+The corpus files under corpus/ were written for jdvrif and are covered by the
+repository's MIT licence; nothing in them is copied from elsewhere.
+
+The selection is a small version of the "cover" algorithm used by zstd's
+dictionary builder: the corpus is cut into epochs, and from each epoch the
+k-byte segment whose d-byte substrings occur in the most corpus files is taken,
+after which those substrings no longer score. Segments are laid out best-last,
+since deflate reaches the end of a preset dictionary with the shortest
+distances. The output depends only on the corpus, so running the script again
+reproduces the committed .bin files byte for byte.
+
+Usage:
+
+ python3 build_dictionaries.py           # rebuild both dictionaries
+ python3 build_dictionaries.py --check   # exit 1 if the .bin files are stale
+
+Changing the dictionaries changes their Adler-32 DICTIDs; images made with the
+old ones can then no longer be recovered, so treat them as a file format.
+"""
+
+import argparse
+import hashlib
+import sys
+from pathlib import Path
+
+DICTIONARY_SIZE = 24 * 1024
+SEGMENT_SIZE = 64   # k
+DMER_SIZE = 8       # d
+MIN_FILES = 2       # A d-mer found in only one corpus file is not worth keeping.
+
+HERE = Path(__file__).resolve().parent
+MANIFEST = HERE / "MANIFEST.txt"
+OUTPUTS = {
+    "text": HERE.parent / "deflate_dict_text.bin",
+    "structured": HERE.parent / "deflate_dict_structured.bin",
+}
+
+
+def read_manifest():
+    """Returns {dictionary: [corpus bytes, ...]} after checking every hash."""
+    corpora = {name: [] for name in OUTPUTS}
+    for line_number, line in enumerate(MANIFEST.read_text(encoding="utf-8").splitlines(), 1):
+        line = line.strip()
+        if not line or line.startswith("#"):
+            continue
+        fields = line.split()
+        if len(fields) != 3 or fields[0] not in corpora:
+            sys.exit(f"MANIFEST.txt:{line_number}: expected '<text|structured> <path> <sha256>'")
+        name, relative_path, expected = fields
+        data = (HERE / relative_path).read_bytes()
+        actual = hashlib.sha256(data).hexdigest()
+        if actual != expected:
+            sys.exit(f"MANIFEST.txt:{line_number}: {relative_path} has SHA-256 {actual}, manifest says {expected}")
+        corpora[name].append(data)
+    for name, files in corpora.items():
+        if not files:
+            sys.exit(f"MANIFEST.txt: no corpus files for the {name} dictionary")
+    return corpora
+
+
+def dmer_file_counts(files):
+    """Number of corpus files each d-mer occurs in."""
+    counts = {}
+    for data in files:
+        for dmer in {data[i:i + DMER_SIZE] for i in range(len(data) - DMER_SIZE + 1)}:
+            counts[dmer] = counts.get(dmer, 0) + 1
+    return {dmer: n for dmer, n in counts.items() if n >= MIN_FILES}
+
+
+def best_segment(corpus, begin, end, scores):
+    """(score, start) of the best SEGMENT_SIZE window in corpus[begin:end]."""
+    last_start = end - SEGMENT_SIZE
+    if last_start < begin:
+        return 0, None
+
+    active = {}
+    score = 0
+    best_score, best_start = 0, None
+    dmers_per_segment = SEGMENT_SIZE - DMER_SIZE + 1
+    for i in range(begin, last_start + dmers_per_segment):
+        dmer = corpus[i:i + DMER_SIZE]
+        if active.get(dmer, 0) == 0:
+            score += scores.get(dmer, 0)
+        active[dmer] = active.get(dmer, 0) + 1
+
+        start = i - dmers_per_segment + 1
+        if start < begin:
+            continue
+        if score > best_score:
+            best_score, best_start = score, start
+
+        leaving = corpus[start:start + DMER_SIZE]
+        active[leaving] -= 1
+        if active[leaving] == 0:
+            score -= scores.get(leaving, 0)
+    return best_score, best_start
+
+
+def build_dictionary(files):
+    scores = dmer_file_counts(files)
+    # One string to cut into epochs; a NUL marks each file boundary.
+    corpus = b"\0".join(files)
+    epochs = max(1, DICTIONARY_SIZE // SEGMENT_SIZE)
+    epoch_size = max(SEGMENT_SIZE, len(corpus) // epochs)
+
+    segments = []
+    total = 0
+    progress = True
+    while total < DICTIONARY_SIZE and progress:
+        progress = False
+        for begin in range(0, len(corpus), epoch_size):
+            if total >= DICTIONARY_SIZE:
+                break
+            score, start = best_segment(corpus, begin, min(len(corpus), begin + epoch_size), scores)
+            if start is None:
+                continue
+            segment = corpus[start:start + SEGMENT_SIZE]
+            for i in range(len(segment) - DMER_SIZE + 1):
+                scores.pop(segment[i:i + DMER_SIZE], None)
+            segments.append((score, len(segments), segment))
+            total += len(segment)
+            progress = True
+
+    # Best segments go last, nearest the data; ties keep corpus order.
+    segments.sort(key=lambda entry: (entry[0], -entry[1]))
+    dictionary = b"".join(segment for _, _, segment in segments)
+    return dictionary[-DICTIONARY_SIZE:]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build jdvrif's preset deflate dictionaries.")
+    parser.add_argument("--check", action="store_true", help="only report whether the .bin files are up to date")
+    args = parser.parse_args()
+
+    stale = False
+    for name, files in read_manifest().items():
+        dictionary = build_dictionary(files)
+        output = OUTPUTS[name]
+        if args.check:
+            if not output.exists() or output.read_bytes() != dictionary:
+                print(f"{output.name}: out of date")
+                stale = True
+            continue
+        output.write_bytes(dictionary)
+        print(f"{output.name}: {len(dictionary)} bytes from {len(files)} corpus files")
+    return 1 if stale else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -59,6 +59,118 @@ for name, (size, seed) in specs.items():
     path.write_bytes(bytes(rng.randrange(256) for _ in range(size)))
 PY
 
+# Executable and PCM audio payloads for the conversion filters (x86 and ARM64
+# branch converters, delta). Only the headers jdvrif sniffs are real; the
+# bodies are seeded pseudo-code and a noisy tone, compressible enough to get
+# past the compression probe and a few hundred KiB long, so each crosses
+# several 64 KiB filter blocks.
+DATA="$DATA" python3 - <<'PY'
+import math
+import os
+import random
+import struct
+from pathlib import Path
+
+root = Path(os.environ["DATA"]) / "payloads"
+SIZE = 320 * 1024
+
+
+def x86_code(rng, size, base):
+    # Function bodies from a few common instruction sequences, with E8/E9
+    # rel32 calls and jumps to a fixed set of function addresses.
+    snippets = [
+        b"\x55\x48\x89\xe5",                  # push rbp; mov rbp, rsp
+        b"\x48\x83\xec\x20",                  # sub rsp, 0x20
+        b"\x48\x89\x7d\xf8",                  # mov [rbp-8], rdi
+        b"\x8b\x45\xfc",                       # mov eax, [rbp-4]
+        b"\x48\x8b\x45\xf8",                  # mov rax, [rbp-8]
+        b"\x31\xc0",                            # xor eax, eax
+        b"\x85\xc0\x74\x0a",                  # test eax, eax; je +10
+        b"\x48\x8d\x3d\x00\x10\x00\x00",  # lea rdi, [rip+0x1000]
+        b"\xc9\xc3",                            # leave; ret
+        b"\x90",                                 # nop
+    ]
+    functions = sorted(rng.sample(range(0, size - 64, 16), 200))
+    out = bytearray()
+    while len(out) < size:
+        if rng.random() < 0.25:
+            target = base + rng.choice(functions)
+            opcode = 0xE8 if rng.random() < 0.85 else 0xE9
+            rel = (target - (base + len(out) + 5)) & 0xFFFFFFFF
+            out += bytes([opcode]) + struct.pack("<I", rel)
+        else:
+            out += rng.choice(snippets)
+    return bytes(out[:size])
+
+
+def arm64_code(rng, size):
+    words = [
+        0xA9BF7BFD,  # stp x29, x30, [sp, #-16]!
+        0x910003FD,  # mov x29, sp
+        0xF9400BE0,  # ldr x0, [sp, #16]
+        0xB9400FE1,  # ldr w1, [sp, #12]
+        0x2A0003E2,  # mov w2, w0
+        0x52800000,  # mov w0, #0
+        0x34000060,  # cbz w0, +12
+        0xA8C17BFD,  # ldp x29, x30, [sp], #16
+        0xD65F03C0,  # ret
+        0xD503201F,  # nop
+    ]
+    count = size // 4
+    functions = sorted(rng.sample(range(count), 200))
+    out = bytearray()
+    for index in range(count):
+        if rng.random() < 0.2:
+            offset = rng.choice(functions) - index
+            out += struct.pack("<I", 0x94000000 | (offset & 0x03FFFFFF))  # bl
+        else:
+            out += struct.pack("<I", rng.choice(words))
+    return bytes(out)
+
+
+def elf_header(machine):
+    # ELFCLASS64, ELFDATA2LSB, EV_CURRENT; ET_EXEC for the given e_machine.
+    ident = b"\x7fELF\x02\x01\x01" + bytes(9)
+    return ident + struct.pack("<HHI", 2, machine, 1) + bytes(64 - 24)
+
+
+def pe_header():
+    # MZ stub pointing at a PE signature for IMAGE_FILE_MACHINE_AMD64.
+    stub = bytearray(0x80)
+    stub[0:2] = b"MZ"
+    stub[0x3C:0x40] = struct.pack("<I", 0x80)
+    return bytes(stub) + b"PE\0\0" + struct.pack("<H", 0x8664) + bytes(18)
+
+
+def wav_file(rng, size):
+    rate, channels, bits = 44100, 2, 16
+    block_align = channels * bits // 8
+    frames = (size - 44) // block_align
+    samples = bytearray()
+    for n in range(frames):
+        t = n / rate
+        left = 9000 * math.sin(2 * math.pi * 220 * t) + 3000 * math.sin(2 * math.pi * 660 * t)
+        right = 8000 * math.sin(2 * math.pi * 330 * t + 1.0)
+        samples += struct.pack("<hh", int(left) + rng.randint(-24, 24), int(right) + rng.randint(-24, 24))
+    fmt = struct.pack("<HHIIHH", 1, channels, rate, rate * block_align, block_align, bits)
+    return (b"RIFF" + struct.pack("<I", 36 + len(samples)) + b"WAVE" +
+            b"fmt " + struct.pack("<I", len(fmt)) + fmt +
+            b"data" + struct.pack("<I", len(samples)) + bytes(samples))
+
+
+builders = {
+    "payload_x86.elf": lambda rng: elf_header(62) + x86_code(rng, SIZE - 64, 0x401000),
+    "payload_arm64.elf": lambda rng: elf_header(183) + arm64_code(rng, SIZE - 64),
+    "payload_x86.exe": lambda rng: pe_header() + x86_code(rng, SIZE - len(pe_header()), 0x140001000),
+    "payload_pcm.wav": lambda rng: wav_file(rng, SIZE),
+}
+for seed, (name, build) in enumerate(builders.items(), start=50):
+    path = root / name
+    if path.exists():
+        continue
+    path.write_bytes(build(random.Random(seed)))
+PY
+
 archive_src="$DATA/payloads/archive_src"
 archive_path="$DATA/payloads/payload_archive.zip"
 if [[ ! -f "$archive_path" ]]; then
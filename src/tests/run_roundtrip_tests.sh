@@ -308,6 +308,7 @@ PY
 
 PASS=0
 FAIL=0
+SKIP=0
 
 run_case() {
     local case_id="$1"
@@ -315,10 +316,16 @@ run_case() {
     local cover_rel="$3"
     local payload_rel="$4"
     local expected_table_layout="$5"
+    local expected_filter="${6:-}"
 
     local cover="$TESTS/$cover_rel"
     local payload="$TESTS/$payload_rel"
     local work="$TESTS/.work_roundtrip/$case_id"
+    # A --threads limit given to conceal is given to verify and recover too.
+    local -a recover_options=()
+    if [[ " $option " =~ \ --threads\ ([0-9]+)\  ]]; then
+        recover_options=(--threads "${BASH_REMATCH[1]}")
+    fi
 
     if [[ ! -f "$cover" ]]; then
         echo "[FAIL] $case_id: missing cover $cover_rel" >&2
@@ -332,9 +339,13 @@ run_case() {
     rm -rf "$work"
     mkdir -p "$work"
 
+    # The option field may hold several words (e.g. "--codec zstd").
+    local -a option_args=()
+    read -ra option_args <<< "$option"
+
     pushd "$work" >/dev/null
     if [[ -n "$option" ]]; then
-        if ! "$BIN" conceal "$option" "$cover" "$payload" > conceal.log 2>&1; then
+        if ! "$BIN" conceal "${option_args[@]}" "$cover" "$payload" > conceal.log 2>&1; then
             popd >/dev/null
             echo "[FAIL] $case_id: conceal command failed" >&2
             cat "$work/conceal.log" >&2
@@ -360,6 +371,13 @@ run_case() {
         return 1
     fi
 
+    if [[ -n "$expected_filter" ]] && ! grep -qxF "  Filter: $expected_filter." conceal.log; then
+        popd >/dev/null
+        echo "[FAIL] $case_id: expected the $expected_filter filter" >&2
+        cat "$work/conceal.log" >&2
+        return 1
+    fi
+
     if [[ "$expected_table_layout" != "." ]] &&
        ! assert_table_layout \
            "$embedded" \
@@ -371,7 +389,23 @@ run_case() {
         return 1
     fi
 
-    if ! printf '%s\n' "$pin" | "$BIN" recover "$embedded" > recover.log 2>&1; then
+    # verify must authenticate the payload without leaving anything behind.
+    local files_before
+    files_before="$(ls -A)"
+    if ! printf '%s\n' "$pin" | "$BIN" verify "${recover_options[@]}" "$embedded" > verify.log 2>&1 ||
+       ! grep -q "^Verified hidden file: " verify.log; then
+        popd >/dev/null
+        echo "[FAIL] $case_id: verify command failed" >&2
+        cat "$work/verify.log" >&2
+        return 1
+    fi
+    if [[ "$(ls -A | grep -vx verify.log)" != "$files_before" ]]; then
+        popd >/dev/null
+        echo "[FAIL] $case_id: verify wrote files" >&2
+        return 1
+    fi
+
+    if ! printf '%s\n' "$pin" | "$BIN" recover "${recover_options[@]}" "$embedded" > recover.log 2>&1; then
         popd >/dev/null
         echo "[FAIL] $case_id: recover command failed" >&2
         cat "$work/recover.log" >&2
@@ -398,11 +432,80 @@ run_case() {
     return 0
 }
 
+# conceal-batch: every image of the batch must recover on its own with the
+# one PIN printed for the batch.
+run_batch_case() {
+    local case_id="$1"
+    local cover="$TESTS/$2"
+    shift 2
+    local -a payloads=()
+    local rel
+    for rel in "$@"; do
+        payloads+=("$TESTS/$rel")
+    done
+    local work="$TESTS/.work_roundtrip/$case_id"
+
+    rm -rf "$work"
+    mkdir -p "$work"
+    pushd "$work" >/dev/null
+    if ! "$BIN" conceal-batch --kdf-ops 1 --kdf-mem 16M "$cover" "${payloads[@]}" > conceal.log 2>&1; then
+        popd >/dev/null
+        echo "[FAIL] $case_id: conceal-batch command failed" >&2
+        cat "$work/conceal.log" >&2
+        return 1
+    fi
+
+    local pin
+    pin="$(extract_pin conceal.log)"
+    if [[ -z "$pin" ]]; then
+        popd >/dev/null
+        echo "[FAIL] $case_id: failed to parse batch PIN" >&2
+        cat "$work/conceal.log" >&2
+        return 1
+    fi
+
+    local payload embedded recovered
+    for payload in "${payloads[@]}"; do
+        embedded="$(sed -n "s|.*Saved \"file-embedded\" JPG image: \(.*\) ([0-9][0-9]* bytes) <- ${payload}\.\$|\1|p" conceal.log)"
+        if [[ -z "$embedded" || ! -f "$embedded" ]]; then
+            popd >/dev/null
+            echo "[FAIL] $case_id: no output image reported for $payload" >&2
+            cat "$work/conceal.log" >&2
+            return 1
+        fi
+        mkdir -p "recover_$embedded"
+        if ! (cd "recover_$embedded" && printf '%s\n' "$pin" | "$BIN" recover "../$embedded" > recover.log 2>&1); then
+            popd >/dev/null
+            echo "[FAIL] $case_id: recover of $embedded failed" >&2
+            cat "$work/recover_$embedded/recover.log" >&2
+            return 1
+        fi
+        recovered="$(extract_recovered_file "recover_$embedded/recover.log")"
+        if [[ -z "$recovered" ]] || ! cmp -s "recover_$embedded/$recovered" "$payload"; then
+            popd >/dev/null
+            echo "[FAIL] $case_id: recovered bytes differ from $payload" >&2
+            return 1
+        fi
+    done
+
+    popd >/dev/null
+    echo "[PASS] $case_id"
+    return 0
+}
+
 CASES=(
     $'default\t.\ttestdata/covers/cover_default.jpg\ttestdata/payloads/payload_text.txt\t.'
     $'default_multiseg\t.\ttestdata/covers/cover_default.jpg\ttestdata/payloads/payload_multi.bin\t.'
     $'default_space_name\t.\ttestdata/covers/cover_default.jpg\t.work_roundtrip/input_payloads/payload space.txt\t.'
     $'default_zip\t.\ttestdata/covers/cover_default.jpg\ttestdata/payloads/payload_archive.zip\t.'
+    $'default_zstd\t--codec zstd\ttestdata/covers/cover_default.jpg\ttestdata/payloads/payload_text.txt\t.'
+    $'default_dictionary\t--dictionary\ttestdata/covers/cover_default.jpg\ttestdata/payloads/payload_text.txt\t.'
+    $'default_dictionary_json\t--dictionary\ttestdata/covers/cover_default.jpg\t../templates/dictionaries/corpus/structured/package.json\t.'
+    $'default_indexed\t--indexed\ttestdata/covers/cover_default.jpg\t.work_roundtrip/input_payloads/payload_large.txt\t.'
+    $'default_threads\t--threads 1\ttestdata/covers/cover_default.jpg\ttestdata/payloads/payload_multi.bin\t.'
+    $'default_indexed_threads\t--indexed --threads 2\ttestdata/covers/cover_default.jpg\t.work_roundtrip/input_payloads/payload_large.txt\t.'
+    $'default_small_frames\t--frame-size 64K\ttestdata/covers/cover_default.jpg\ttestdata/payloads/payload_multi.bin\t.'
+    $'default_kdf_cost\t--kdf-ops 1 --kdf-mem 16M\ttestdata/covers/cover_default.jpg\ttestdata/payloads/payload_text.txt\t.'
     $'bluesky\t-b\ttestdata/covers/cover_bluesky.jpg\ttestdata/payloads/bsingle.bin\t.'
     $'bluesky_split\t-b\ttestdata/covers/cover_bluesky.jpg\ttestdata/payloads/bsplit.bin\t.'
     $'bluesky_xmp\t-b\ttestdata/covers/cover_bluesky.jpg\ttestdata/payloads/bxmp.bin\t.'
@@ -410,11 +513,47 @@ CASES=(
     $'dqt_bluesky\t-b\t.work_roundtrip/input_covers/two_tables.jpg\ttestdata/payloads/payload_text.txt\tbaseline_split'
 )
 
+# Conversion-filter fixtures: id, fixture under testdata/payloads, and the
+# filter --stats must report for it.
+FILTER_PAYLOADS=(
+    $'x86_elf\tpayload_x86.elf\tx86 branch converter'
+    $'arm64_elf\tpayload_arm64.elf\tARM64 branch converter'
+    $'x86_pe\tpayload_x86.exe\tx86 branch converter'
+    $'pcm_wav\tpayload_pcm.wav\tdelta'
+)
+# Each fixture runs with every codec layout: id, conceal options, and where
+# its payload comes from. --indexed only splits payloads of more than one
+# 16 MiB member, so it gets the fixture repeated past 17 MiB.
+FILTER_MODES=(
+    $'zlib\t.\ttestdata/payloads'
+    $'zstd\t--codec zstd\ttestdata/payloads'
+    $'indexed\t--indexed\t.work_roundtrip/input_payloads/large'
+)
+
 mkdir -p "$TESTS/.work_roundtrip"
 trap 'rm -rf "$TESTS/.work_roundtrip"' EXIT
 mkdir -p "$TESTS/.work_roundtrip/input_payloads"
 cp "$TESTS/testdata/payloads/payload_text.txt" \
     "$TESTS/.work_roundtrip/input_payloads/payload space.txt"
+# Just over two 16 MiB members, so --indexed writes a short final member.
+python3 - "$TESTS/.work_roundtrip/input_payloads/payload_large.txt" <<'PY'
+import sys
+from pathlib import Path
+
+lines = (f"{i:08d} the quick brown fox jumps over the lazy dog\n" for i in range(700000))
+Path(sys.argv[1]).write_text("".join(lines))
+PY
+mkdir -p "$TESTS/.work_roundtrip/input_payloads/large"
+for row in "${FILTER_PAYLOADS[@]}"; do
+    IFS=$'\t' read -r _ fixture _ <<<"$row"
+    python3 - "$TESTS/testdata/payloads/$fixture" "$TESTS/.work_roundtrip/input_payloads/large/$fixture" <<'PY'
+import sys
+from pathlib import Path
+
+data = Path(sys.argv[1]).read_bytes()
+Path(sys.argv[2]).write_bytes(data * (17 * 1024 * 1024 // len(data) + 1))
+PY
+done
 mkdir -p "$TESTS/.work_roundtrip/input_covers"
 python3 - \
     "$TESTS/testdata/covers/cover_tables.jpg" \
@@ -525,10 +664,52 @@ for row in "${CASES[@]}"; do
     fi
 done
 
+for payload_row in "${FILTER_PAYLOADS[@]}"; do
+    IFS=$'\t' read -r payload_id fixture filter_name <<<"$payload_row"
+    for mode_row in "${FILTER_MODES[@]}"; do
+        IFS=$'\t' read -r mode_id option payload_dir <<<"$mode_row"
+        if [[ "$option" == "." ]]; then
+            option=""
+        fi
+        if run_case "filter_${payload_id}_${mode_id}" "--stats $option" \
+               testdata/covers/cover_default.jpg "$payload_dir/$fixture" . "$filter_name"; then
+            PASS=$((PASS + 1))
+        else
+            FAIL=$((FAIL + 1))
+        fi
+    done
+done
+
+# AES-256-GCM needs hardware AES; bench-cipher says when this CPU lacks it.
+if "$BIN" bench-cipher | grep -q "AES-256-GCM .*not available"; then
+    echo "[SKIP] default_aes256gcm: no hardware AES on this CPU"
+    SKIP=$((SKIP + 1))
+elif run_case default_aes256gcm "--cipher aes256gcm" testdata/covers/cover_default.jpg \
+         testdata/payloads/payload_multi.bin .; then
+    PASS=$((PASS + 1))
+else
+    FAIL=$((FAIL + 1))
+fi
+
+if run_batch_case batch testdata/covers/cover_default.jpg \
+       testdata/payloads/payload_text.txt testdata/payloads/payload_multi.bin testdata/payloads/payload_archive.zip; then
+    PASS=$((PASS + 1))
+else
+    FAIL=$((FAIL + 1))
+fi
+
 echo
-echo "Round-trip test summary: PASS=$PASS FAIL=$FAIL"
+echo "Round-trip test summary: PASS=$PASS FAIL=$FAIL SKIP=$SKIP"
 echo "Binary: $BIN"
 
 if [[ "$FAIL" -ne 0 ]]; then
     exit 1
 fi
+
+# The segment writer batches its writes through io_uring where the kernel
+# allows it; run the whole suite again on the pwritev() fallback.
+if [[ -z "${JDVRIF_DISABLE_IO_URING:-}" ]]; then
+    echo
+    echo "Repeating with JDVRIF_DISABLE_IO_URING=1"
+    JDVRIF_DISABLE_IO_URING=1 bash "${BASH_SOURCE[0]}" --no-build --bin "$BIN"
+fi
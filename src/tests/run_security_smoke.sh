@@ -208,7 +208,7 @@ test_wrong_pin() {
 test_authenticated_compression_mode() {
     local dir="$WORK/compression_tamper"
     mkdir -p "$dir"
-    python3 - "$EMBEDDED" "$dir/input.jpg" "$dir/downgrade.jpg" <<'PY'
+    python3 - "$EMBEDDED" "$dir/input.jpg" "$dir/downgrade.jpg" "$dir/zstd.jpg" "$dir/downgrade_v3.jpg" <<'PY'
 import sys
 from pathlib import Path
 
@@ -220,20 +220,25 @@ base = mntr - 8
 flag = base + 0x68
 if flag >= len(data):
     raise SystemExit("compression marker out of bounds")
-if data[flag] == 0x58:
-    raise SystemExit("fresh small payload unexpectedly bypassed compression")
+if data[flag] in (0x58, 0x5A):
+    raise SystemExit("fresh small payload unexpectedly not zlib-compressed")
+data[flag] = 0x5A
+Path(sys.argv[4]).write_bytes(data)
 data[flag] = 0x58
 Path(sys.argv[2]).write_bytes(data)
 
-# The version marker is mutable metadata too. Downgrading KDF3 to legacy KDF2
-# must not remove the associated-data check and resurrect the old ambiguity.
+# The version marker is mutable metadata too. Downgrading KDF5 to KDF3, or to
+# legacy KDF2, must not remove the associated-data check and resurrect the old
+# ambiguity.
 kdf = base + 0x2FB
-if data[kdf:kdf + 4] != b"KDF3":
-    raise SystemExit("fresh fixture did not use authenticated KDF3 framing")
+if data[kdf:kdf + 4] != b"KDF5":
+    raise SystemExit("fresh fixture did not use parallel KDF5 framing")
 data[kdf:kdf + 4] = b"KDF2"
 Path(sys.argv[3]).write_bytes(data)
+data[kdf:kdf + 4] = b"KDF3"
+Path(sys.argv[5]).write_bytes(data)
 PY
-    for image in input.jpg downgrade.jpg; do
+    for image in input.jpg downgrade.jpg downgrade_v3.jpg zstd.jpg; do
         if (
             cd "$dir"
             printf '%s\n' "$PIN" | "$BIN" recover "$image" > "recover-$image.log" 2>&1
@@ -273,6 +278,163 @@ PY
     assert_no_recovered_payload "$dir"
 }
 
+# verify must reject what recover rejects, say "Verification failed!", and,
+# like a successful verify, leave no file behind.
+test_verify_rejects_tampering() {
+    local dir="$WORK/verify_tamper"
+    local wrong_pin=0 image pin files_before
+    if [[ "$PIN" == "0" ]]; then wrong_pin=1; fi
+    mkdir -p "$dir/images" "$dir/logs"
+    python3 - "$EMBEDDED" "$dir/images" <<'PY'
+import sys
+from pathlib import Path
+
+data = bytearray(Path(sys.argv[1]).read_bytes())
+out = Path(sys.argv[2])
+mntr = data.find(b"mntrRGB")
+if mntr < 8:
+    raise SystemExit("ICC signature not found")
+base = mntr - 8
+size = int.from_bytes(data[base + 0x2CA:base + 0x2CE], "big")
+payload = base + 0x33B
+if size < 2 or payload + size > len(data):
+    raise SystemExit("unexpected embedded layout")
+(out / "intact.jpg").write_bytes(data)
+(out / "truncated.jpg").write_bytes(data[:payload + size - 1])
+data[payload + size // 2] ^= 0x01
+(out / "flipped.jpg").write_bytes(data)
+PY
+    for image in flipped.jpg truncated.jpg intact.jpg; do
+        pin="$PIN"
+        if [[ "$image" == intact.jpg ]]; then pin="$wrong_pin"; fi
+        files_before="$(ls -A "$dir/images")"
+        if (
+            cd "$dir/images"
+            printf '%s\n' "$pin" | "$BIN" verify "$image" > "$dir/logs/verify-$image.log" 2>&1
+        ); then
+            echo "verify accepted $image (PIN $pin)" >&2
+            return 1
+        fi
+        if ! grep -qx "Verification failed!" "$dir/logs/verify-$image.log"; then
+            echo "verify of $image did not report \"Verification failed!\"" >&2
+            cat "$dir/logs/verify-$image.log" >&2
+            return 1
+        fi
+        if [[ "$(ls -A "$dir/images")" != "$files_before" ]]; then
+            echo "verify of $image left files behind" >&2
+            return 1
+        fi
+        assert_no_stage_files "$dir/images"
+    done
+}
+
+# A crafted image must not be able to demand an unbounded Argon2id memlimit
+# (or a zero-cost one): recover refuses the cost before reading a PIN.
+test_kdf_cost_bounds() {
+    local dir="$WORK/kdf_cost"
+    mkdir -p "$dir"
+    python3 - "$EMBEDDED" "$dir/huge_mem.jpg" "$dir/zero_ops.jpg" <<'PY'
+import sys
+from pathlib import Path
+
+data = bytearray(Path(sys.argv[1]).read_bytes())
+mntr = data.find(b"mntrRGB")
+if mntr < 8:
+    raise SystemExit("ICC signature not found")
+kdf = mntr - 8 + 0x2FB
+if data[kdf:kdf + 4] != b"KDF5":
+    raise SystemExit("fresh fixture did not record a KDF cost")
+data[kdf + 49] = 40
+Path(sys.argv[2]).write_bytes(data)
+data[kdf + 49] = 26
+data[kdf + 48] = 0
+Path(sys.argv[3]).write_bytes(data)
+PY
+    for image in huge_mem.jpg zero_ops.jpg; do
+        if (
+            cd "$dir"
+            printf '%s\n' "$PIN" | "$BIN" recover "$image" > "recover-$image.log" 2>&1
+        ); then
+            echo "recovery accepted an out-of-range KDF cost from $image" >&2
+            return 1
+        fi
+        if ! grep -q "key derivation cost" "$dir/recover-$image.log"; then
+            echo "out-of-range KDF cost in $image was not reported as such" >&2
+            return 1
+        fi
+    done
+    assert_no_recovered_payload "$dir"
+}
+
+# An image that cannot fit its --target must fail before Argon2id starts: with
+# 16 passes over 1 GiB the KDF alone takes many seconds, the failure should not.
+test_target_failure_precedes_kdf() {
+    local dir="$WORK/target_fail_fast"
+    local mode start elapsed_ms
+    mkdir -p "$dir"
+    head -c $((256 * 1024)) /dev/urandom > "$dir/large.bin"
+    cp "$PAYLOAD" "$dir/small.txt"
+    for mode in conceal conceal-batch; do
+        start="$(date +%s%N)"
+        if (
+            cd "$dir"
+            if [[ "$mode" == conceal ]]; then
+                "$BIN" conceal --target X-Twitter --kdf-ops 16 --kdf-mem 1G "$COVER" large.bin
+            else
+                "$BIN" conceal-batch --target X-Twitter --kdf-ops 16 --kdf-mem 1G "$COVER" large.bin small.txt
+            fi > "$mode.log" 2>&1
+        ); then
+            echo "$mode fitted 256 KiB of random data to X-Twitter" >&2
+            return 1
+        fi
+        elapsed_ms=$(( ($(date +%s%N) - start) / 1000000 ))
+        if ! grep -q "does not fit X-Twitter" "$dir/$mode.log"; then
+            echo "$mode did not report the failed --target fit" >&2
+            cat "$dir/$mode.log" >&2
+            return 1
+        fi
+        if [[ "$elapsed_ms" -gt 5000 ]]; then
+            echo "$mode took ${elapsed_ms} ms to fail --target: the KDF ran first" >&2
+            return 1
+        fi
+        assert_no_stage_files "$dir"
+    done
+}
+
+# KDF byte 6 names the frame cipher suite. A value this build does not know
+# must be refused as such, not tried with the wrong cipher.
+test_unknown_cipher_suite() {
+    local dir="$WORK/unknown_cipher"
+    mkdir -p "$dir"
+    python3 - "$EMBEDDED" "$dir/input.jpg" <<'PY'
+import sys
+from pathlib import Path
+
+data = bytearray(Path(sys.argv[1]).read_bytes())
+mntr = data.find(b"mntrRGB")
+if mntr < 8:
+    raise SystemExit("ICC signature not found")
+kdf = mntr - 8 + 0x2FB
+if data[kdf:kdf + 4] != b"KDF5":
+    raise SystemExit("fresh fixture did not record a cipher suite")
+data[kdf + 6] = 0x7F
+Path(sys.argv[2]).write_bytes(data)
+PY
+    if (
+        cd "$dir"
+        printf '%s\n' "$PIN" | "$BIN" recover input.jpg > recover.log 2>&1
+    ); then
+        echo "recovery accepted an unknown cipher suite" >&2
+        return 1
+    fi
+    if ! grep -q "uses a cipher this version of jdvrif does not support" "$dir/recover.log"; then
+        echo "unknown cipher suite was not reported as such" >&2
+        cat "$dir/recover.log" >&2
+        return 1
+    fi
+    assert_no_recovered_payload "$dir"
+}
+
 patch_declared_size() {
     local input="$1"
     local output="$2"
@@ -734,9 +896,12 @@ PY
     assert_no_recovered_payload "$dir"
 }
 
-test_signal_cleans_compression_stage() {
+# conceal writes the image to a staged .jrif_*.jpg.jdvrif_tmp_* file next to
+# the output and renames it into place only when complete; SIGINT part way
+# through must remove the staged file and commit nothing.
+test_signal_cleans_staged_output() {
     local dir="$WORK/signal_cleanup"
-    local pid status seen=0
+    local pid status staged=""
     if ! command -v truncate >/dev/null 2>&1; then
         echo "truncate is unavailable; sparse interrupt fixture not generated" >&2
         return 77
@@ -750,9 +915,9 @@ test_signal_cleans_compression_stage() {
     pid=$!
 
     for ((attempt = 0; attempt < 1000; ++attempt)); do
-        if find "$dir" -maxdepth 1 -type f -name '.jdvrif_comp_*' -print -quit | grep -q .; then
-            seen=1
-            kill -TERM "$pid"
+        staged="$(find "$dir" -maxdepth 1 -type f -name '.jrif_*.jpg.jdvrif_tmp_*' -print -quit)"
+        if [[ -n "$staged" ]]; then
+            kill -INT "$pid"
             break
         fi
         if ! kill -0 "$pid" 2>/dev/null; then
@@ -761,10 +926,10 @@ test_signal_cleans_compression_stage() {
         sleep 0.01
     done
 
-    if [[ "$seen" -eq 0 ]]; then
-        if kill -0 "$pid" 2>/dev/null; then kill -TERM "$pid"; fi
+    if [[ -z "$staged" ]]; then
+        if kill -0 "$pid" 2>/dev/null; then kill -INT "$pid"; fi
         wait "$pid" 2>/dev/null || true
-        echo "did not observe the compression staging file before process exit" >&2
+        echo "did not observe the staged output image before process exit" >&2
         return 1
     fi
 
@@ -776,6 +941,10 @@ test_signal_cleans_compression_stage() {
         echo "signal-interrupted conceal returned success" >&2
         return 1
     fi
+    if [[ -e "$staged" ]]; then
+        echo "staged output survived SIGINT: $staged" >&2
+        return 1
+    fi
     assert_no_stage_files "$dir"
     if find "$dir" -maxdepth 1 -type f -name 'jrif_*.jpg' -print -quit | grep -q .; then
         echo "signal-interrupted conceal committed an output image" >&2
@@ -788,6 +957,10 @@ run_test "--info build and Bluesky examples" test_info_documentation
 run_test "wrong PIN leaves no plaintext or stages" test_wrong_pin
 run_test "compression mode is authenticated" test_authenticated_compression_mode
 run_test "truncated ciphertext is rejected" test_truncated_ciphertext
+run_test "verify rejects a flipped byte, truncation and a wrong PIN" test_verify_rejects_tampering
+run_test "out-of-range KDF cost is refused" test_kdf_cost_bounds
+run_test "--target failure precedes the KDF" test_target_failure_precedes_kdf
+run_test "unknown cipher suite is refused" test_unknown_cipher_suite
 run_test "default recovery 50 MiB wiggle room" test_default_recovery_wiggle_room
 run_test "dangling output symlink is a collision" test_dangling_symlink_collision
 run_test "PIN delivery failure does not commit output" test_pin_delivery_failure_is_transactional
@@ -797,7 +970,7 @@ run_test "CMYK covers are rejected" test_cmyk_cover_rejected
 run_test "post-transform dimensions are revalidated" test_post_transform_dimensions
 run_test "quality limit applies only to default conceal" test_referenced_nonzero_dqt_quality
 run_test "terminal state is restored after SIGINT" test_terminal_restored_after_interrupt
-run_test "signal interruption cleans compression stage" test_signal_cleans_compression_stage
+run_test "signal interruption cleans staged output" test_signal_cleans_staged_output
 
 echo
 echo "Security smoke summary: PASS=$PASS FAIL=$FAIL SKIP=$SKIP"